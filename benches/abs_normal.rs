@@ -1,11 +1,10 @@
-#![feature(test)]
-
 extern crate advantage as adv;
-extern crate test;
+#[macro_use]
+extern crate criterion;
 
 use adv::prelude::*;
 use adv::Float;
-use test::Bencher;
+use criterion::{black_box, Criterion};
 
 fn test_function<T: Float>(input: Vec<T>) -> T {
     input
@@ -23,36 +22,41 @@ fn test_function_tape() -> impl adv::Tape {
     ctx.tape()
 }
 
-#[bench]
-fn abs_normal_mul_left(b: &mut Bencher) {
+fn abs_normal_mul_left(c: &mut Criterion) {
     let mut tape = test_function_tape();
     tape.zero_order(&adv::DVector::from_element(tape.num_indeps(), 1.0));
     let s = tape.num_abs();
 
-    let tape = test::black_box(Box::new(tape));
+    let tape = black_box(Box::new(tape));
     let abs_tape = adv::drivers::AbsNormalTape::new(tape);
     let abs_l = adv::drivers::AbsNormalL::new(&abs_tape);
     let ybar = adv::DMatrix::from_element(1, s, 1.0);
 
-    b.iter(|| {
-        let ybar = test::black_box(&ybar);
-        abs_l.mul_left(ybar)
+    c.bench_function("abs_normal_mul_left", |b| {
+        b.iter(|| {
+            let ybar = black_box(&ybar);
+            abs_l.mul_left(ybar)
+        })
     });
 }
 
-#[bench]
-fn abs_normal_mul_right(b: &mut Bencher) {
+fn abs_normal_mul_right(c: &mut Criterion) {
     let mut tape = test_function_tape();
     tape.zero_order(&adv::DVector::from_element(tape.num_indeps(), 1.0));
     let s = tape.num_abs();
 
-    let tape = test::black_box(Box::new(tape));
+    let tape = black_box(Box::new(tape));
     let abs_tape = adv::drivers::AbsNormalTape::new(tape);
     let abs_l = adv::drivers::AbsNormalL::new(&abs_tape);
     let dx = adv::DMatrix::from_element(s, 1, 1.0);
 
-    b.iter(|| {
-        let dx = test::black_box(&dx);
-        abs_l.mul_right(dx)
+    c.bench_function("abs_normal_mul_right", |b| {
+        b.iter(|| {
+            let dx = black_box(&dx);
+            abs_l.mul_right(dx)
+        })
     });
 }
+
+criterion_group!(benches, abs_normal_mul_left, abs_normal_mul_right);
+criterion_main!(benches);
@@ -0,0 +1,61 @@
+//! Scalable test function shared by the benchmarks
+#![allow(dead_code)]
+
+use adv::prelude::*;
+use adv::Float;
+
+/// Tape sizes in number of independents
+pub const SIZES: [usize; 3] = [100, 1_000, 10_000];
+
+/// Thread counts of the parallel benchmarks
+pub const THREADS: [usize; 4] = [1, 2, 4, 8];
+
+/// Smooth function of `n` arguments with `n` results
+pub fn model<T: Float>(x: &[T]) -> Vec<T> {
+    let n = x.len();
+    let mut v = x.to_vec();
+    for _ in 0..4 {
+        v = (0..n)
+            .map(|i| (v[i] * v[(i + 1) % n]).sin() + v[(i + 2) % n] / (v[i] * v[i] + T::one()))
+            .collect();
+    }
+    v
+}
+
+/// Record `model` with `n` independents
+pub fn record(n: usize) -> impl adv::Tape + Clone {
+    let mut ctx = adv::AContext::new();
+    let x = ctx.new_indep_vec(n, 0.5);
+    ctx.set_dep_slice(&model(&x));
+    ctx.tape()
+}
+
+/// Point at which `model` is evaluated
+pub fn point(n: usize) -> adv::DVector<f64> {
+    adv::DVector::from_fn(n, |i, _| 0.1 + 0.8 * i as f64 / n as f64)
+}
+
+/// Number of operations on the tape of `model`
+pub fn num_ops(n: usize) -> u64 {
+    record(n).ops_iter().count() as u64
+}
+
+/// Print the size and memory use of the tape of `model`
+pub fn print_stats(n: usize) {
+    let stats = adv::profile::TapeStats::from_tape(&record(n));
+    eprintln!(
+        "model({}): {} ops, {:.1} bytes/op, {} peak live values",
+        n,
+        stats.num_ops,
+        stats.bytes as f64 / stats.num_ops as f64,
+        stats.peak_live_values
+    );
+}
+
+/// Rayon pool with `threads` threads
+pub fn pool(threads: usize) -> rayon::ThreadPool {
+    rayon::ThreadPoolBuilder::new()
+        .num_threads(threads)
+        .build()
+        .unwrap()
+}
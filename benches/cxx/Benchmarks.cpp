@@ -0,0 +1,113 @@
+#include <benchmark/benchmark.h>
+#include <adv.hpp>
+
+#include <string>
+#include <vector>
+
+/// Smooth function of `n` arguments with `n` results, like in the Rust benchmarks
+static std::vector<adv::ADouble> model(std::vector<adv::ADouble> v)
+{
+	auto n = v.size();
+	for (int round = 0; round < 4; ++round) {
+		std::vector<adv::ADouble> next;
+		next.reserve(n);
+		for (std::size_t i = 0; i < n; ++i) {
+			next.push_back(adv::sin(v[i] * v[(i + 1) % n]) + v[(i + 2) % n] / (1.0 + v[i] * v[i]));
+		}
+		v = std::move(next);
+	}
+	return v;
+}
+
+/// `model` with every statement recorded as one expression block
+static std::vector<adv::ADouble> model_expression(std::vector<adv::ADouble> v)
+{
+	auto n = v.size();
+	for (int round = 0; round < 4; ++round) {
+		std::vector<adv::ADouble> next;
+		next.reserve(n);
+		for (std::size_t i = 0; i < n; ++i) {
+			auto a = adv::lazy(v[i]);
+			next.push_back(adv::sin(a * v[(i + 1) % n]) + v[(i + 2) % n] / (1.0 + a * v[i]));
+		}
+		v = std::move(next);
+	}
+	return v;
+}
+
+template<class F>
+static adv::Tape record(std::size_t n, F func)
+{
+	adv::AContext ctx;
+	ctx.set_dependents(func(ctx.new_independents(n)));
+	return adv::Tape(std::move(ctx));
+}
+
+/// Unsigned integer field of a flat JSON object
+static double json_field(const std::string& json, const std::string& key)
+{
+	auto pos = json.find("\"" + key + "\":");
+	return std::stod(json.substr(pos + key.size() + 3));
+}
+
+/// Report operations per second and the memory use of the tape
+static void set_counters(benchmark::State& state, const adv::Tape& tape)
+{
+	auto stats = tape.stats_json();
+	auto ops = json_field(stats, "num_ops");
+	state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(ops));
+	state.counters["bytes/op"] = benchmark::Counter(json_field(stats, "bytes") / ops, benchmark::Counter::kAvgThreads);
+}
+
+template<std::vector<adv::ADouble> (*Func)(std::vector<adv::ADouble>)>
+static void record_model(benchmark::State& state)
+{
+	auto n = static_cast<std::size_t>(state.range(0));
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(record(n, Func));
+	}
+	set_counters(state, record(n, Func));
+}
+BENCHMARK_TEMPLATE(record_model, model)->RangeMultiplier(10)->Range(100, 10000)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(record_model, model_expression)->RangeMultiplier(10)->Range(100, 10000)->ThreadRange(1, 8)->UseRealTime();
+
+static void zero_order(benchmark::State& state)
+{
+	auto n = static_cast<std::size_t>(state.range(0));
+	auto tape = record(n, model);
+	std::vector<double> x(n, 0.5), y(n);
+	for (auto _ : state) {
+		tape.zero_order(x.data(), y.data());
+		benchmark::DoNotOptimize(y.data());
+	}
+	set_counters(state, tape);
+}
+BENCHMARK(zero_order)->RangeMultiplier(10)->Range(100, 10000);
+
+static void first_order_forward(benchmark::State& state)
+{
+	auto n = static_cast<std::size_t>(state.range(0));
+	auto tape = record(n, model);
+	std::vector<double> dx(n, 1.0), dy(n);
+	for (auto _ : state) {
+		tape.first_order_forward(dx.data(), dy.data());
+		benchmark::DoNotOptimize(dy.data());
+	}
+	set_counters(state, tape);
+}
+BENCHMARK(first_order_forward)->RangeMultiplier(10)->Range(100, 10000);
+
+static void first_order_reverse(benchmark::State& state)
+{
+	auto n = static_cast<std::size_t>(state.range(0));
+	auto tape = record(n, model);
+	std::vector<double> ybar(n, 1.0), xbar(n);
+	for (auto _ : state) {
+		tape.first_order_reverse(ybar.data(), xbar.data());
+		benchmark::DoNotOptimize(xbar.data());
+	}
+	set_counters(state, tape);
+}
+BENCHMARK(first_order_reverse)->RangeMultiplier(10)->Range(100, 10000);
+
+BENCHMARK_MAIN();
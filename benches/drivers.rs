@@ -0,0 +1,77 @@
+extern crate advantage as adv;
+#[macro_use]
+extern crate criterion;
+extern crate rayon;
+
+mod common;
+
+use adv::prelude::*;
+use common::*;
+use criterion::{black_box, BenchmarkId, Criterion, Throughput};
+
+/// Sizes of the dense Jacobians
+const JACOBIAN_SIZES: [usize; 3] = [16, 64, 256];
+
+/// Dense Jacobians by forward and reverse mode on pools of different sizes
+fn jacobian(c: &mut Criterion) {
+    let mut group = c.benchmark_group("jacobian");
+    group.sample_size(10);
+    for n in JACOBIAN_SIZES.iter() {
+        let ops = num_ops(*n);
+        let func = adv::SimpleFunction::new(*n, *n, |x: adv::DVector<adv::ADouble>| {
+            adv::DVector::from_vec(model(x.as_slice()))
+        });
+        let x = point(*n);
+        let mut tape = record(*n);
+        tape.zero_order(&x);
+        // Both modes perform one sweep per independent or dependent
+        group.throughput(Throughput::Elements(ops * *n as u64));
+        for threads in THREADS.iter() {
+            let pool = pool(*threads);
+            group.bench_with_input(
+                BenchmarkId::new(format!("forward_{}_threads", threads), n),
+                n,
+                |b, _| {
+                    b.iter(|| pool.install(|| adv::drivers::jacobian_forward(&func, black_box(&x))))
+                },
+            );
+            group.bench_with_input(
+                BenchmarkId::new(format!("reverse_{}_threads", threads), n),
+                n,
+                |b, _| b.iter(|| pool.install(|| adv::drivers::jacobian_reverse(black_box(&tape)))),
+            );
+        }
+    }
+    group.finish();
+}
+
+/// Reversal of a sequence of 1000 steps with different numbers of checkpoints
+fn reverse_sequence(c: &mut Criterion) {
+    let nsteps = 1000;
+    let mut group = c.benchmark_group("reverse_sequence");
+    group.sample_size(10);
+    group.throughput(Throughput::Elements(nsteps as u64));
+    for ncheckpoints in [2, 4, 8, 16, 32, 1001].iter() {
+        let x = adv::DVector::from_element(100, 0.5);
+        group.bench_with_input(
+            BenchmarkId::from_parameter(ncheckpoints),
+            ncheckpoints,
+            |b, ncheckpoints| {
+                b.iter(|| {
+                    adv::drivers::reverse_sequence(
+                        black_box(x.clone()),
+                        nsteps,
+                        *ncheckpoints,
+                        |x| x.map(|x: f64| (x * 1.1).sin()),
+                        |x, r| r + x.sum(),
+                        |x| x.sum(),
+                    )
+                })
+            },
+        );
+    }
+    group.finish();
+}
+
+criterion_group!(benches, jacobian, reverse_sequence);
+criterion_main!(benches);
@@ -1,10 +1,9 @@
-#![feature(test)]
-
 extern crate advantage as adv;
-extern crate test;
+#[macro_use]
+extern crate criterion;
 
 use adv::prelude::*;
-use test::Bencher;
+use criterion::{black_box, Criterion};
 
 adv_fn! {
     fn test_function(input: [[128]]) -> [[1]] {
@@ -26,22 +25,22 @@ adv_fn! {
     }
 }
 
-#[bench]
-fn generalized_jacobian(b: &mut Bencher) {
+fn generalized_jacobian(c: &mut Criterion) {
     let func = adv_fn_obj!(test_function);
     let x = adv::DVector::from_element(func.n(), 1.0);
     let dx = adv::DVector::from_element(func.n(), 1.0);
 
-    b.iter(|| {
-        let func = test::black_box(&func);
-        let x = test::black_box(&x);
-        let dx = test::black_box(&dx);
-        adv::drivers::generalized_jacobian(func, x, dx, &[0], None)
+    c.bench_function("generalized_jacobian", |b| {
+        b.iter(|| {
+            let func = black_box(&func);
+            let x = black_box(&x);
+            let dx = black_box(&dx);
+            adv::drivers::generalized_jacobian(func, x, dx, &[0], None)
+        })
     });
 }
 
-#[bench]
-fn generalized_jacobian_chain(b: &mut Bencher) {
+fn generalized_jacobian_chain(c: &mut Criterion) {
     let mut chain = adv::FunctionChain::new(adv_fn_obj!(propagate));
     chain.append(adv_fn_obj!(propagate));
     chain.append(adv_fn_obj!(propagate));
@@ -50,10 +49,15 @@ fn generalized_jacobian_chain(b: &mut Bencher) {
     let x = adv::DVector::from_element(chain.n(), 1.0);
     let dx = adv::DVector::from_element(chain.n(), 1.0);
 
-    b.iter(|| {
-        let chain = test::black_box(&chain);
-        let x = test::black_box(x.clone());
-        let dx = test::black_box(dx.clone());
-        adv::drivers::generalized_jacobian_chain(chain, x, dx, None)
+    c.bench_function("generalized_jacobian_chain", |b| {
+        b.iter(|| {
+            let chain = black_box(&chain);
+            let x = black_box(x.clone());
+            let dx = black_box(dx.clone());
+            adv::drivers::generalized_jacobian_chain(chain, x, dx, None)
+        })
     });
 }
+
+criterion_group!(benches, generalized_jacobian, generalized_jacobian_chain);
+criterion_main!(benches);
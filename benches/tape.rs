@@ -0,0 +1,135 @@
+extern crate advantage as adv;
+#[macro_use]
+extern crate criterion;
+extern crate rayon;
+
+mod common;
+
+use adv::prelude::*;
+use common::*;
+use criterion::{black_box, BenchmarkId, Criterion, Throughput};
+use rayon::prelude::*;
+
+/// Recording throughput with one context per thread
+fn record_tape(c: &mut Criterion) {
+    let mut group = c.benchmark_group("record");
+    for n in SIZES.iter() {
+        print_stats(*n);
+        let ops = num_ops(*n);
+        for threads in THREADS.iter() {
+            let pool = pool(*threads);
+            group.throughput(Throughput::Elements(ops * *threads as u64));
+            group.bench_with_input(
+                BenchmarkId::new(format!("{}_threads", threads), n),
+                n,
+                |b, n| {
+                    b.iter(|| {
+                        pool.install(|| {
+                            (0..*threads)
+                                .into_par_iter()
+                                .for_each(|_| drop(black_box(record(*n))))
+                        })
+                    })
+                },
+            );
+        }
+    }
+    group.finish();
+}
+
+fn zero_order(c: &mut Criterion) {
+    let mut group = c.benchmark_group("zero_order");
+    for n in SIZES.iter() {
+        let ops = num_ops(*n);
+        let mut tape = record(*n);
+        let x = point(*n);
+        group.throughput(Throughput::Elements(ops));
+        group.bench_with_input(BenchmarkId::from_parameter(n), n, |b, _| {
+            b.iter(|| tape.zero_order(black_box(&x)))
+        });
+    }
+    group.finish();
+}
+
+/// Zero order and forward sweeps with reused value slots
+fn replay(c: &mut Criterion) {
+    let mut group = c.benchmark_group("replay");
+    for n in SIZES.iter() {
+        let ops = num_ops(*n);
+        let mut replay = adv::ReplayTape::from_tape(&record(*n));
+        let x = point(*n);
+        let dx = adv::DVector::from_element(*n, 1.0);
+        group.throughput(Throughput::Elements(ops));
+        group.bench_with_input(BenchmarkId::new("zero_order", n), n, |b, _| {
+            b.iter(|| replay.zero_order(black_box(&x)))
+        });
+        group.bench_with_input(BenchmarkId::new("first_order_forward", n), n, |b, _| {
+            b.iter(|| replay.first_order_forward(black_box(&x), black_box(&dx)))
+        });
+    }
+    group.finish();
+}
+
+/// Sweeps over operations batched into runs of one op code
+fn compiled(c: &mut Criterion) {
+    let mut group = c.benchmark_group("compiled");
+    for n in SIZES.iter() {
+        let ops = num_ops(*n);
+        let mut compiled = adv::CompiledTape::new(&record(*n));
+        let x = point(*n);
+        compiled.zero_order(&x);
+        let dx = adv::DVector::from_element(*n, 1.0);
+        group.throughput(Throughput::Elements(ops));
+        group.bench_with_input(BenchmarkId::new("zero_order", n), n, |b, _| {
+            b.iter(|| compiled.zero_order(black_box(&x)))
+        });
+        group.bench_with_input(BenchmarkId::new("first_order_forward", n), n, |b, _| {
+            b.iter(|| compiled.first_order_forward(black_box(&dx)))
+        });
+        group.bench_with_input(BenchmarkId::new("first_order_reverse", n), n, |b, _| {
+            b.iter(|| compiled.first_order_reverse(black_box(&dx)))
+        });
+    }
+    group.finish();
+}
+
+fn first_order_forward(c: &mut Criterion) {
+    let mut group = c.benchmark_group("first_order_forward");
+    for n in SIZES.iter() {
+        let ops = num_ops(*n);
+        let mut tape = record(*n);
+        tape.zero_order(&point(*n));
+        let dx = adv::DVector::from_element(*n, 1.0);
+        group.throughput(Throughput::Elements(ops));
+        group.bench_with_input(BenchmarkId::from_parameter(n), n, |b, _| {
+            b.iter(|| tape.first_order_forward(black_box(&dx)))
+        });
+    }
+    group.finish();
+}
+
+fn first_order_reverse(c: &mut Criterion) {
+    let mut group = c.benchmark_group("first_order_reverse");
+    for n in SIZES.iter() {
+        let ops = num_ops(*n);
+        let mut tape = record(*n);
+        tape.zero_order(&point(*n));
+        let ybar = adv::DVector::from_element(*n, 1.0);
+        group.throughput(Throughput::Elements(ops));
+        group.bench_with_input(BenchmarkId::from_parameter(n), n, |b, _| {
+            b.iter(|| tape.first_order_reverse(black_box(&ybar)))
+        });
+    }
+    group.finish();
+}
+
+criterion_group!(
+    benches,
+    record_tape,
+    zero_order,
+    replay,
+    compiled,
+    first_order_forward,
+    first_order_reverse
+);
+criterion_main!(benches);
@@ -3,5 +3,8 @@
 
 #include "adv/AContext.hpp"
 #include "adv/ADouble.hpp"
+#include "adv/Expression.hpp"
+#include "adv/Profile.hpp"
+#include "adv/Tape.hpp"
 
 #endif // _ADV_HPP
@@ -4,6 +4,9 @@
 #include "export.hpp"
 #include "ADouble.hpp"
 
+#include <cstddef>
+#include <vector>
+
 namespace adv
 {
 
@@ -30,6 +33,18 @@ public:
 	/// Set a variable dependent
 	void set_dependent(const ADouble& var);
 
+	/// Get `n` new independent variables
+	std::vector<ADouble> new_independents(std::size_t n);
+	/// Write `n` new independent variables to `vars`
+	void new_independents(ADouble* vars, std::size_t n);
+	/// Set `n` variables dependent
+	void set_dependents(const ADouble* vars, std::size_t n);
+	/// Set all variables of a vector dependent
+	void set_dependents(const std::vector<ADouble>& vars);
+
+	/// Reserve space for `ops` more operations and `values` more values
+	void reserve(std::size_t ops, std::size_t values);
+
 private:
 	struct Impl;
 	Impl* m_impl;
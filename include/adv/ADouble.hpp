@@ -3,28 +3,58 @@
 
 #include "export.hpp"
 
+#include <cstddef>
+#include <cstdint>
+
+struct adv_adouble;
+
 namespace adv
 {
 
+/// \brief Operation of a block recorded by `ADouble::record_block`.
+///
+/// Arguments index the inputs of the block followed by the results of the
+/// preceding operations. `NO_ARG` marks an absent second argument.
+struct BlockOp
+{
+	static constexpr std::uint32_t NO_ARG = UINT32_MAX;
+
+	std::uint32_t opcode;
+	std::uint32_t arg1;
+	std::uint32_t arg2;
+};
+
+/// \brief Active double precision variable.
+///
+/// The value is stored inline and trivially copyable so recording an
+/// operation does not allocate on the C++ side.
 class ADV_EXPORT ADouble
 {
 public:
-	/// \brief Destructor
-	~ADouble();
-
 	/// \brief Default constructor.
 	ADouble();
 	/// \brief Construct from a primitive
 	ADouble(double);
-	/// \brief Deleted copy constructor.
-	ADouble(const ADouble&);
+	/// \brief Copy constructor.
+	ADouble(const ADouble&) = default;
 	/// \brief Move constructor.
-	ADouble(ADouble&&);
+	ADouble(ADouble&&) = default;
 
-	/// \brief Deleted copy assignment.
-	ADouble& operator=(const ADouble&);
+	/// \brief Copy assignment.
+	ADouble& operator=(const ADouble&) = default;
 	/// \brief Move assignment.
-	ADouble& operator=(ADouble&&);
+	ADouble& operator=(ADouble&&) = default;
+
+	/// Get the zero-order value
+	double value() const;
+	/// Get the first-order value
+	double dvalue() const;
+
+	/// \brief Evaluate and record a block of operations with a single call into the library.
+	///
+	/// Returns the result of the last operation, or a passive NaN if the block
+	/// is empty or an operation is malformed.
+	static ADouble record_block(const ADouble* inputs, std::size_t num_inputs, const BlockOp* ops, std::size_t num_ops);
 
 	// Overloaded arithmetic operators
 	ADouble operator+(const ADouble&) const;
@@ -33,11 +63,14 @@ public:
 	ADouble operator/(const ADouble&) const;
 
 private:
-	struct Impl;
-	Impl* m_impl;
-
-	ADouble(void* impl);
-	const void* get_impl() const;
+	// Must match the layout of `adv_adouble`
+	double m_value;
+	double m_dvalue;
+	std::size_t m_cid;
+	std::size_t m_vid;
+
+	ADouble(const ::adv_adouble& raw);
+	::adv_adouble raw() const;
 
 	friend class AContext;
 
@@ -0,0 +1,243 @@
+#ifndef _ADV_EXPRESSION_HPP
+#define _ADV_EXPRESSION_HPP
+
+#include "ADouble.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace adv
+{
+
+/// \brief Op codes of the operations in an expression block.
+///
+/// The values match the discriminants of `OpCode` in the Rust library.
+enum class ExprOp : std::uint32_t
+{
+	Add = 2,
+	Sub = 3,
+	Mul = 4,
+	Div = 5,
+	Sin = 6,
+	Cos = 7,
+	Tan = 8,
+	Abs = 9,
+	Exp = 10,
+	Ln = 11,
+};
+
+/// \brief Inputs and operations of a flattened expression.
+template<std::size_t NumInputs, std::size_t NumOps>
+class ExprBlock
+{
+public:
+	/// Append an input and return its position
+	std::uint32_t input(const ADouble& val)
+	{
+		new (inputs() + m_num_inputs) ADouble(val);
+		return static_cast<std::uint32_t>(m_num_inputs++);
+	}
+
+	/// Append an operation and return the position of its result
+	std::uint32_t op(ExprOp opcode, std::uint32_t arg1, std::uint32_t arg2 = BlockOp::NO_ARG)
+	{
+		m_ops[m_num_ops] = BlockOp { static_cast<std::uint32_t>(opcode), arg1, arg2 };
+		return static_cast<std::uint32_t>(NumInputs + m_num_ops++);
+	}
+
+	/// Record the block with a single call into the library
+	ADouble record()
+	{
+		return ADouble::record_block(inputs(), NumInputs, m_ops.data(), NumOps);
+	}
+
+private:
+	// `ADouble` is trivially copyable, so the inputs are copied into raw storage
+	alignas(ADouble) unsigned char m_inputs[NumInputs * sizeof(ADouble)];
+	std::array<BlockOp, NumOps> m_ops;
+	std::size_t m_num_inputs = 0;
+	std::size_t m_num_ops = 0;
+
+	ADouble* inputs()
+	{
+		return reinterpret_cast<ADouble*>(m_inputs);
+	}
+};
+
+/// \brief Statement captured at compile time.
+///
+/// The whole expression is recorded with one call into the library when it
+/// is converted to `ADouble`, instead of one call per operation.
+template<class E>
+class Expression
+{
+public:
+	/// Record the expression
+	ADouble evaluate() const
+	{
+		ExprBlock<E::num_inputs, E::num_ops> block;
+		derived().emit(block);
+		return block.record();
+	}
+
+	/// Record the expression
+	operator ADouble() const
+	{
+		return derived().evaluate();
+	}
+
+	/// Get the concrete expression
+	const E& derived() const
+	{
+		return static_cast<const E&>(*this);
+	}
+};
+
+/// \brief Variable or constant in an expression.
+class ExprLeaf : public Expression<ExprLeaf>
+{
+public:
+	static constexpr std::size_t num_inputs = 1;
+	static constexpr std::size_t num_ops = 0;
+
+	ExprLeaf(const ADouble& val):
+		m_val(val)
+	{
+	}
+
+	template<class Block>
+	std::uint32_t emit(Block& block) const
+	{
+		return block.input(m_val);
+	}
+
+	/// A single leaf is not recorded
+	ADouble evaluate() const
+	{
+		return m_val;
+	}
+
+private:
+	ADouble m_val;
+};
+
+/// \brief Unary function applied to an expression.
+template<ExprOp Op, class A>
+class ExprUnary : public Expression<ExprUnary<Op, A>>
+{
+public:
+	static constexpr std::size_t num_inputs = A::num_inputs;
+	static constexpr std::size_t num_ops = A::num_ops + 1;
+
+	explicit ExprUnary(const A& arg):
+		m_arg(arg)
+	{
+	}
+
+	template<class Block>
+	std::uint32_t emit(Block& block) const
+	{
+		return block.op(Op, m_arg.emit(block));
+	}
+
+private:
+	A m_arg;
+};
+
+/// \brief Binary operator applied to two expressions.
+template<ExprOp Op, class L, class R>
+class ExprBinary : public Expression<ExprBinary<Op, L, R>>
+{
+public:
+	static constexpr std::size_t num_inputs = L::num_inputs + R::num_inputs;
+	static constexpr std::size_t num_ops = L::num_ops + R::num_ops + 1;
+
+	ExprBinary(const L& lhs, const R& rhs):
+		m_lhs(lhs),
+		m_rhs(rhs)
+	{
+	}
+
+	template<class Block>
+	std::uint32_t emit(Block& block) const
+	{
+		auto lhs = m_lhs.emit(block);
+		auto rhs = m_rhs.emit(block);
+		return block.op(Op, lhs, rhs);
+	}
+
+private:
+	L m_lhs;
+	R m_rhs;
+};
+
+/// \brief Start an expression from a variable.
+///
+/// Operators on the result build expressions instead of recording, e.g.
+/// `ADouble y = lazy(a) * b + lazy(c) * d - e;` records one block.
+inline ExprLeaf lazy(const ADouble& val)
+{
+	return ExprLeaf(val);
+}
+
+#define ADV_EXPR_BINARY_OP(OP, CODE) \
+	template<class L, class R> \
+	ExprBinary<ExprOp::CODE, L, R> operator OP(const Expression<L>& lhs, const Expression<R>& rhs) \
+	{ \
+		return ExprBinary<ExprOp::CODE, L, R>(lhs.derived(), rhs.derived()); \
+	} \
+	\
+	template<class L> \
+	ExprBinary<ExprOp::CODE, L, ExprLeaf> operator OP(const Expression<L>& lhs, const ADouble& rhs) \
+	{ \
+		return ExprBinary<ExprOp::CODE, L, ExprLeaf>(lhs.derived(), ExprLeaf(rhs)); \
+	} \
+	\
+	template<class R> \
+	ExprBinary<ExprOp::CODE, ExprLeaf, R> operator OP(const ADouble& lhs, const Expression<R>& rhs) \
+	{ \
+		return ExprBinary<ExprOp::CODE, ExprLeaf, R>(ExprLeaf(lhs), rhs.derived()); \
+	} \
+	\
+	template<class L> \
+	ExprBinary<ExprOp::CODE, L, ExprLeaf> operator OP(const Expression<L>& lhs, double rhs) \
+	{ \
+		return ExprBinary<ExprOp::CODE, L, ExprLeaf>(lhs.derived(), ExprLeaf(rhs)); \
+	} \
+	\
+	template<class R> \
+	ExprBinary<ExprOp::CODE, ExprLeaf, R> operator OP(double lhs, const Expression<R>& rhs) \
+	{ \
+		return ExprBinary<ExprOp::CODE, ExprLeaf, R>(ExprLeaf(lhs), rhs.derived()); \
+	}
+ADV_EXPR_BINARY_OP(+, Add)
+ADV_EXPR_BINARY_OP(-, Sub)
+ADV_EXPR_BINARY_OP(*, Mul)
+ADV_EXPR_BINARY_OP(/, Div)
+#undef ADV_EXPR_BINARY_OP
+
+template<class A>
+ExprBinary<ExprOp::Sub, ExprLeaf, A> operator-(const Expression<A>& arg)
+{
+	return ExprBinary<ExprOp::Sub, ExprLeaf, A>(ExprLeaf(0.0), arg.derived());
+}
+
+#define ADV_EXPR_UNARY_FUNC(NAME, CODE) \
+	template<class A> \
+	ExprUnary<ExprOp::CODE, A> NAME(const Expression<A>& arg) \
+	{ \
+		return ExprUnary<ExprOp::CODE, A>(arg.derived()); \
+	}
+ADV_EXPR_UNARY_FUNC(sin, Sin)
+ADV_EXPR_UNARY_FUNC(cos, Cos)
+ADV_EXPR_UNARY_FUNC(tan, Tan)
+ADV_EXPR_UNARY_FUNC(abs, Abs)
+ADV_EXPR_UNARY_FUNC(exp, Exp)
+ADV_EXPR_UNARY_FUNC(ln, Ln)
+#undef ADV_EXPR_UNARY_FUNC
+
+} // namespace adv
+
+#endif // _ADV_EXPRESSION_HPP
@@ -0,0 +1,36 @@
+#ifndef _ADV_PROFILE_HPP
+#define _ADV_PROFILE_HPP
+
+#include "export.hpp"
+
+#include <string>
+
+namespace adv
+{
+
+/// \brief Process-wide counters and timers of the library.
+///
+/// Profiling is disabled by default and costs next to nothing while
+/// disabled.
+class ADV_EXPORT Profile
+{
+public:
+	/// Start collecting counters and timers
+	static void enable();
+	/// Stop collecting counters and timers
+	static void disable();
+	/// Whether counters and timers are collected
+	static bool enabled();
+	/// Set all counters and timers to zero
+	static void reset();
+
+	/// \brief Current counters and timers as a JSON object.
+	///
+	/// Holds the recorded operations per op code, the counters of the
+	/// drivers and the number of calls and nanoseconds of every timer.
+	static std::string json();
+};
+
+} // namespace adv
+
+#endif // _ADV_PROFILE_HPP
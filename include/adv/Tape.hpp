@@ -0,0 +1,91 @@
+#ifndef _ADV_TAPE_HPP
+#define _ADV_TAPE_HPP
+
+#include "export.hpp"
+#include "AContext.hpp"
+
+#include <cstddef>
+#include <string>
+
+namespace adv
+{
+
+/// \brief Recorded evaluation procedure of a function.
+///
+/// All results are written to caller-owned buffers. Matrices are stored in
+/// row-major order.
+class ADV_EXPORT Tape
+{
+public:
+	/// \brief Destructor
+	~Tape();
+
+	/// \brief Create a tape from the recording of a context.
+	///
+	/// The context is consumed.
+	explicit Tape(AContext&& ctx);
+	/// \brief Deleted copy constructor.
+	Tape(const Tape&) = delete;
+	/// \brief Move constructor.
+	Tape(Tape&&);
+
+	/// \brief Deleted copy assignment.
+	Tape& operator=(const Tape&) = delete;
+	/// \brief Move assignment.
+	Tape& operator=(Tape&&);
+
+	/// Number of independent variables `n`
+	std::size_t num_independents() const;
+	/// Number of dependent variables `m`
+	std::size_t num_dependents() const;
+	/// Number of abs operations `s`
+	std::size_t num_abs() const;
+
+	/// \brief Re-evaluate the function at `x`.
+	///
+	/// \param x `n` arguments
+	/// \param y `m` results
+	void zero_order(const double* x, double* y);
+	/// \brief Forward propagation of first-order derivatives.
+	///
+	/// \param dx `n` tangents of the arguments
+	/// \param dy `m` tangents of the results
+	void first_order_forward(const double* dx, double* dy) const;
+	/// \brief Reverse propagation of first-order derivatives.
+	///
+	/// The tape must not contain abs operations.
+	///
+	/// \param dy `m` adjoints of the results
+	/// \param dx `n` adjoints of the arguments
+	void first_order_reverse(const double* dy, double* dx) const;
+
+	/// \brief Jacobian at the recorded point.
+	///
+	/// The tape must not contain abs operations.
+	///
+	/// \param jac `m`×`n` matrix
+	void jacobian(double* jac) const;
+	/// \brief Abs-Normal Form at the recorded point.
+	///
+	/// \param a `s` vector
+	/// \param zmat `s`×`n` matrix
+	/// \param lmat `s`×`s` matrix
+	/// \param b `m` vector
+	/// \param jmat `m`×`n` matrix
+	/// \param ymat `m`×`s` matrix
+	void abs_normal(double* a, double* zmat, double* lmat, double* b, double* jmat, double* ymat) const;
+
+	/// \brief Statistics of the tape as a JSON object.
+	///
+	/// Holds the dimensions, the operations per op code, the size in bytes
+	/// and the peak number of live values.
+	std::string stats_json() const;
+
+private:
+	struct Impl;
+	Impl* m_impl;
+};
+
+} // namespace adv
+
+#endif // _ADV_TAPE_HPP
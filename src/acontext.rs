@@ -1,8 +1,13 @@
 use super::*;
 use num::{Float, NumCast};
+use std::cell::RefCell;
 use std::collections::HashMap;
+use std::io;
+use std::marker::PhantomData;
+use std::path::PathBuf;
 use std::sync::atomic::{AtomicUsize, Ordering};
 use std::sync::{Arc, Mutex, Weak};
+use std::time::Instant;
 
 static NEXT_CONTEXT_ID: AtomicUsize = AtomicUsize::new(1);
 
@@ -11,13 +16,69 @@ lazy_static! {
         Mutex::new(HashMap::new());
 }
 
-#[derive(Debug)]
-struct AContextInner {
-    cid: usize,
+thread_local! {
+    /// Recording buffers of the contexts that are bound to the current thread
+    static BOUND_CONTEXTS: RefCell<Vec<(usize, TapeBuffer)>> = RefCell::new(Vec::new());
+}
+
+/// Data recorded by a context
+#[derive(Debug, Default)]
+pub(crate) struct TapeBuffer {
     pub indeps: Vec<usize>,
     pub deps: Vec<usize>,
     pub ops: Vec<Operation>,
     pub vals: Vec<f64>,
+    /// Destination of the operations if they are streamed to a file
+    pub stream: Option<OpStreamWriter>,
+    /// Time of the first operation recorded while profiling
+    pub started: Option<Instant>,
+}
+
+impl TapeBuffer {
+    /// Record an operation and return the id of its result
+    pub fn record<S: Float>(
+        &mut self,
+        opcode: OpCode,
+        val: S,
+        arg1: Option<usize>,
+        arg2: Option<usize>,
+    ) -> usize {
+        if profile::is_enabled() {
+            profile::count_op(opcode);
+            if self.started.is_none() {
+                self.started = Some(Instant::now());
+            }
+        }
+        let vid = self.vals.len();
+        self.vals.push(NumCast::from(val).unwrap());
+        let op = Operation {
+            opcode,
+            vid,
+            arg1,
+            arg2,
+        };
+        match self.stream {
+            Some(ref mut stream) => stream.push(&op),
+            None => self.ops.push(op),
+        }
+        vid
+    }
+
+    /// Panic if the operations are streamed to a file
+    fn assert_in_memory(&self) {
+        assert!(
+            self.stream.is_none(),
+            "Operations of a streaming AContext are not kept in memory"
+        );
+    }
+}
+
+#[derive(Debug)]
+struct AContextInner {
+    cid: usize,
+    buf: TapeBuffer,
+    /// Whether `buf` is currently owned by a thread binding
+    bound: bool,
 }
 
 impl AContextInner {
@@ -25,10 +86,8 @@ impl AContextInner {
     fn construct(cid: usize) -> AContextInner {
         AContextInner {
             cid,
-            indeps: Vec::new(),
-            deps: Vec::new(),
-            ops: Vec::new(),
-            vals: Vec::new(),
+            buf: TapeBuffer::default(),
+            bound: false,
         }
     }
 
@@ -60,15 +119,52 @@ impl Drop for AContextInner {
 
 /// Records a function evaluation
 pub struct AContext {
+    cid: usize,
     inner: Arc<Mutex<AContextInner>>,
 }
 
+/// Keeps an `AContext` bound to the current thread
+///
+/// While the binding is alive, operations on the context that happen on this thread are appended
+/// to a thread-owned buffer without taking any locks. Dropping the binding hands the recorded data
+/// back to the context.
+pub struct AContextBinding {
+    cid: usize,
+    inner: Arc<Mutex<AContextInner>>,
+    // Bindings refer to thread-local storage and must not leave their thread
+    _not_send: PhantomData<*const ()>,
+}
+
+impl Drop for AContextBinding {
+    fn drop(&mut self) {
+        let buf = BOUND_CONTEXTS.with(|bound| {
+            let mut bound = bound.borrow_mut();
+            let pos = bound.iter().position(|(cid, _)| *cid == self.cid).unwrap();
+            bound.remove(pos).1
+        });
+        let mut inner = self.inner.lock().unwrap();
+        inner.buf = buf;
+        inner.bound = false;
+    }
+}
+
 impl AContext {
     /// Create a new AContext
     pub fn new() -> AContext {
-        AContext {
-            inner: AContextInner::new(),
-        }
+        let inner = AContextInner::new();
+        let cid = inner.lock().unwrap().cid();
+        AContext { cid, inner }
+    }
+
+    /// Create a new AContext that streams its operations to a file at `path`
+    ///
+    /// Operations are written in chunks of `chunk_len`. The recording is retrieved with
+    /// `stream_tape`. Fails if the file cannot be created.
+    pub fn new_streaming<P: Into<PathBuf>>(path: P, chunk_len: usize) -> io::Result<AContext> {
+        let stream = OpStreamWriter::new(path.into(), chunk_len)?;
+        let ctx = Self::new();
+        ctx.inner.lock().unwrap().buf.stream = Some(stream);
+        Ok(ctx)
     }
 
     /// Get a context by its id
@@ -78,46 +174,107 @@ impl AContext {
             .unwrap()
             .get(&cid)
             .and_then(|weak| weak.upgrade())
-            .map(|inner| AContext { inner })
+            .map(|inner| AContext { cid, inner })
     }
 
     /// Get the context id
     pub fn cid(&self) -> usize {
-        let inner = self.inner.lock().unwrap();
-        inner.cid()
+        self.cid
+    }
+
+    /// Bind the context to the current thread for lock-free recording
+    ///
+    /// Panics if the context is already bound.
+    pub fn bind(&self) -> AContextBinding {
+        let buf = {
+            let mut inner = self.inner.lock().unwrap();
+            if inner.bound {
+                None
+            } else {
+                inner.bound = true;
+                Some(std::mem::take(&mut inner.buf))
+            }
+        };
+        let buf = buf.expect("AContext is already bound to a thread");
+        BOUND_CONTEXTS.with(|bound| bound.borrow_mut().push((self.cid, buf)));
+        AContextBinding {
+            cid: self.cid,
+            inner: self.inner.clone(),
+            _not_send: PhantomData,
+        }
+    }
+
+    /// Access the recording buffer of a context bound to the current thread
+    fn with_bound_buffer<R, F: FnOnce(&mut TapeBuffer) -> R>(cid: usize, f: F) -> Result<R, F> {
+        BOUND_CONTEXTS.with(|bound| {
+            let mut bound = bound.borrow_mut();
+            match bound.iter_mut().find(|(bound_cid, _)| *bound_cid == cid) {
+                Some((_, buf)) => Ok(f(buf)),
+                None => Err(f),
+            }
+        })
+    }
+
+    /// Access the recording buffer of this context
+    fn with_buffer<R, F: FnOnce(&mut TapeBuffer) -> R>(&self, f: F) -> R {
+        match Self::with_bound_buffer(self.cid, f) {
+            Ok(result) => result,
+            Err(f) => {
+                let mut inner = self.inner.lock().unwrap();
+                if inner.bound {
+                    drop(inner);
+                    panic!("AContext is bound to another thread");
+                }
+                f(&mut inner.buf)
+            }
+        }
+    }
+
+    /// Access the recording buffer of the context with the given id
+    ///
+    /// Contexts bound to the current thread are accessed without locking. Returns `None` if the
+    /// context does not exist anymore.
+    pub(crate) fn with_cid_buffer<R, F: FnOnce(&mut TapeBuffer) -> R>(
+        cid: usize,
+        f: F,
+    ) -> Option<R> {
+        match Self::with_bound_buffer(cid, f) {
+            Ok(result) => Some(result),
+            Err(f) => Self::from_cid(cid).map(|ctx| ctx.with_buffer(f)),
+        }
+    }
+
+    /// Reserve capacity for at least `ops` more operations and `values` more values
+    pub fn reserve(&mut self, ops: usize, values: usize) {
+        self.with_buffer(|buf| {
+            buf.ops.reserve(ops);
+            buf.vals.reserve(values);
+        });
     }
 
     /// Mark a variable as independent
     pub fn set_indep<S: Float>(&mut self, x: &mut AFloat<S>) {
-        let mut inner = self.inner.lock().unwrap();
-        let vid = inner.vals.len();
-        inner.vals.push(NumCast::from(x.value()).unwrap());
-        x.set_context(inner.cid(), vid);
-        inner.indeps.push(vid);
+        self.set_indep_slice(std::slice::from_mut(x));
+    }
+
+    /// Mark all variables of a slice as independent
+    pub fn set_indep_slice<S: Float>(&mut self, slice: &mut [AFloat<S>]) {
+        let cid = self.cid;
+        self.with_buffer(|buf| {
+            buf.vals.reserve(slice.len());
+            buf.indeps.reserve(slice.len());
+            for x in slice.iter_mut() {
+                let vid = buf.vals.len();
+                buf.vals.push(NumCast::from(x.value()).unwrap());
+                x.set_context(cid, vid);
+                buf.indeps.push(vid);
+            }
+        });
     }
 
     /// Mark a variable as dependent
     pub fn set_dep<S: Float>(&mut self, x: &AFloat<S>) {
-        let mut inner = self.inner.lock().unwrap();
-        let vid = match x.context() {
-            Some((cid, vid)) => {
-                assert_eq!(cid, inner.cid());
-                vid
-            }
-            None => {
-                // Record constant
-                let vid = inner.vals.len();
-                inner.vals.push(NumCast::from(x.value()).unwrap());
-                inner.ops.push(Operation {
-                    opcode: OpCode::Const,
-                    vid,
-                    arg1: None,
-                    arg2: None,
-                });
-                vid
-            }
-        };
-        inner.deps.push(vid);
+        self.set_dep_slice(std::slice::from_ref(x));
     }
 
     /// Create idependent var
@@ -130,17 +287,29 @@ impl AContext {
     /// Create idependent vector
     pub fn new_indep_vec<S: Float>(&mut self, length: usize, value: S) -> Vec<AFloat<S>> {
         let mut vec = vec![AFloat::new(value, S::zero()); length];
-        for x in vec.iter_mut() {
-            self.set_indep(x);
-        }
+        self.set_indep_slice(&mut vec);
         vec
     }
 
     /// Set slice dependent
     pub fn set_dep_slice<S: Float>(&mut self, slice: &[AFloat<S>]) {
-        for x in slice.iter() {
-            self.set_dep(x);
-        }
+        let cid = self.cid;
+        self.with_buffer(|buf| {
+            buf.deps.reserve(slice.len());
+            for x in slice.iter() {
+                let vid = match x.context() {
+                    Some((x_cid, vid)) => {
+                        assert_eq!(x_cid, cid);
+                        vid
+                    }
+                    None => {
+                        // Record constant
+                        buf.record(OpCode::Const, x.value(), None, None)
+                    }
+                };
+                buf.deps.push(vid);
+            }
+        });
     }
 
     /// Record an operation
@@ -151,50 +320,78 @@ impl AContext {
         arg1: Option<usize>,
         arg2: Option<usize>,
     ) -> usize {
-        let mut inner = self.inner.lock().unwrap();
-        let vid = inner.vals.len();
-        inner.vals.push(NumCast::from(val).unwrap());
-        inner.ops.push(Operation {
-            opcode,
-            vid,
-            arg1,
-            arg2,
-        });
-        vid
+        self.with_buffer(|buf| buf.record(opcode, val, arg1, arg2))
     }
 
     /// Get all independents
     pub fn indeps(&self) -> Vec<usize> {
-        let inner = self.inner.lock().unwrap();
-        inner.indeps.clone()
+        self.with_buffer(|buf| buf.indeps.clone())
     }
 
     /// Get all dependents
     pub fn deps(&self) -> Vec<usize> {
-        let inner = self.inner.lock().unwrap();
-        inner.deps.clone()
+        self.with_buffer(|buf| buf.deps.clone())
     }
 
     /// Get all operations
     pub fn operations(&self) -> Vec<Operation> {
-        let inner = self.inner.lock().unwrap();
-        inner.ops.clone()
+        self.with_buffer(|buf| {
+            buf.assert_in_memory();
+            buf.ops.clone()
+        })
     }
 
     /// Get all intermediate values
     pub fn values(&self) -> Vec<f64> {
-        let inner = self.inner.lock().unwrap();
-        inner.vals.clone()
+        self.with_buffer(|buf| buf.vals.clone())
     }
 
     /// Get a tape
-    pub fn tape(&self) -> impl Tape + Clone {
-        AContextTape {
-            indeps: self.indeps(),
-            deps: self.deps(),
-            ops: self.operations(),
-            vals: self.values(),
+    ///
+    /// The recording is moved into the tape. Clones of the tape share the operations and copy only
+    /// the values, so every thread can replay its own point without duplicating the operations.
+    pub fn tape(self) -> impl Tape + Clone {
+        self.context_tape()
+    }
+
+    /// Move the recording into a tape of known type
+    pub(crate) fn context_tape(self) -> AContextTape {
+        let buf = self.with_buffer(std::mem::take);
+        buf.assert_in_memory();
+        let tape = AContextTape {
+            indeps: buf.indeps,
+            deps: buf.deps,
+            ops: Arc::new(buf.ops),
+            vals: buf.vals,
+        };
+        if let Some(started) = buf.started {
+            profile::add_time(Timer::Record, started);
+            profile::count(Counter::RecordedTapes, 1);
+            profile::count(Counter::RecordedBytes, tape.bytes() as u64);
         }
+        tape
+    }
+
+    /// Get the tape of a streaming context
+    ///
+    /// Fails if writing any of the operations to the file failed.
+    pub fn stream_tape(self) -> io::Result<StreamTape> {
+        let buf = self.with_buffer(std::mem::take);
+        let stream = buf.stream.expect("AContext is not streaming");
+        StreamTape::new(buf.indeps, buf.deps, buf.vals, stream)
+    }
+
+    /// Get a tape in the packed `CompactTape` format
+    pub fn compact_tape(&self) -> CompactTape {
+        self.with_buffer(|buf| {
+            buf.assert_in_memory();
+            CompactTape::new(
+                buf.indeps.clone(),
+                buf.deps.clone(),
+                &buf.ops,
+                buf.vals.clone(),
+            )
+        })
     }
 }
 
@@ -204,12 +401,32 @@ impl Default for AContext {
     }
 }
 
+/// Tape owning its values and sharing its immutable operations between clones
 #[derive(Debug, Clone)]
-struct AContextTape {
-    indeps: Vec<usize>,
-    deps: Vec<usize>,
-    ops: Vec<Operation>,
-    vals: Vec<f64>,
+pub(crate) struct AContextTape {
+    pub indeps: Vec<usize>,
+    pub deps: Vec<usize>,
+    pub ops: Arc<Vec<Operation>>,
+    pub vals: Vec<f64>,
+}
+
+impl AContextTape {
+    /// Copy of an arbitrary tape
+    pub fn from_tape(tape: &dyn Tape) -> Self {
+        Self {
+            indeps: tape.indeps().to_vec(),
+            deps: tape.deps().to_vec(),
+            ops: Arc::new(tape.ops_iter().collect()),
+            vals: tape.values().to_vec(),
+        }
+    }
+
+    /// Memory taken by the indices, operations and values
+    pub fn bytes(&self) -> usize {
+        (self.indeps.len() + self.deps.len()) * std::mem::size_of::<usize>()
+            + self.ops.len() * std::mem::size_of::<Operation>()
+            + self.vals.len() * std::mem::size_of::<f64>()
+    }
 }
 
 impl Tape for AContextTape {
@@ -232,6 +449,14 @@ impl Tape for AContextTape {
     fn ops_iter<'a>(&'a self) -> Box<dyn DoubleEndedIterator<Item = Operation> + 'a> {
         Box::new(self.ops.iter().cloned())
     }
+
+    fn ops_slice(&self) -> Option<&[Operation]> {
+        Some(self.ops.as_slice())
+    }
+
+    fn zero_order(&mut self, x: &DVector<f64>) {
+        zero_order_sweep(self.ops.iter().cloned(), &self.indeps, &mut self.vals, x);
+    }
 }
 
 #[cfg(test)]
@@ -333,4 +558,100 @@ mod tests {
             assert!((vals[2] - 3.0).abs() < std::f64::EPSILON);
         }
     }
+
+    fn record_test_tape(ctx: &mut AContext) {
+        let mut a = AFloat::new(1.0, 0.0);
+        let mut b = AFloat::new(2.0, 0.0);
+        ctx.set_indep(&mut a);
+        ctx.set_indep(&mut b);
+        let c = (a + b) * 2.0;
+        ctx.set_dep(&c);
+    }
+
+    #[test]
+    fn acontext_bind() {
+        let mut unbound_ctx = AContext::new();
+        record_test_tape(&mut unbound_ctx);
+
+        let mut ctx = AContext::new();
+        {
+            let _binding = ctx.bind();
+            record_test_tape(&mut ctx);
+            assert_eq!(ctx.operations(), unbound_ctx.operations());
+            assert!(ctx.inner.lock().unwrap().buf.ops.is_empty());
+        }
+        assert_eq!(ctx.inner.lock().unwrap().buf.ops.len(), 3);
+        assert_eq!(ctx.indeps(), unbound_ctx.indeps());
+        assert_eq!(ctx.deps(), unbound_ctx.deps());
+        assert_eq!(ctx.operations(), unbound_ctx.operations());
+        assert_eq!(ctx.values(), unbound_ctx.values());
+    }
+
+    #[test]
+    fn acontext_bind_threads() {
+        let handles = (0..4)
+            .map(|_| {
+                std::thread::spawn(|| {
+                    let mut ctx = AContext::new();
+                    {
+                        let _binding = ctx.bind();
+                        record_test_tape(&mut ctx);
+                    }
+                    ctx.values()
+                })
+            })
+            .collect::<Vec<_>>();
+        for handle in handles {
+            assert_eq!(handle.join().unwrap(), vec![1.0, 2.0, 3.0, 2.0, 6.0]);
+        }
+    }
+
+    #[test]
+    fn acontext_bulk() {
+        let mut ctx = AContext::new();
+        ctx.reserve(10, 20);
+        assert!(ctx.inner.lock().unwrap().buf.ops.capacity() >= 10);
+        assert!(ctx.inner.lock().unwrap().buf.vals.capacity() >= 20);
+
+        let x = ctx.new_indep_vec(3, 1.0);
+        let y = vec![x[0] + x[1], x[2], AFloat::new(2.0, 0.0)];
+        ctx.set_dep_slice(&y);
+        assert_eq!(ctx.indeps(), vec![0, 1, 2]);
+        assert_eq!(ctx.deps(), vec![3, 2, 4]);
+        assert_eq!(ctx.values(), vec![1.0, 1.0, 1.0, 2.0, 2.0]);
+    }
+
+    #[test]
+    fn tape_clones_share_operations() {
+        use rayon::prelude::*;
+        let mut ctx = AContext::new();
+        let x = ctx.new_indep_vec(2, 0.0);
+        ctx.set_dep(&(x[0].sin() * x[1]));
+        let tape = AContextTape::from_tape(&ctx.tape());
+
+        let results = (0..8)
+            .into_par_iter()
+            .map(|i| {
+                let mut local = tape.clone();
+                let x = adv_dvec![0.1 * i as f64, 2.0];
+                local.zero_order(&x);
+                let xbar = local.first_order_reverse(&adv_dvec![1.0]);
+                (Arc::ptr_eq(&local.ops, &tape.ops), x, local.y(), xbar)
+            })
+            .collect::<Vec<_>>();
+        for (shared, x, y, xbar) in results {
+            assert!(shared);
+            assert_eq!(y[0], x[0].sin() * x[1]);
+            assert_eq!(xbar, adv_dvec![x[0].cos() * x[1], x[0].sin()]);
+        }
+        assert_eq!(tape.x(), adv_dvec![0.0, 0.0]);
+    }
+
+    #[test]
+    #[should_panic]
+    fn acontext_bind_twice() {
+        let ctx = AContext::new();
+        let _binding1 = ctx.bind();
+        let _binding2 = ctx.bind();
+    }
 }
@@ -6,6 +6,19 @@ pub type ASingle = AFloat<f32>;
 /// Double precision `AFloat`
 pub type ADouble = AFloat<f64>;
 
+/// Number of slots `AFloat::from_block` keeps on the stack
+const BLOCK_SLOTS: usize = 32;
+
+/// Operation of a block recorded by `AFloat::from_block`
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct BlockOp {
+    pub opcode: OpCode,
+    /// Position of the first argument among the block inputs and results
+    pub arg1: usize,
+    /// Position of the second argument among the block inputs and results
+    pub arg2: Option<usize>,
+}
+
 /// Floating point variable type for tapeless forward-mode automatic differentiation
 #[derive(Clone, Copy, Debug)]
 pub struct AFloat<S: Float> {
@@ -70,16 +83,16 @@ impl<S: Float> AFloat<S> {
             }
         }
         if let Some(cid) = cid {
-            // Get context
-            if let Some(mut ctx) = AContext::from_cid(cid) {
+            // Record on the context. Contexts bound to this thread are recorded to without locking.
+            let vid = AContext::with_cid_buffer(cid, |buf| {
                 // Add constants if necessary
                 if arg1.context().is_none() {
-                    let vid = ctx.record(OpCode::Const, arg1.value(), None, None);
+                    let vid = buf.record(OpCode::Const, arg1.value(), None, None);
                     arg1.ctx = Some((cid, vid));
                 }
                 if let Some(ref mut arg2) = &mut arg2 {
                     if arg2.context().is_none() {
-                        let vid = ctx.record(OpCode::Const, arg2.value(), None, None);
+                        let vid = buf.record(OpCode::Const, arg2.value(), None, None);
                         arg2.ctx = Some((cid, vid));
                     }
                 }
@@ -87,13 +100,96 @@ impl<S: Float> AFloat<S> {
                 let arg1_vid = Some(arg1.context().unwrap().1);
                 let arg2_vid = arg2.map(|arg2| arg2.context().unwrap().1);
                 // Record operation
-                let vid = ctx.record(opcode, v, arg1_vid, arg2_vid);
+                buf.record(opcode, v, arg1_vid, arg2_vid)
+            });
+            if let Some(vid) = vid {
                 this.ctx = Some((cid, vid));
             }
         }
         this
     }
 
+    /// Evaluate and record a block of operations at once
+    ///
+    /// Results take the positions after `inputs`, so the arguments of an operation index both.
+    /// The block is recorded with a single access to the context, constants are recorded at most
+    /// once and operations on passive values only are not recorded. Returns the result of the last
+    /// operation or the last input if `ops` is empty.
+    pub fn from_block(inputs: &[Self], ops: &[BlockOp]) -> Self {
+        Self::from_block_iter(inputs.iter().cloned(), ops.iter().cloned())
+    }
+
+    /// `from_block` taking the inputs and operations from iterators
+    ///
+    /// `ops` is traversed twice, once to evaluate and once to record.
+    pub(crate) fn from_block_iter<I, O>(inputs: I, ops: O) -> Self
+    where
+        I: ExactSizeIterator<Item = Self>,
+        O: ExactSizeIterator<Item = BlockOp> + Clone,
+    {
+        let num_inputs = inputs.len();
+        let len = num_inputs + ops.len();
+        assert!(len > 0, "Empty operation block");
+        // Blocks of single statements fit on the stack
+        let zero = Self::new(S::zero(), S::zero());
+        let mut stack = [zero; BLOCK_SLOTS];
+        let mut heap = Vec::new();
+        let slots = if len <= BLOCK_SLOTS {
+            &mut stack[..len]
+        } else {
+            heap.resize(len, zero);
+            &mut heap[..]
+        };
+
+        let mut cid = None;
+        for (slot, x) in slots.iter_mut().zip(inputs) {
+            if let Some((input_cid, _)) = x.context() {
+                assert_eq!(*cid.get_or_insert(input_cid), input_cid);
+            }
+            *slot = x;
+        }
+        for (pos, op) in (num_inputs..).zip(ops.clone()) {
+            assert!(
+                op.arg1 < pos && op.arg2.iter().all(|idx| *idx < pos),
+                "Block operation uses a later result"
+            );
+            let arg1 = slots[op.arg1];
+            let arg2 = op.arg2.map(|idx| slots[idx]);
+            let v = zero_order_value(op.opcode, arg1.v, arg2.map(|x| x.v));
+            let dv = first_order_value(
+                op.opcode,
+                arg1.v,
+                arg2.map(|x| x.v),
+                arg1.dv,
+                arg2.map(|x| x.dv),
+            );
+            slots[pos] = Self::new(v, dv);
+        }
+
+        if let Some(cid) = cid {
+            AContext::with_cid_buffer(cid, |buf| {
+                for (pos, op) in (num_inputs..).zip(ops) {
+                    let args = std::iter::once(op.arg1).chain(op.arg2);
+                    if args.clone().all(|idx| slots[idx].ctx.is_none()) {
+                        continue;
+                    }
+                    // Add constants if necessary
+                    for idx in args {
+                        if slots[idx].ctx.is_none() {
+                            let vid = buf.record(OpCode::Const, slots[idx].v, None, None);
+                            slots[idx].ctx = Some((cid, vid));
+                        }
+                    }
+                    let arg1_vid = slots[op.arg1].ctx.map(|(_, vid)| vid);
+                    let arg2_vid = op.arg2.and_then(|idx| slots[idx].ctx.map(|(_, vid)| vid));
+                    let vid = buf.record(op.opcode, slots[pos].v, arg1_vid, arg2_vid);
+                    slots[pos].ctx = Some((cid, vid));
+                }
+            });
+        }
+        slots[len - 1]
+    }
+
     /// Cast to different value type
     pub fn cast<T: Float>(x: AFloat<T>) -> Self {
         Self {
@@ -406,6 +502,78 @@ mod tests {
         v5
     }
 
+    #[test]
+    fn afloat_from_block() {
+        let record = |block: bool| {
+            let mut ctx = AContext::new();
+            let x = ctx.new_indep_vec(3, 0.0);
+            let c = ADouble::new(2.0, 0.0);
+            // x0 * x1 + sin(x2) / c - c * x0
+            let y = if block {
+                let op = |opcode, arg1, arg2| BlockOp { opcode, arg1, arg2 };
+                let ops = [
+                    op(OpCode::Mul, 0, Some(1)),
+                    op(OpCode::Sin, 2, None),
+                    op(OpCode::Div, 5, Some(3)),
+                    op(OpCode::Add, 4, Some(6)),
+                    op(OpCode::Mul, 3, Some(0)),
+                    op(OpCode::Sub, 7, Some(8)),
+                ];
+                ADouble::from_block(&[x[0], x[1], x[2], c], &ops)
+            } else {
+                x[0] * x[1] + x[2].sin() / c - c * x[0]
+            };
+            ctx.set_dep(&y);
+            (y, ctx.operations().len(), ctx.tape())
+        };
+        let (y_block, num_block, mut tape_block) = record(true);
+        let (y, num, mut tape) = record(false);
+        assert_eq!(y_block.value(), y.value());
+        // The constant is recorded once
+        assert_eq!(num_block, 7);
+        assert_eq!(num, 8);
+
+        let x = adv_dvec![0.5, 2.0, -1.0];
+        tape_block.zero_order(&x);
+        tape.zero_order(&x);
+        assert_eq!(tape_block.y(), tape.y());
+        let ybar = adv_dvec![1.0];
+        assert_eq!(
+            tape_block.first_order_reverse(&ybar),
+            tape.first_order_reverse(&ybar)
+        );
+
+        let passive = ADouble::from_block(
+            &[ADouble::new(3.0, 1.0)],
+            &[BlockOp {
+                opcode: OpCode::Exp,
+                arg1: 0,
+                arg2: None,
+            }],
+        );
+        assert_eq!(passive.context(), None);
+        assert_eq!(passive.dvalue(), 3.0_f64.exp());
+    }
+
+    #[test]
+    fn afloat_from_large_block() {
+        // More slots than fit on the stack
+        let n = 2 * BLOCK_SLOTS;
+        let mut ctx = AContext::new();
+        let x = ctx.new_indep(0.5);
+        let ops = (0..n)
+            .map(|k| BlockOp {
+                opcode: OpCode::Sin,
+                arg1: k,
+                arg2: None,
+            })
+            .collect::<Vec<_>>();
+        let y = ADouble::from_block(&[x], &ops);
+        let reference = (0..n).fold(x, |y, _| y.sin());
+        assert_eq!(y.value(), reference.value());
+        assert_eq!(ctx.operations().len(), 2 * n);
+    }
+
     #[test]
     fn afloat_consistency() {
         let x = AFloat::<f64>::new(2.0, 1.0);
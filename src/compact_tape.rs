@@ -0,0 +1,309 @@
+use super::*;
+
+/// Marker for an absent argument in a `CompactTape`
+const NO_ARG: u32 = u32::MAX;
+
+/// Packed tape storing its operations as a structure of arrays
+///
+/// Every value slot owns exactly one entry in the op code stream, so the result id of an operation
+/// is implied by its position. Arguments are stored as 32-bit indices. Slots of independent
+/// variables carry `OpCode::Nop`.
+#[derive(Debug, Clone)]
+pub struct CompactTape {
+    indeps: Vec<usize>,
+    deps: Vec<usize>,
+    opcodes: Vec<OpCode>,
+    arg1: Vec<u32>,
+    arg2: Vec<u32>,
+    vals: Vec<f64>,
+}
+
+fn pack_arg(arg: Option<usize>) -> u32 {
+    match arg {
+        Some(idx) => {
+            assert!(idx < NO_ARG as usize, "Tape too large for CompactTape");
+            idx as u32
+        }
+        None => NO_ARG,
+    }
+}
+
+fn unpack_arg(arg: u32) -> Option<usize> {
+    if arg == NO_ARG {
+        None
+    } else {
+        Some(arg as usize)
+    }
+}
+
+impl CompactTape {
+    /// Pack a recorded evaluation procedure
+    ///
+    /// Result ids of `ops` have to be strictly increasing and `Nop` operations are dropped.
+    pub fn new(indeps: Vec<usize>, deps: Vec<usize>, ops: &[Operation], vals: Vec<f64>) -> Self {
+        assert!(
+            vals.len() < NO_ARG as usize,
+            "Tape too large for CompactTape"
+        );
+        let mut opcodes = vec![OpCode::Nop; vals.len()];
+        let mut arg1 = vec![NO_ARG; vals.len()];
+        let mut arg2 = vec![NO_ARG; vals.len()];
+        let mut last_vid = None;
+        for op in ops.iter().filter(|op| op.opcode != OpCode::Nop) {
+            assert!(
+                last_vid.map_or(true, |last_vid| op.vid > last_vid),
+                "CompactTape requires operations ordered by result id"
+            );
+            last_vid = Some(op.vid);
+            opcodes[op.vid] = op.opcode;
+            arg1[op.vid] = pack_arg(op.arg1);
+            arg2[op.vid] = pack_arg(op.arg2);
+        }
+        Self {
+            indeps,
+            deps,
+            opcodes,
+            arg1,
+            arg2,
+            vals,
+        }
+    }
+
+    /// Pack an arbitrary tape
+    pub fn from_tape(tape: &dyn Tape) -> Self {
+        let ops = tape.ops_iter().collect::<Vec<_>>();
+        Self::new(
+            tape.indeps().to_vec(),
+            tape.deps().to_vec(),
+            &ops,
+            tape.values().to_vec(),
+        )
+    }
+
+    /// Number of bytes used by the packed representation
+    pub fn size_in_bytes(&self) -> usize {
+        self.opcodes.len() * std::mem::size_of::<OpCode>()
+            + (self.arg1.len() + self.arg2.len()) * std::mem::size_of::<u32>()
+            + self.vals.len() * std::mem::size_of::<f64>()
+            + (self.indeps.len() + self.deps.len()) * std::mem::size_of::<usize>()
+    }
+
+    /// Borrow the packed operation arrays
+    fn compact_ops(&self) -> CompactOps<'_> {
+        CompactOps {
+            opcodes: &self.opcodes,
+            arg1: &self.arg1,
+            arg2: &self.arg2,
+        }
+    }
+}
+
+/// Borrowed view of the packed operation arrays of a `CompactTape`
+#[derive(Clone, Copy)]
+struct CompactOps<'a> {
+    opcodes: &'a [OpCode],
+    arg1: &'a [u32],
+    arg2: &'a [u32],
+}
+
+impl<'a> CompactOps<'a> {
+    /// Decode the operation writing to value slot `vid`
+    fn op(self, vid: usize) -> Operation {
+        Operation {
+            opcode: self.opcodes[vid],
+            vid,
+            arg1: unpack_arg(self.arg1[vid]),
+            arg2: unpack_arg(self.arg2[vid]),
+        }
+    }
+
+    /// Decode all operations in order
+    fn iter(self) -> impl DoubleEndedIterator<Item = Operation> + 'a {
+        (0..self.opcodes.len()).map(move |vid| self.op(vid))
+    }
+}
+
+impl Tape for CompactTape {
+    fn indeps(&self) -> &[usize] {
+        &self.indeps
+    }
+
+    fn deps(&self) -> &[usize] {
+        &self.deps
+    }
+
+    fn values(&self) -> &[f64] {
+        &self.vals
+    }
+
+    fn values_mut(&mut self) -> &mut [f64] {
+        &mut self.vals
+    }
+
+    fn ops_iter<'a>(&'a self) -> Box<dyn DoubleEndedIterator<Item = Operation> + 'a> {
+        Box::new(
+            self.compact_ops()
+                .iter()
+                .filter(|op| op.opcode != OpCode::Nop),
+        )
+    }
+
+    fn num_abs(&self) -> usize {
+        self.opcodes
+            .iter()
+            .filter(|opcode| **opcode == OpCode::Abs)
+            .count()
+    }
+
+    fn max_id(&self) -> usize {
+        let indep_max = self.indeps.iter().cloned().max().unwrap_or(0);
+        let dep_max = self.deps.iter().cloned().max().unwrap_or(0);
+        let op_max = self.vals.len().max(1) - 1;
+        indep_max.max(dep_max).max(op_max)
+    }
+
+    fn zero_order(&mut self, x: &DVector<f64>) {
+        let ops = CompactOps {
+            opcodes: &self.opcodes,
+            arg1: &self.arg1,
+            arg2: &self.arg2,
+        };
+        zero_order_sweep(ops.iter(), &self.indeps, &mut self.vals, x);
+    }
+
+    fn zero_order_batch_into(&self, x: &[f64], values: &mut [f64], lanes: usize) {
+        zero_order_batch_sweep(
+            self.compact_ops().iter(),
+            &self.indeps,
+            &self.vals,
+            values,
+            x,
+            lanes,
+        )
+    }
+
+    fn first_order_forward_into(&self, dx: &[f64], dy: &mut [f64], ws: &mut Workspace) {
+        first_order_forward_sweep(
+            self.compact_ops().iter(),
+            &self.indeps,
+            &self.deps,
+            &self.vals,
+            dx,
+            dy,
+            ws,
+        )
+    }
+
+    fn first_order_reverse_into(&self, ybar: &[f64], xbar: &mut [f64], ws: &mut Workspace) {
+        first_order_reverse_sweep(
+            self.compact_ops().iter(),
+            &self.indeps,
+            &self.deps,
+            &self.vals,
+            ybar,
+            xbar,
+            ws,
+        )
+    }
+
+    fn first_order_forward_vector_into(
+        &self,
+        dx: &[f64],
+        dy: &mut [f64],
+        k: usize,
+        ws: &mut Workspace,
+    ) {
+        first_order_forward_vector_sweep(
+            self.compact_ops().iter(),
+            &self.indeps,
+            &self.deps,
+            &self.vals,
+            dx,
+            dy,
+            k,
+            ws,
+        )
+    }
+
+    fn first_order_reverse_vector_into(
+        &self,
+        ybar: &[f64],
+        xbar: &mut [f64],
+        k: usize,
+        ws: &mut Workspace,
+    ) {
+        first_order_reverse_vector_sweep(
+            self.compact_ops().iter(),
+            &self.indeps,
+            &self.deps,
+            &self.vals,
+            ybar,
+            xbar,
+            k,
+            ws,
+        )
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    adv_fn! {
+        fn test_function([[x1, x2]]) -> [[2]] {
+            let v1 = x1 * x2.sin() + 2.0;
+            let v2 = (v1 / x1).exp() - x2.powi(2);
+            adv_dvec![v1.ln(), v2.atan()]
+        }
+    }
+
+    fn test_function_tapes(x: &DVector<f64>) -> (impl Tape, CompactTape) {
+        let mut ctx = AContext::new();
+        let input = DVector::from_vec(ctx.new_indep_vec(2, 0.0));
+        let output = test_function(input);
+        ctx.set_dep_slice(output.as_slice());
+        let mut compact = ctx.compact_tape();
+        let mut tape = ctx.tape();
+        tape.zero_order(x);
+        compact.zero_order(x);
+        (tape, compact)
+    }
+
+    #[test]
+    fn compact_tape_ops() {
+        let (tape, compact) = test_function_tapes(&adv_dvec![1.0, 2.0]);
+        assert_eq!(
+            compact.ops_iter().collect::<Vec<_>>(),
+            tape.ops_iter().collect::<Vec<_>>()
+        );
+        assert_eq!(
+            CompactTape::from_tape(&compact)
+                .ops_iter()
+                .collect::<Vec<_>>(),
+            tape.ops_iter().collect::<Vec<_>>()
+        );
+        assert_eq!(compact.max_id(), tape.max_id());
+        assert!(
+            compact.size_in_bytes() < tape.ops_iter().count() * std::mem::size_of::<Operation>()
+        );
+    }
+
+    #[test]
+    fn compact_tape_sweeps() {
+        let (tape, compact) = test_function_tapes(&adv_dvec![1.5, 0.5]);
+        assert_eq!(compact.values(), tape.values());
+        assert_eq!(compact.y(), tape.y());
+
+        let dx = adv_dvec![1.0, -1.0];
+        assert_eq!(
+            compact.first_order_forward(&dx),
+            tape.first_order_forward(&dx)
+        );
+
+        let ybar = adv_dvec![0.5, 2.0];
+        assert_eq!(
+            compact.first_order_reverse(&ybar),
+            tape.first_order_reverse(&ybar)
+        );
+    }
+}
@@ -0,0 +1,333 @@
+use super::*;
+
+/// Marker for a missing argument in the argument arrays
+const NO_ARG: usize = usize::max_value();
+
+/// Consecutive operations sharing one op code
+#[derive(Debug, Clone)]
+struct Run {
+    opcode: OpCode,
+    start: usize,
+    end: usize,
+}
+
+/// Tape whose operations are batched into runs of a single op code
+///
+/// Sweeps dispatch on the op code once per run and then loop over the run with the op code fixed
+/// at compile time. Tapes in which every slot is written at most once are reordered by
+/// dependency level first, so independent operations of the same kind end up in one run. The
+/// relative order of `Abs` operations is kept, so switching variables keep their numbering.
+#[derive(Debug, Clone)]
+pub struct CompiledTape {
+    indeps: Vec<usize>,
+    deps: Vec<usize>,
+    vals: Vec<f64>,
+    runs: Vec<Run>,
+    vid: Vec<usize>,
+    arg1: Vec<usize>,
+    arg2: Vec<usize>,
+}
+
+/// Whether every slot is written at most once, never before it is read and never if it holds
+/// an independent
+fn is_single_assignment(tape: &dyn Tape, ops: &[Operation]) -> bool {
+    let len = tape.values().len();
+    let mut writes = vec![0; len];
+    for vid in tape.indeps() {
+        writes[*vid] += 1;
+    }
+    for op in ops {
+        writes[op.vid] += 1;
+    }
+    let mut written = vec![false; len];
+    for vid in tape.indeps() {
+        written[*vid] = true;
+    }
+    for op in ops {
+        let mut args = op.arg1.iter().chain(op.arg2.iter());
+        if writes[op.vid] > 1 || args.any(|arg| writes[*arg] > 0 && !written[*arg]) {
+            return false;
+        }
+        written[op.vid] = true;
+    }
+    true
+}
+
+/// Call `$kernel` with the op code of `$run` as a constant, so the loop over the run does not
+/// dispatch per operation
+macro_rules! dispatch {
+    ($run:expr, $this:ident.$kernel:ident($($arg:expr),*)) => {
+        match $run.opcode {
+            OpCode::Nop | OpCode::Const => {}
+            OpCode::Add => $this.$kernel(OpCode::Add, $($arg),*),
+            OpCode::Sub => $this.$kernel(OpCode::Sub, $($arg),*),
+            OpCode::Mul => $this.$kernel(OpCode::Mul, $($arg),*),
+            OpCode::Div => $this.$kernel(OpCode::Div, $($arg),*),
+            OpCode::Sin => $this.$kernel(OpCode::Sin, $($arg),*),
+            OpCode::Cos => $this.$kernel(OpCode::Cos, $($arg),*),
+            OpCode::Tan => $this.$kernel(OpCode::Tan, $($arg),*),
+            OpCode::Abs => $this.$kernel(OpCode::Abs, $($arg),*),
+            OpCode::Exp => $this.$kernel(OpCode::Exp, $($arg),*),
+            OpCode::Ln => $this.$kernel(OpCode::Ln, $($arg),*),
+            OpCode::Asin => $this.$kernel(OpCode::Asin, $($arg),*),
+            OpCode::Acos => $this.$kernel(OpCode::Acos, $($arg),*),
+            OpCode::Atan => $this.$kernel(OpCode::Atan, $($arg),*),
+            OpCode::Powf => $this.$kernel(OpCode::Powf, $($arg),*),
+        }
+    };
+}
+
+impl CompiledTape {
+    /// Batch the evaluation procedure of `tape` into runs
+    pub fn new(tape: &dyn Tape) -> Self {
+        let mut ops = tape
+            .ops_iter()
+            .filter(|op| op.opcode != OpCode::Nop)
+            .collect::<Vec<_>>();
+
+        if is_single_assignment(tape, &ops) {
+            // An operation only depends on operations of lower levels, and constants are
+            // available from the start
+            let mut level = vec![0; tape.values().len()];
+            let mut abs_level = 0;
+            let mut keys = Vec::with_capacity(ops.len());
+            for op in ops.iter() {
+                let mut op_level = op
+                    .arg1
+                    .iter()
+                    .chain(op.arg2.iter())
+                    .map(|arg| level[*arg] + 1)
+                    .max()
+                    .unwrap_or(0);
+                if op.opcode == OpCode::Abs {
+                    op_level = op_level.max(abs_level);
+                    abs_level = op_level;
+                }
+                level[op.vid] = op_level;
+                keys.push((op_level, op.opcode as u8));
+            }
+            let mut order = (0..ops.len()).collect::<Vec<_>>();
+            order.sort_by_key(|pos| keys[*pos]);
+            ops = order.into_iter().map(|pos| ops[pos]).collect();
+        }
+
+        let mut runs: Vec<Run> = Vec::new();
+        for (pos, op) in ops.iter().enumerate() {
+            match runs.last_mut() {
+                Some(run) if run.opcode == op.opcode => run.end = pos + 1,
+                _ => runs.push(Run {
+                    opcode: op.opcode,
+                    start: pos,
+                    end: pos + 1,
+                }),
+            }
+        }
+        Self {
+            indeps: tape.indeps().to_vec(),
+            deps: tape.deps().to_vec(),
+            vals: tape.values().to_vec(),
+            runs,
+            vid: ops.iter().map(|op| op.vid).collect(),
+            arg1: ops.iter().map(|op| op.arg1.unwrap_or(NO_ARG)).collect(),
+            arg2: ops.iter().map(|op| op.arg2.unwrap_or(NO_ARG)).collect(),
+        }
+    }
+
+    /// Number of runs the operations are batched into
+    pub fn num_runs(&self) -> usize {
+        self.runs.len()
+    }
+
+    /// Operation at `pos` with the op code of its run
+    #[inline(always)]
+    fn op(&self, opcode: OpCode, pos: usize) -> Operation {
+        Operation {
+            opcode,
+            vid: self.vid[pos],
+            arg1: Some(self.arg1[pos]),
+            arg2: if opcode.is_binary() {
+                Some(self.arg2[pos])
+            } else {
+                None
+            },
+        }
+    }
+
+    #[inline(always)]
+    fn primal_run(&self, opcode: OpCode, run: &Run, v: &mut [f64]) {
+        for pos in run.start..run.end {
+            self.op(opcode, pos).zero_order(v);
+        }
+    }
+
+    #[inline(always)]
+    fn tangent_run(&self, opcode: OpCode, run: &Run, v: &[f64], dv: &mut [f64]) {
+        for pos in run.start..run.end {
+            self.op(opcode, pos).first_order(v, dv);
+        }
+    }
+
+    #[inline(always)]
+    fn adjoint_run(&self, opcode: OpCode, run: &Run, v: &[f64], vbar: &mut [f64]) {
+        for pos in (run.start..run.end).rev() {
+            self.op(opcode, pos).first_order_reverse(v, vbar);
+        }
+    }
+}
+
+impl Tape for CompiledTape {
+    fn indeps(&self) -> &[usize] {
+        &self.indeps
+    }
+
+    fn deps(&self) -> &[usize] {
+        &self.deps
+    }
+
+    fn values(&self) -> &[f64] {
+        &self.vals
+    }
+
+    fn values_mut(&mut self) -> &mut [f64] {
+        &mut self.vals
+    }
+
+    fn ops_iter<'a>(&'a self) -> Box<dyn DoubleEndedIterator<Item = Operation> + 'a> {
+        let arg = |arg: usize| if arg == NO_ARG { None } else { Some(arg) };
+        Box::new(self.runs.iter().flat_map(move |run| {
+            (run.start..run.end).map(move |pos| Operation {
+                opcode: run.opcode,
+                vid: self.vid[pos],
+                arg1: arg(self.arg1[pos]),
+                arg2: arg(self.arg2[pos]),
+            })
+        }))
+    }
+
+    fn zero_order(&mut self, x: &DVector<f64>) {
+        let _timer = profile::time(Timer::ZeroOrder);
+        assert_eq!(x.nrows(), self.indeps.len());
+        for (idx, vid) in self.indeps.iter().enumerate() {
+            self.vals[*vid] = x[idx];
+        }
+        let mut vals = std::mem::take(&mut self.vals);
+        for run in self.runs.iter() {
+            dispatch!(run, self.primal_run(run, &mut vals));
+        }
+        self.vals = vals;
+    }
+
+    fn first_order_forward_into(&self, dx: &[f64], dy: &mut [f64], ws: &mut Workspace) {
+        let _timer = profile::time(Timer::Forward);
+        assert_eq!(dx.len(), self.indeps.len());
+        assert_eq!(dy.len(), self.deps.len());
+        let dv = ws.zeroed(self.vals.len());
+        for (idx, vid) in self.indeps.iter().enumerate() {
+            dv[*vid] = dx[idx];
+        }
+        for run in self.runs.iter() {
+            dispatch!(run, self.tangent_run(run, &self.vals, dv));
+        }
+        for (idx, vid) in self.deps.iter().enumerate() {
+            dy[idx] = dv[*vid];
+        }
+    }
+
+    fn first_order_reverse_into(&self, ybar: &[f64], xbar: &mut [f64], ws: &mut Workspace) {
+        let _timer = profile::time(Timer::Reverse);
+        assert_eq!(ybar.len(), self.deps.len());
+        assert_eq!(xbar.len(), self.indeps.len());
+        let vbar = ws.zeroed(self.vals.len());
+        for (idx, vid) in self.deps.iter().enumerate() {
+            vbar[*vid] += ybar[idx];
+        }
+        for run in self.runs.iter().rev() {
+            dispatch!(run, self.adjoint_run(run, &self.vals, vbar));
+        }
+        for (idx, vid) in self.indeps.iter().enumerate() {
+            xbar[idx] = vbar[*vid];
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    adv_fn! {
+        fn test_function([[x1, x2]]) -> [[3]] {
+            let v1 = x1 * x2.sin() + x1.powf(x2) - x2 / x1;
+            let v2 = (v1 / x1).exp() * x1.cos() + x2.atan() - x1.ln();
+            adv_dvec![v1, v2.tan(), (x1 * x1 - x2).abs()]
+        }
+    }
+
+    #[test]
+    fn compiled_tape_matches_tape() {
+        let mut tape = adv_fn_obj!(test_function).tape(&adv_dvec![1.0, 1.0]);
+        let mut compiled = CompiledTape::new(tape.as_ref());
+        for x in &[adv_dvec![1.5, -0.5], adv_dvec![0.2, 2.0]] {
+            tape.zero_order(x);
+            compiled.zero_order(x);
+            assert_eq!(compiled.values(), tape.values());
+
+            let dx = adv_dvec![1.0, 0.5];
+            assert_eq!(
+                compiled.first_order_forward(&dx),
+                tape.first_order_forward(&dx)
+            );
+        }
+    }
+
+    #[test]
+    fn compiled_tape_reverse() {
+        let mut tape = {
+            let mut ctx = AContext::new();
+            let x = ctx.new_indep_vec(2, 0.0);
+            let y = (x[0] * x[1].sin()).exp() / x[1] - x[0].asin() * x[1].acos();
+            ctx.set_dep(&y);
+            ctx.tape()
+        };
+        tape.zero_order(&adv_dvec![0.3, 0.6]);
+        let compiled = CompiledTape::new(&tape);
+        let ybar = adv_dvec![2.0];
+        // Reordering changes the order in which adjoints are summed
+        let xbar = compiled.first_order_reverse(&ybar);
+        assert!((xbar - tape.first_order_reverse(&ybar)).norm() < 1e-12);
+    }
+
+    #[test]
+    fn compiled_tape_batches_runs() {
+        let n = 10;
+        let tape = {
+            let mut ctx = AContext::new();
+            let x = ctx.new_indep_vec(n, 0.5);
+            let y = x
+                .iter()
+                .map(|xi| (xi.sin() * *xi).abs().exp())
+                .collect::<Vec<_>>();
+            ctx.set_dep_slice(&y);
+            ctx.tape()
+        };
+        let compiled = CompiledTape::new(&tape);
+        assert_eq!(compiled.num_runs(), 4);
+        let abs_args = |tape: &dyn Tape| {
+            tape.ops_iter()
+                .filter(|op| op.opcode == OpCode::Abs)
+                .map(|op| op.arg1)
+                .collect::<Vec<_>>()
+        };
+        assert_eq!(abs_args(&compiled), abs_args(&tape));
+
+        // Slot 2 is overwritten after it has been read, so the order is kept
+        let ops = [Operation::sin(1, 2), Operation::add(2, 0, 0)];
+        let values = vec![0.0, 0.0, 3.0];
+        let mut tape = CompactTape::new(vec![0], vec![1, 2], &ops, values);
+        let mut compiled = CompiledTape::new(&tape);
+        assert_eq!(compiled.num_runs(), 2);
+        let x = adv_dvec![0.5];
+        tape.zero_order(&x);
+        compiled.zero_order(&x);
+        assert_eq!(compiled.y(), tape.y());
+    }
+}
@@ -64,7 +64,35 @@ ADouble AContext::new_independent()
 
 void AContext::set_dependent(const ADouble& var)
 {
-	::adv_acontext_set_dependent(m_impl->ctx, reinterpret_cast<const ::adv_adouble*>(var.get_impl()));
+	::adv_acontext_set_dependent(m_impl->ctx, var.raw());
+}
+
+std::vector<ADouble> AContext::new_independents(std::size_t n)
+{
+	std::vector<ADouble> vars(n);
+	new_independents(vars.data(), n);
+	return vars;
+}
+
+void AContext::new_independents(ADouble* vars, std::size_t n)
+{
+	// `ADouble` has the layout of `adv_adouble`
+	::adv_acontext_new_independents(m_impl->ctx, reinterpret_cast<::adv_adouble*>(vars), n);
+}
+
+void AContext::set_dependents(const ADouble* vars, std::size_t n)
+{
+	::adv_acontext_set_dependents(m_impl->ctx, reinterpret_cast<const ::adv_adouble*>(vars), n);
+}
+
+void AContext::set_dependents(const std::vector<ADouble>& vars)
+{
+	set_dependents(vars.data(), vars.size());
+}
+
+void AContext::reserve(std::size_t ops, std::size_t values)
+{
+	::adv_acontext_reserve(m_impl->ctx, ops, values);
 }
 
 } // namespace adv
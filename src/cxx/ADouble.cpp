@@ -7,77 +7,62 @@
 namespace adv
 {
 
-struct ADouble::Impl
+static_assert(sizeof(ADouble) == sizeof(::adv_adouble), "ADouble layout must match adv_adouble");
+static_assert(sizeof(BlockOp) == sizeof(::adv_block_op), "BlockOp layout must match adv_block_op");
+
+ADouble::ADouble(const ::adv_adouble& raw):
+	m_value(raw.value),
+	m_dvalue(raw.dvalue),
+	m_cid(raw.cid),
+	m_vid(raw.vid)
 {
-public:
-	adv_adouble* val;
-};
-
-ADouble::~ADouble()
-{
-	::adv_adouble_free(m_impl->val);
-	delete m_impl;
-}
-
-ADouble::ADouble(void* impl):
-	m_impl(new Impl)
-{
-	m_impl->val = reinterpret_cast<adv_adouble*>(impl);
 }
 
 ADouble::ADouble():
-	ADouble(::adv_adouble_default())
+	ADouble(0.0)
 {
 }
 
 ADouble::ADouble(double val):
-	ADouble(::adv_adouble_from_value(val))
-{
-}
-
-ADouble::ADouble(const ADouble& other):
-	ADouble(::adv_adouble_copy(other.m_impl->val))
+	m_value(val),
+	m_dvalue(0.0),
+	m_cid(0),
+	m_vid(0)
 {
 }
 
-ADouble::ADouble(ADouble&& other):
-	ADouble(other.m_impl->val)
+::adv_adouble ADouble::raw() const
 {
-	other.m_impl->val = ::adv_adouble_default();
+	return ::adv_adouble { m_value, m_dvalue, m_cid, m_vid };
 }
 
-ADouble& ADouble::operator=(ADouble&& other)
+double ADouble::value() const
 {
-	::adv_adouble_free(m_impl->val);
-	m_impl->val = other.m_impl->val;
-	other.m_impl->val = ::adv_adouble_default();
-	return *this;
+	return m_value;
 }
 
-ADouble& ADouble::operator=(const ADouble& other)
+double ADouble::dvalue() const
 {
-	::adv_adouble_free(m_impl->val);
-	m_impl->val = ::adv_adouble_copy(other.m_impl->val);
-	return *this;
+	return m_dvalue;
 }
 
-const void* ADouble::get_impl() const
+ADouble ADouble::record_block(const ADouble* inputs, std::size_t num_inputs, const BlockOp* ops, std::size_t num_ops)
 {
-	return m_impl->val;
+	// `ADouble` and `BlockOp` have the layouts of `adv_adouble` and `adv_block_op`
+	auto raw_inputs = reinterpret_cast<const ::adv_adouble*>(inputs);
+	auto raw_ops = reinterpret_cast<const ::adv_block_op*>(ops);
+	return ADouble(::adv_record_block(raw_inputs, num_inputs, raw_ops, num_ops));
 }
 
 #define BINARY_OP_IMPL(NAME, OP) \
 	ADouble ADouble::operator OP(const ADouble& rhs) const \
 	{ \
-		::adv_adouble* result_impl; \
-		::adv_op_##NAME(m_impl->val, rhs.m_impl->val, &result_impl); \
-		return ADouble(result_impl); \
+		return ADouble(::adv_op_##NAME(raw(), rhs.raw())); \
 	} \
 	\
-	ADouble operator OP(double lhs_, const ADouble& rhs) \
+	ADouble operator OP(double lhs, const ADouble& rhs) \
 	{ \
-		auto lhs = ADouble(lhs_); \
-		return lhs + rhs; \
+		return ADouble(lhs) OP rhs; \
 	}
 BINARY_OP_IMPL(add, +)
 BINARY_OP_IMPL(sub, -)
@@ -87,9 +72,7 @@ BINARY_OP_IMPL(div, /)
 
 #define UNARY_FUNC_IMPL(NAME, STDNAME) \
 	ADouble NAME(const ADouble& val) { \
-		::adv_adouble* ptr; \
-		::adv_##NAME(val.m_impl->val, &ptr); \
-		return ADouble(ptr); \
+		return ADouble(::adv_##NAME(val.raw())); \
 	} \
 	\
 	double NAME(double val) { \
@@ -106,9 +89,7 @@ UNARY_FUNC_IMPL(ln, log)
 
 #define BINARY_FUNC_IMPL(NAME) \
 	ADouble NAME(const ADouble& lhs, const ADouble& rhs) { \
-		::adv_adouble* ptr; \
-		::adv_##NAME(lhs.m_impl->val, rhs.m_impl->val, &ptr); \
-		return ADouble(ptr); \
+		return ADouble(::adv_##NAME(lhs.raw(), rhs.raw())); \
 	}
 BINARY_FUNC_IMPL(min)
 BINARY_FUNC_IMPL(max)
@@ -0,0 +1,39 @@
+#include <adv/Profile.hpp>
+#include "ffi.hpp"
+
+namespace adv
+{
+
+void Profile::enable()
+{
+	::adv_profile_enable();
+}
+
+void Profile::disable()
+{
+	::adv_profile_disable();
+}
+
+bool Profile::enabled()
+{
+	return ::adv_profile_is_enabled();
+}
+
+void Profile::reset()
+{
+	::adv_profile_reset();
+}
+
+std::string Profile::json()
+{
+	// The report may grow between the calls, so retry until it fits
+	std::string json;
+	std::size_t len;
+	while ((len = ::adv_profile_json(&json[0], json.size() + 1)) > json.size()) {
+		json.resize(len);
+	}
+	json.resize(len);
+	return json;
+}
+
+} // namespace adv
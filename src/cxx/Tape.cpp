@@ -0,0 +1,93 @@
+#include <adv/Tape.hpp>
+#include "ffi.hpp"
+
+namespace adv
+{
+
+struct Tape::Impl
+{
+public:
+	adv_tape* tape;
+};
+
+Tape::~Tape()
+{
+	if (m_impl != nullptr) {
+		if (m_impl->tape != nullptr) {
+			::adv_tape_free(m_impl->tape);
+		}
+		delete m_impl;
+	}
+}
+
+Tape::Tape(AContext&& ctx):
+	m_impl(new Impl)
+{
+	m_impl->tape = ::adv_tape_new(static_cast<adv_acontext*>(ctx.move_impl()));
+}
+
+Tape::Tape(Tape&& other):
+	m_impl(other.m_impl)
+{
+	other.m_impl = nullptr;
+}
+
+Tape& Tape::operator=(Tape&& other)
+{
+	if (m_impl != nullptr) {
+		::adv_tape_free(m_impl->tape);
+		delete m_impl;
+	}
+	m_impl = other.m_impl;
+	other.m_impl = nullptr;
+	return *this;
+}
+
+std::size_t Tape::num_independents() const
+{
+	return ::adv_tape_num_independents(m_impl->tape);
+}
+
+std::size_t Tape::num_dependents() const
+{
+	return ::adv_tape_num_dependents(m_impl->tape);
+}
+
+std::size_t Tape::num_abs() const
+{
+	return ::adv_tape_num_abs(m_impl->tape);
+}
+
+void Tape::zero_order(const double* x, double* y)
+{
+	::adv_tape_zero_order(m_impl->tape, x, y);
+}
+
+void Tape::first_order_forward(const double* dx, double* dy) const
+{
+	::adv_tape_first_order_forward(m_impl->tape, dx, dy);
+}
+
+void Tape::first_order_reverse(const double* dy, double* dx) const
+{
+	::adv_tape_first_order_reverse(m_impl->tape, dy, dx);
+}
+
+void Tape::jacobian(double* jac) const
+{
+	::adv_tape_jacobian(m_impl->tape, jac);
+}
+
+void Tape::abs_normal(double* a, double* zmat, double* lmat, double* b, double* jmat, double* ymat) const
+{
+	::adv_tape_abs_normal(m_impl->tape, a, zmat, lmat, b, jmat, ymat);
+}
+
+std::string Tape::stats_json() const
+{
+	std::string json(::adv_tape_stats_json(m_impl->tape, nullptr, 0), '\0');
+	::adv_tape_stats_json(m_impl->tape, &json[0], json.size() + 1);
+	return json;
+}
+
+} // namespace adv
@@ -1,37 +1,75 @@
 #ifndef _ADV_FFI_HPP
 #define _ADV_FFI_HPP
 
+#include <cstddef>
+#include <cstdint>
+
 extern "C"
 {
 
 typedef struct adv_acontext adv_acontext;
-typedef struct adv_adouble adv_adouble;
+typedef struct adv_tape adv_tape;
+
+struct adv_adouble
+{
+	double value;
+	double dvalue;
+	std::size_t cid;
+	std::size_t vid;
+};
 
 void adv_acontext_free(adv_acontext* self);
 adv_acontext* adv_acontext_new(void);
 
-adv_adouble* adv_acontext_new_independent(adv_acontext* self);
-void adv_acontext_set_dependent(adv_acontext* self, const adv_adouble* val);
+adv_adouble adv_acontext_new_independent(adv_acontext* self);
+void adv_acontext_set_dependent(adv_acontext* self, adv_adouble val);
+void adv_acontext_new_independents(adv_acontext* self, adv_adouble* vals, std::size_t len);
+void adv_acontext_set_dependents(adv_acontext* self, const adv_adouble* vals, std::size_t len);
+void adv_acontext_reserve(adv_acontext* self, std::size_t ops, std::size_t values);
+
+adv_tape* adv_tape_new(adv_acontext* ctx);
+void adv_tape_free(adv_tape* self);
+
+std::size_t adv_tape_num_independents(const adv_tape* self);
+std::size_t adv_tape_num_dependents(const adv_tape* self);
+std::size_t adv_tape_num_abs(const adv_tape* self);
+
+void adv_tape_zero_order(adv_tape* self, const double* x, double* y);
+void adv_tape_first_order_forward(const adv_tape* self, const double* dx, double* dy);
+void adv_tape_first_order_reverse(const adv_tape* self, const double* dy, double* dx);
+void adv_tape_jacobian(const adv_tape* self, double* jac);
+void adv_tape_abs_normal(const adv_tape* self, double* a, double* zmat, double* lmat, double* b, double* jmat, double* ymat);
+std::size_t adv_tape_stats_json(const adv_tape* self, char* buf, std::size_t len);
+
+void adv_profile_enable(void);
+void adv_profile_disable(void);
+bool adv_profile_is_enabled(void);
+void adv_profile_reset(void);
+std::size_t adv_profile_json(char* buf, std::size_t len);
+
+struct adv_block_op
+{
+	std::uint32_t opcode;
+	std::uint32_t arg1;
+	std::uint32_t arg2;
+};
 
-void adv_adouble_free(adv_adouble* self);
-adv_adouble* adv_adouble_default(void);
-adv_adouble* adv_adouble_copy(const adv_adouble* this_);
-adv_adouble* adv_adouble_from_value(double val);
+adv_adouble adv_record_block(const adv_adouble* inputs, std::size_t num_inputs, const adv_block_op* ops, std::size_t num_ops);
 
-void adv_op_add(const adv_adouble* a, const adv_adouble* b, adv_adouble** result);
-void adv_op_sub(const adv_adouble* a, const adv_adouble* b, adv_adouble** result);
-void adv_op_mul(const adv_adouble* a, const adv_adouble* b, adv_adouble** result);
-void adv_op_div(const adv_adouble* a, const adv_adouble* b, adv_adouble** result);
+adv_adouble adv_op_add(adv_adouble a, adv_adouble b);
+adv_adouble adv_op_sub(adv_adouble a, adv_adouble b);
+adv_adouble adv_op_mul(adv_adouble a, adv_adouble b);
+adv_adouble adv_op_div(adv_adouble a, adv_adouble b);
 
-void adv_sin(const adv_adouble* x, adv_adouble** result);
-void adv_cos(const adv_adouble* x, adv_adouble** result);
-void adv_tan(const adv_adouble* x, adv_adouble** result);
-void adv_abs(const adv_adouble* x, adv_adouble** result);
-void adv_exp(const adv_adouble* x, adv_adouble** result);
-void adv_ln(const adv_adouble* x, adv_adouble** result);
+adv_adouble adv_sin(adv_adouble x);
+adv_adouble adv_cos(adv_adouble x);
+adv_adouble adv_tan(adv_adouble x);
+adv_adouble adv_abs(adv_adouble x);
+adv_adouble adv_exp(adv_adouble x);
+adv_adouble adv_ln(adv_adouble x);
 
-void adv_max(const adv_adouble* a, const adv_adouble* b, adv_adouble** result);
-void adv_min(const adv_adouble* a, const adv_adouble* b, adv_adouble** result);
+adv_adouble adv_max(adv_adouble a, adv_adouble b);
+adv_adouble adv_min(adv_adouble a, adv_adouble b);
 
 }
 
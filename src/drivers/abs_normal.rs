@@ -3,11 +3,16 @@ use nalgebra::{Dim, Matrix};
 use rayon::prelude::*;
 
 /// Wraps a tape containing abs-calls and decomposes it for algorithms specific to piecewise-smooth functions
+///
+/// The positions of the abs-functions and the operation stream with abs-functions replaced by
+/// `Nop` are computed once on construction.
 #[derive(Debug)]
 pub struct AbsNormalTape {
     inner: Box<dyn Tape>,
     indeps: Vec<usize>,
     deps: Vec<usize>,
+    ops: Vec<Operation>,
+    abs_positions: Vec<usize>,
     n: usize,
     m: usize,
     s: usize,
@@ -15,35 +20,37 @@ pub struct AbsNormalTape {
 
 impl AbsNormalTape {
     pub fn new(inner: Box<dyn Tape>) -> Self {
+        let mut ops = inner.ops_iter().collect::<Vec<_>>();
+        let mut abs_positions = Vec::new();
+        let mut abs_vids = Vec::new();
+        let mut abs_args = Vec::new();
+        for (pos, op) in ops.iter_mut().enumerate() {
+            if op.opcode == OpCode::Abs {
+                abs_positions.push(pos);
+                abs_vids.push(op.vid);
+                abs_args.push(op.arg1.unwrap());
+                *op = Operation::nop();
+            }
+        }
+
         // Save dimensions
         let n = inner.num_indeps();
         let m = inner.num_deps();
-        let s = inner.num_abs();
-
-        // Calculate independent indices
-        let indeps = {
-            let x_iter = inner.indeps().iter().cloned();
-            let z_iter = inner
-                .ops_iter()
-                .filter(|op| op.opcode == OpCode::Abs)
-                .map(|op| op.vid);
-            x_iter.chain(z_iter).collect()
-        };
+        let s = abs_positions.len();
 
-        // Calculate dependent indices
-        let deps = {
-            let y_iter = inner.deps().iter().cloned();
-            let z_iter = inner
-                .ops_iter()
-                .filter(|op| op.opcode == OpCode::Abs)
-                .map(|op| op.arg1.unwrap());
-            z_iter.chain(y_iter).collect()
-        };
+        // Independents are x and |z|, dependents are z and y
+        let indeps = inner.indeps().iter().cloned().chain(abs_vids).collect();
+        let deps = abs_args
+            .into_iter()
+            .chain(inner.deps().iter().cloned())
+            .collect();
 
         Self {
             inner,
             indeps,
             deps,
+            ops,
+            abs_positions,
             n,
             m,
             s,
@@ -86,14 +93,139 @@ impl AbsNormalTape {
 
     pub fn z(&self) -> DVector<f64> {
         DVector::from_vec(
-            self.inner
-                .ops_iter()
-                .filter(|op| op.opcode == OpCode::Abs)
-                .map(|op| op.arg1.unwrap())
-                .map(|id| self.values()[id])
+            self.deps[..self.s]
+                .iter()
+                .map(|id| self.values()[*id])
                 .collect(),
         )
     }
+
+    /// Signs of the switching variables with zero for kinks
+    pub fn signature(&self) -> DVector<f64> {
+        self.z().map(|z| {
+            if z > 0.0 {
+                1.0
+            } else if z < 0.0 {
+                -1.0
+            } else {
+                0.0
+            }
+        })
+    }
+
+    /// Replay the tape at `x` and return the switching variables whose sign changed
+    ///
+    /// Abs-factorable functions without branches record the same operations at every point, so
+    /// the decomposition computed on construction stays valid and views like `AbsNormalZ` can be
+    /// created again without recording a new tape.
+    pub fn retape(&mut self, x: &DVector<f64>) -> Vec<usize> {
+        profile::count(Counter::AbsNormalRetapes, 1);
+        let before = self.signature();
+        self.inner.zero_order(x);
+        let after = self.signature();
+        (0..self.s).filter(|i| before[*i] != after[*i]).collect()
+    }
+
+    /// Whether the smooth parts are linear, so the matrices of the Abs-Normal Form are constant
+    pub fn is_piecewise_linear(&self) -> bool {
+        let mut active = vec![false; self.values().len()];
+        for vid in self.indeps.iter() {
+            active[*vid] = true;
+        }
+        for op in self.ops.iter() {
+            if op.opcode == OpCode::Nop {
+                continue;
+            }
+            let a1 = op.arg1.iter().any(|i| active[*i]);
+            let a2 = op.arg2.iter().any(|i| active[*i]);
+            let linear = match op.opcode {
+                OpCode::Nop | OpCode::Const | OpCode::Add | OpCode::Sub => true,
+                OpCode::Mul => !(a1 && a2),
+                OpCode::Div => !a2,
+                _ => !(a1 || a2),
+            };
+            if !linear {
+                return false;
+            }
+            active[op.vid] = a1 || a2;
+        }
+        true
+    }
+
+    /// Original abs-function operations in tape order
+    fn abs_ops<'a>(
+        &'a self,
+    ) -> impl DoubleEndedIterator<Item = (usize, usize, usize)> + ExactSizeIterator + 'a {
+        self.abs_positions
+            .iter()
+            .zip(self.indeps[self.n..].iter())
+            .zip(self.deps[..self.s].iter())
+            .map(|((pos, vid), arg)| (*pos, *vid, *arg))
+    }
+
+    /// Solve `Δz = a + ZΔx + L|Δz|` by forward substitution
+    ///
+    /// `L` is strictly lower triangular, so a single tangent sweep that replaces each abs-function
+    /// by `|Δz_i|` as soon as `Δz_i` is known is enough.
+    pub fn forward_substitution(&self, a: &DVector<f64>, dx: &DVector<f64>) -> DVector<f64> {
+        assert_eq!(a.nrows(), self.s);
+        assert_eq!(dx.nrows(), self.n);
+        let values = self.inner.values();
+        let mut dz = DVector::zeros(self.s);
+        Workspace::with_local(|ws| {
+            let dv = ws.zeroed(values.len());
+            for (idx, vid) in self.inner.indeps().iter().enumerate() {
+                dv[*vid] = dx[idx];
+            }
+            let mut start = 0;
+            for (i, (pos, vid, arg)) in self.abs_ops().enumerate() {
+                for op in self.ops[start..pos].iter() {
+                    op.first_order(values, dv);
+                }
+                dz[i] = a[i] + dv[arg];
+                dv[vid] = dz[i].abs();
+                start = pos + 1;
+            }
+        });
+        dz
+    }
+
+    /// Solve `u = (wY + uL)Σ` by back substitution
+    ///
+    /// The same adjoint sweep also yields `xbar = wJ + uZ`.
+    pub fn reverse_substitution(
+        &self,
+        sigma: &DVector<f64>,
+        w: &[f64],
+        u: &mut [f64],
+        xbar: &mut [f64],
+        ws: &mut Workspace,
+    ) {
+        assert_eq!(sigma.nrows(), self.s);
+        assert_eq!(w.len(), self.m);
+        assert_eq!(u.len(), self.s);
+        assert_eq!(xbar.len(), self.n);
+        let values = self.inner.values();
+        let vbar = ws.zeroed(values.len());
+        for (idx, vid) in self.inner.deps().iter().enumerate() {
+            vbar[*vid] += w[idx];
+        }
+        let mut end = self.ops.len();
+        for (i, (pos, vid, arg)) in self.abs_ops().enumerate().rev() {
+            for op in self.ops[pos + 1..end].iter().rev() {
+                op.first_order_reverse(values, vbar);
+            }
+            u[i] = vbar[vid] * sigma[i];
+            vbar[arg] += u[i];
+            end = pos;
+        }
+        for op in self.ops[..end].iter().rev() {
+            op.first_order_reverse(values, vbar);
+        }
+        for (idx, vid) in self.inner.indeps().iter().enumerate() {
+            xbar[idx] = vbar[*vid];
+        }
+    }
 }
 
 impl Tape for AbsNormalTape {
@@ -106,13 +238,15 @@ impl Tape for AbsNormalTape {
     }
 
     fn ops_iter<'a>(&'a self) -> Box<dyn DoubleEndedIterator<Item = Operation> + 'a> {
-        Box::new(self.inner.ops_iter().map(|op| {
-            if op.opcode == OpCode::Abs {
-                Operation::nop()
-            } else {
-                op
-            }
-        }))
+        Box::new(self.ops.iter().cloned())
+    }
+
+    fn ops_slice(&self) -> Option<&[Operation]> {
+        Some(&self.ops)
+    }
+
+    fn num_abs(&self) -> usize {
+        0
     }
 
     fn values(&self) -> &[f64] {
@@ -158,30 +292,33 @@ macro_rules! anf_matrix {
                 S: nalgebra::storage::Storage<f64, R, C> + Sync,
             {
                 assert_eq!(self.ncols(), rhs.nrows());
-                let cols = (0..rhs.ncols())
-                    .into_par_iter()
-                    .map(|j| {
-                        let mut dx = DVector::zeros(rhs.nrows());
-                        for i in 0..rhs.nrows() {
-                            dx[i] = rhs[(i, j)];
-                        }
-                        let dy = self.first_order_forward(&dx);
-                        let mut result = DMatrix::zeros(self.nrows(), 1);
-                        for i in 0..dy.nrows() {
-                            result[(i, 0)] = dy[i];
-                        }
-                        vec![(j, result)]
-                    })
-                    .reduce(
-                        Vec::new,
-                        |mut a, mut b| {
-                            a.append(&mut b);
-                            a
-                        },
-                    );
-                let mut result = DMatrix::zeros(self.nrows(), rhs.ncols());
-                for (j, col) in cols.iter() {
-                    result.column_mut(*j).copy_from(col);
+                let (nrows, ncols) = (self.nrows(), self.ncols());
+                let mut result = DMatrix::zeros(nrows, rhs.ncols());
+                if nrows > 0 {
+                    // Columns are propagated in blocks of `SWEEP_BLOCK_WIDTH` directions
+                    result
+                        .as_mut_slice()
+                        .par_chunks_mut(nrows * SWEEP_BLOCK_WIDTH)
+                        .enumerate()
+                        .for_each(|(b, block)| {
+                            let j0 = b * SWEEP_BLOCK_WIDTH;
+                            let k = block.len() / nrows;
+                            let mut dx = vec![0.0; ncols * k];
+                            for i in 0..ncols {
+                                for l in 0..k {
+                                    dx[i * k + l] = rhs[(i, j0 + l)];
+                                }
+                            }
+                            let mut dy = vec![0.0; nrows * k];
+                            Workspace::with_local(|ws| {
+                                self.first_order_forward_vector_into(&dx, &mut dy, k, ws)
+                            });
+                            for l in 0..k {
+                                for i in 0..nrows {
+                                    block[l * nrows + i] = dy[i * k + l];
+                                }
+                            }
+                        });
                 }
                 result
             }
@@ -191,32 +328,36 @@ macro_rules! anf_matrix {
                 S: nalgebra::storage::Storage<f64, R, C> + Sync,
             {
                 assert_eq!(lhs.ncols(), self.nrows());
-                let rows = (0..lhs.nrows())
-                    .into_par_iter()
-                    .map(|i| {
-                        let mut ybar = DVector::zeros(lhs.ncols());
-                        for j in 0..lhs.ncols() {
-                            ybar[j] = lhs[(i, j)];
-                        }
-                        let xbar = self.first_order_reverse(&ybar);
-                        let mut result = DMatrix::zeros(1, self.ncols());
-                        for j in 0..xbar.nrows() {
-                            result[(0, j)] = xbar[j];
-                        }
-                        vec![(i, result)]
-                    })
-                    .reduce(
-                        Vec::new,
-                        |mut a, mut b| {
-                            a.append(&mut b);
-                            a
-                        },
-                    );
-                let mut result = DMatrix::zeros(lhs.nrows(), self.ncols());
-                for (i, row) in rows.iter() {
-                    result.row_mut(*i).copy_from(row);
+                let (nrows, ncols) = (self.nrows(), self.ncols());
+                // Rows of the result are computed as columns of its transpose in blocks of
+                // `SWEEP_BLOCK_WIDTH` directions
+                let mut result_t = DMatrix::zeros(ncols, lhs.nrows());
+                if ncols > 0 {
+                    result_t
+                        .as_mut_slice()
+                        .par_chunks_mut(ncols * SWEEP_BLOCK_WIDTH)
+                        .enumerate()
+                        .for_each(|(b, block)| {
+                            let i0 = b * SWEEP_BLOCK_WIDTH;
+                            let k = block.len() / ncols;
+                            let mut ybar = vec![0.0; nrows * k];
+                            for j in 0..nrows {
+                                for l in 0..k {
+                                    ybar[j * k + l] = lhs[(i0 + l, j)];
+                                }
+                            }
+                            let mut xbar = vec![0.0; ncols * k];
+                            Workspace::with_local(|ws| {
+                                self.first_order_reverse_vector_into(&ybar, &mut xbar, k, ws)
+                            });
+                            for l in 0..k {
+                                for j in 0..ncols {
+                                    block[l * ncols + j] = xbar[j * k + l];
+                                }
+                            }
+                        });
                 }
-                result
+                result_t.transpose()
             }
 
             pub fn row(&self, i: usize) -> DMatrix<f64> {
@@ -245,6 +386,14 @@ macro_rules! anf_matrix {
                 self.inner.ops_iter()
             }
 
+            fn ops_slice(&self) -> Option<&[Operation]> {
+                self.inner.ops_slice()
+            }
+
+            fn num_abs(&self) -> usize {
+                0
+            }
+
             fn values(&self) -> &[f64] {
                 self.inner.values()
             }
@@ -292,55 +441,192 @@ pub struct AbsNormalForm {
     pub ymat: DMatrix<f64>,
 }
 
+impl AbsNormalForm {
+    /// Derive the dense Abs-Normal Form of a decomposed tape
+    #[allow(clippy::many_single_char_names)]
+    pub fn from_tape(abs_tape: &AbsNormalTape) -> Self {
+        let _timer = profile::time(Timer::AbsNormal);
+        profile::count(Counter::AbsNormalForms, 1);
+        let n = abs_tape.n();
+        let m = abs_tape.m();
+        let s = abs_tape.s();
+
+        let z_tape = AbsNormalZ::new(&abs_tape);
+        let l_tape = AbsNormalL::new(&abs_tape);
+        let j_tape = AbsNormalJ::new(&abs_tape);
+        let y_tape = AbsNormalY::new(&abs_tape);
+
+        let zmat = if n < s {
+            z_tape.mul_right(&DMatrix::identity(n, n))
+        } else {
+            z_tape.mul_left(&DMatrix::identity(s, s))
+        };
+
+        let lmat = l_tape.mul_left(&DMatrix::identity(s, s));
+
+        let jmat = if n < m {
+            j_tape.mul_right(&DMatrix::identity(n, n))
+        } else {
+            j_tape.mul_left(&DMatrix::identity(m, m))
+        };
+
+        let ymat = if s < m {
+            y_tape.mul_right(&DMatrix::identity(s, s))
+        } else {
+            y_tape.mul_left(&DMatrix::identity(m, m))
+        };
+
+        let z = abs_tape.z();
+        let z_abs = z.abs();
+        let a = &z - &lmat * &z_abs;
+        let b = -&ymat * &z_abs;
+
+        Self {
+            a,
+            zmat,
+            lmat,
+            b,
+            jmat,
+            ymat,
+        }
+    }
+
+    /// Bring the form to the current point of `abs_tape` after `AbsNormalTape::retape`
+    ///
+    /// The matrices of piecewise linear functions are kept and only `a` and `b` are computed
+    /// again.
+    pub fn update(&mut self, abs_tape: &AbsNormalTape) {
+        if abs_tape.is_piecewise_linear() {
+            let _timer = profile::time(Timer::AbsNormal);
+            profile::count(Counter::AbsNormalUpdates, 1);
+            let z = abs_tape.z();
+            let z_abs = z.abs();
+            self.a = &z - &self.lmat * &z_abs;
+            self.b = -&self.ymat * &z_abs;
+        } else {
+            *self = Self::from_tape(abs_tape);
+        }
+    }
+}
+
 /// Derive a dense Abs-Normal form from a function
-#[allow(clippy::many_single_char_names)]
 pub fn abs_normal(func: &dyn Function, x: &DVector<f64>) -> AbsNormalForm {
-    let tape = func.tape(x);
-    let abs_tape = AbsNormalTape::new(tape);
-    let n = abs_tape.n();
-    let m = abs_tape.m();
-    let s = abs_tape.s();
-
-    let z_tape = AbsNormalZ::new(&abs_tape);
-    let l_tape = AbsNormalL::new(&abs_tape);
-    let j_tape = AbsNormalJ::new(&abs_tape);
-    let y_tape = AbsNormalY::new(&abs_tape);
-
-    let zmat = if n < s {
-        z_tape.mul_right(&DMatrix::identity(n, n))
-    } else {
-        z_tape.mul_left(&DMatrix::identity(s, s))
-    };
+    abs_normal_tape(func.tape(x))
+}
 
-    let lmat = l_tape.mul_left(&DMatrix::identity(s, s));
+/// Derive a dense Abs-Normal form from a tape
+pub fn abs_normal_tape(tape: Box<dyn Tape>) -> AbsNormalForm {
+    AbsNormalForm::from_tape(&AbsNormalTape::new(tape))
+}
 
-    let jmat = if n < m {
-        j_tape.mul_right(&DMatrix::identity(n, n))
-    } else {
-        j_tape.mul_left(&DMatrix::identity(m, m))
-    };
+/// Sparse representation of an Abs-Normal Form
+///
+/// `lmat` is strictly lower triangular, so systems involving it are solved by substitution.
+#[derive(Debug, Clone, PartialEq)]
+pub struct SparseAbsNormalForm {
+    pub a: DVector<f64>,
+    pub zmat: CsrMatrix,
+    pub lmat: CsrMatrix,
+    pub b: DVector<f64>,
+    pub jmat: CsrMatrix,
+    pub ymat: CsrMatrix,
+}
 
-    let ymat = if s < m {
-        y_tape.mul_right(&DMatrix::identity(s, s))
-    } else {
-        y_tape.mul_left(&DMatrix::identity(m, m))
-    };
+impl SparseAbsNormalForm {
+    /// Derive the sparse Abs-Normal Form from the sparsity pattern of a decomposed tape
+    #[allow(clippy::many_single_char_names)]
+    pub fn from_tape(abs_tape: &AbsNormalTape) -> Self {
+        let _timer = profile::time(Timer::AbsNormal);
+        profile::count(Counter::AbsNormalForms, 1);
+        let n = abs_tape.n();
+        let m = abs_tape.m();
+        let s = abs_tape.s();
+
+        // The decomposed tape maps (x, |z|) to (z, y)
+        let full = sparse_jacobian(abs_tape);
+        let zmat = full.submatrix(0..s, 0..n);
+        let lmat = full.submatrix(0..s, n..n + s);
+        let jmat = full.submatrix(s..s + m, 0..n);
+        let ymat = full.submatrix(s..s + m, n..n + s);
+        assert!(lmat.is_strictly_lower_triangular());
 
-    let z = abs_tape.z();
-    let z_abs = z.abs();
-    let a = &z - &lmat * &z_abs;
-    let b = -&ymat * &z_abs;
+        let z = abs_tape.z();
+        let z_abs = z.abs();
+        let a = &z - lmat.mul_vector(&z_abs);
+        let b = -ymat.mul_vector(&z_abs);
+
+        Self {
+            a,
+            zmat,
+            lmat,
+            b,
+            jmat,
+            ymat,
+        }
+    }
 
-    AbsNormalForm {
-        a,
-        zmat,
-        lmat,
-        b,
-        jmat,
-        ymat,
+    /// Bring the form to the current point of `abs_tape` after `AbsNormalTape::retape`
+    ///
+    /// The matrices of piecewise linear functions are kept and only `a` and `b` are computed
+    /// again.
+    pub fn update(&mut self, abs_tape: &AbsNormalTape) {
+        if abs_tape.is_piecewise_linear() {
+            let _timer = profile::time(Timer::AbsNormal);
+            profile::count(Counter::AbsNormalUpdates, 1);
+            let z = abs_tape.z();
+            let z_abs = z.abs();
+            self.a = &z - self.lmat.mul_vector(&z_abs);
+            self.b = -self.ymat.mul_vector(&z_abs);
+        } else {
+            *self = Self::from_tape(abs_tape);
+        }
+    }
+
+    pub fn n(&self) -> usize {
+        self.zmat.ncols()
+    }
+
+    pub fn m(&self) -> usize {
+        self.jmat.nrows()
+    }
+
+    pub fn s(&self) -> usize {
+        self.zmat.nrows()
+    }
+
+    /// Solve `Δz = a + ZΔx + L|Δz|` by forward substitution
+    pub fn dz(&self, dx: &DVector<f64>) -> DVector<f64> {
+        let mut dz = &self.a + self.zmat.mul_vector(dx);
+        for i in 0..self.s() {
+            let (cols, vals) = self.lmat.row(i);
+            dz[i] += cols
+                .iter()
+                .zip(vals.iter())
+                .map(|(j, val)| val * dz[*j].abs())
+                .sum::<f64>();
+        }
+        dz
+    }
+
+    /// Dense representation
+    pub fn to_dense(&self) -> AbsNormalForm {
+        AbsNormalForm {
+            a: self.a.clone(),
+            zmat: self.zmat.to_dense(),
+            lmat: self.lmat.to_dense(),
+            b: self.b.clone(),
+            jmat: self.jmat.to_dense(),
+            ymat: self.ymat.to_dense(),
+        }
     }
 }
 
+/// Derive a sparse Abs-Normal form from a function
+pub fn sparse_abs_normal(func: &dyn Function, x: &DVector<f64>) -> SparseAbsNormalForm {
+    let abs_tape = AbsNormalTape::new(func.tape(x));
+    SparseAbsNormalForm::from_tape(&abs_tape)
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
@@ -376,6 +662,61 @@ mod tests {
         assert_eq!(b, abs_ref.b);
     }
 
+    #[test]
+    fn abs_normal_tape_ops() {
+        let x = DVector::from_vec(vec![1.0, 2.0]);
+        let tape = adv_fn_obj!(halfpipe).tape(&x);
+        let inner_ops = tape.ops_iter().collect::<Vec<_>>();
+        let abs_tape = AbsNormalTape::new(tape);
+
+        let ops = abs_tape.ops_slice().unwrap();
+        assert_eq!(ops.len(), inner_ops.len());
+        for (op, inner_op) in ops.iter().zip(inner_ops.iter()) {
+            if inner_op.opcode == OpCode::Abs {
+                assert_eq!(*op, Operation::nop());
+            } else {
+                assert_eq!(op, inner_op);
+            }
+        }
+        assert_eq!(abs_tape.s(), 2);
+        assert_eq!(abs_tape.z(), adv_dvec![1.0, 3.0]);
+    }
+
+    /// Products spanning several sweep blocks match the dense matrices
+    #[test]
+    fn abs_normal_block_products() {
+        let x = DVector::from_vec(vec![1.0, 2.0]);
+        let abs_ref = halfpipe_anf(x.clone());
+        let abs_tape = AbsNormalTape::new(adv_fn_obj!(halfpipe).tape(&x));
+        let jmat_tape = AbsNormalJ::new(&abs_tape);
+
+        let cols = 2 * SWEEP_BLOCK_WIDTH + 3;
+        let rhs = DMatrix::from_fn(2, cols, |i, j| (i * cols + j) as f64 - 7.0);
+        let lhs = DMatrix::from_fn(cols, 1, |i, _| i as f64 * 0.5 - 3.0);
+        let right = jmat_tape.mul_right(&rhs) - &abs_ref.jmat * &rhs;
+        let left = jmat_tape.mul_left(&lhs) - &lhs * &abs_ref.jmat;
+        assert!(right.iter().all(|x| x.abs() < 1e-12));
+        assert!(left.iter().all(|x| x.abs() < 1e-12));
+    }
+
+    #[test]
+    fn halfpipe_function_sparse() {
+        let func = adv_fn_obj!(halfpipe);
+
+        for x1 in (0..10).map(|i| (i as f64) * 0.5) {
+            for x2 in (0..10).map(|i| (i as f64) * 0.5) {
+                let x = DVector::from_vec(vec![x1, x2]);
+                let anf_ref = halfpipe_anf(x.clone());
+                let anf = sparse_abs_normal(&func, &x);
+                assert_eq!(anf.to_dense(), anf_ref);
+
+                let dx = adv_dvec![0.5, -1.0];
+                let dz0 = anf_ref.a[0] + anf_ref.zmat[(0, 0)] * dx[0];
+                assert_eq!(anf.dz(&dx)[0], dz0);
+            }
+        }
+    }
+
     #[test]
     fn halfpipe_function() {
         let func = adv_fn_obj!(halfpipe);
@@ -390,6 +731,45 @@ mod tests {
         }
     }
 
+    #[test]
+    fn abs_normal_retape() {
+        let func = adv_fn_obj!(halfpipe);
+        let mut abs_tape = AbsNormalTape::new(func.tape(&adv_dvec![1.0, 2.0]));
+        let mut anf = AbsNormalForm::from_tape(&abs_tape);
+        let mut sparse = SparseAbsNormalForm::from_tape(&abs_tape);
+        assert!(!abs_tape.is_piecewise_linear());
+        assert_eq!(abs_tape.signature(), adv_dvec![1.0, 1.0]);
+
+        // z = (x1, x2^2 - max(x1, 0))
+        for (x, changed) in &[
+            (adv_dvec![2.0, 3.0], vec![]),
+            (adv_dvec![-1.0, 3.0], vec![0]),
+            (adv_dvec![-1.0, 0.0], vec![1]),
+            (adv_dvec![1.0, 0.5], vec![0, 1]),
+        ] {
+            assert_eq!(&abs_tape.retape(x), changed);
+            anf.update(&abs_tape);
+            sparse.update(&abs_tape);
+            assert_eq!(anf, halfpipe_anf(x.clone()));
+            assert_eq!(sparse.to_dense(), anf);
+        }
+    }
+
+    #[test]
+    fn abs_normal_retape_piecewise_linear() {
+        let func = adv_fn_obj!(consistency_test_func);
+        let mut abs_tape = AbsNormalTape::new(func.tape(&adv_dvec![2.0, 3.0]));
+        let mut anf = AbsNormalForm::from_tape(&abs_tape);
+        assert!(abs_tape.is_piecewise_linear());
+
+        let x = adv_dvec![-1.0, 0.5];
+        assert_eq!(abs_tape.retape(&x), vec![0]);
+        assert_eq!(abs_tape.signature(), adv_dvec![-1.0]);
+        assert_eq!(abs_tape.y(), adv_dvec![1.5]);
+        anf.update(&abs_tape);
+        assert_eq!(anf, abs_normal(&func, &x));
+    }
+
     adv_fn! {
         fn consistency_test_func(input: [[2]]) -> [[1]] {
             let x1 = input[0];
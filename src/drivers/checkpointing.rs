@@ -2,10 +2,16 @@ use super::*;
 use num::bigint::BigUint;
 use num::integer::binomial;
 use num::ToPrimitive;
+use rayon::prelude::*;
 use std::collections::VecDeque;
 use std::f64::consts::PI;
 use std::fmt::Debug;
+use std::fs::File;
+use std::io::{self, BufReader, BufWriter, Read, Write};
 use std::iter::Iterator;
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Mutex;
 
 fn beta(c: isize, t: isize) -> usize {
     if c <= 0 || t <= 0 {
@@ -125,10 +131,12 @@ where
             let mut current_x = last_cp;
             if partial_r > 0 {
                 for cp_idx in schedule(partial_c, partial_r) {
+                    profile::count(Counter::CheckpointForwards, (cp_idx - current_i) as u64);
                     for _ in current_i..cp_idx {
                         current_x = forward(current_x);
                     }
                     current_i = cp_idx;
+                    profile::count(Counter::Checkpoints, 1);
                     checkpoints.push_back((last_cp_idx + current_i, current_x.clone()));
                 }
             }
@@ -138,6 +146,7 @@ where
         {
             let (cp_idx, cp) = checkpoints.pop_back().unwrap();
             assert_eq!(cp_idx, r - 1);
+            profile::count(Counter::CheckpointReverses, 1);
             result = match result {
                 Some(right) => Some(reverse(cp, right)),
                 None => Some(identity(cp)),
@@ -149,6 +158,379 @@ where
     result.unwrap()
 }
 
+/// Segment length and number of concurrent re-forwards for a pipelined reversal
+///
+/// Keeping one checkpoint per segment and `nforwards + 1` materialized segments has to fit into
+/// `ncheckpoints` states. Fewer re-forwards are used if the budget does not allow `nforwards`.
+fn pipeline_layout(r: usize, ncheckpoints: usize, nforwards: usize) -> Option<(usize, usize)> {
+    (0..=nforwards).rev().find_map(|nforwards| {
+        let live = nforwards + 1;
+        let len = ((r as f64 / live as f64).sqrt().round() as usize).max(1);
+        (len.saturating_sub(1)..=len + 1)
+            .filter(|len| *len > 0)
+            .find(|len| (r + len - 1) / len + live * len <= ncheckpoints)
+            .map(|len| (len, nforwards))
+    })
+}
+
+/// Generate a sequence and walk it in reverse using limited memory and multiple threads
+///
+/// The sequence is split into segments whose first elements are kept as checkpoints. While a
+/// segment is reversed, up to `nforwards` preceding segments are recomputed from their
+/// checkpoints in parallel. Falls back to `reverse_sequence` if `ncheckpoints` is too small for
+/// even a single re-forward.
+#[allow(clippy::too_many_arguments)]
+pub fn reverse_sequence_parallel<T, FW, RV, R, ID>(
+    x: T,
+    nsteps: usize,
+    ncheckpoints: usize,
+    nforwards: usize,
+    forward: FW,
+    reverse: RV,
+    identity: ID,
+) -> R
+where
+    T: Clone + Debug + Send + Sync,
+    R: Debug + Send,
+    FW: Fn(T) -> T + Sync,
+    RV: Fn(T, R) -> R + Sync,
+    ID: Fn(T) -> R + Sync,
+{
+    assert!(ncheckpoints >= 2);
+
+    // Number of elements in the sequence
+    let r = nsteps + 1;
+    let (len, nforwards) = match pipeline_layout(r, ncheckpoints, nforwards) {
+        Some(layout) => layout,
+        None => return reverse_sequence(x, nsteps, ncheckpoints, forward, reverse, identity),
+    };
+    let nsegments = (r + len - 1) / len;
+    let segment_len = |k: usize| len.min(r - k * len);
+
+    // Record the first element of every segment and keep the last segment
+    let mut checkpoints = Vec::with_capacity(nsegments);
+    let mut last = Vec::with_capacity(len);
+    let mut current = x;
+    for idx in 0..r {
+        if idx % len == 0 {
+            profile::count(Counter::Checkpoints, 1);
+            checkpoints.push(current.clone());
+        }
+        if idx / len == nsegments - 1 {
+            last.push(current.clone());
+        }
+        if idx + 1 < r {
+            profile::count(Counter::CheckpointForwards, 1);
+            current = forward(current);
+        }
+    }
+    std::mem::drop(current);
+
+    let materialize = |k: usize| {
+        let mut states = Vec::with_capacity(segment_len(k));
+        let mut current = checkpoints[k].clone();
+        profile::count(Counter::CheckpointForwards, segment_len(k) as u64 - 1);
+        for _ in 1..segment_len(k) {
+            let next = forward(current.clone());
+            states.push(current);
+            current = next;
+        }
+        states.push(current);
+        states
+    };
+
+    // Segments ready for reversal, ordered from the back of the sequence
+    let mut ready = VecDeque::with_capacity(nforwards + 1);
+    ready.push_back(last);
+    let mut next_segment = nsegments - 1;
+    let mut result: Option<R> = None;
+    while let Some(states) = ready.pop_front() {
+        // Segments that are recomputed while this one is reversed
+        let first = next_segment.saturating_sub(nforwards - ready.len());
+        let pending = (first..next_segment).rev().collect::<Vec<_>>();
+        next_segment = first;
+
+        let (reversed, recomputed) = rayon::join(
+            || {
+                let mut result = result;
+                profile::count(Counter::CheckpointReverses, states.len() as u64);
+                for state in states.into_iter().rev() {
+                    result = match result {
+                        Some(right) => Some(reverse(state, right)),
+                        None => Some(identity(state)),
+                    };
+                }
+                result
+            },
+            || pending.into_par_iter().map(materialize).collect::<Vec<_>>(),
+        );
+        result = reversed;
+        ready.extend(recomputed);
+        if ready.is_empty() && next_segment > 0 {
+            // No re-forwards are allowed ahead of time
+            next_segment -= 1;
+            ready.push_back(materialize(next_segment));
+        }
+    }
+
+    result.unwrap()
+}
+
+/// Number of forward steps the binomial schedule needs to reverse `r` elements with `c`
+/// checkpoints
+fn binomial_cost(c: usize, r: usize) -> usize {
+    if r <= 1 || c == 0 {
+        0
+    } else {
+        let t = find_t(c, r);
+        t * r - beta(c as isize + 1, t as isize - 1)
+    }
+}
+
+/// Positions of the slow-tier checkpoints of a two-level schedule
+///
+/// Every slow checkpoint starts an interval that is reversed with `cfast` fast checkpoints.
+/// The number of slow checkpoints, at most `cslow`, minimizes the total of `binomial_cost` and
+/// `cost_slow` forward-step equivalents per slow checkpoint written and read back.
+fn two_level_schedule(cslow: usize, cfast: usize, r: usize, cost_slow: f64) -> Vec<usize> {
+    let cost = |d: usize| {
+        let len = (r + d - 1) / d;
+        (d * binomial_cost(cfast, len)) as f64 + (d - 1) as f64 * cost_slow
+    };
+    let d = (1..=cslow.max(1).min(r.max(1)))
+        .min_by(|a, b| cost(*a).partial_cmp(&cost(*b)).unwrap())
+        .unwrap();
+    let len = (r + d - 1) / d;
+    (0..d)
+        .map(|i| i * len)
+        .filter(|idx| *idx < r.max(1))
+        .collect()
+}
+
+/// State that can be written to and read from a slow checkpoint tier
+pub trait Checkpoint: Sized {
+    fn save(&self, writer: &mut dyn Write) -> io::Result<()>;
+    fn load(reader: &mut dyn Read) -> io::Result<Self>;
+}
+
+impl Checkpoint for f64 {
+    fn save(&self, writer: &mut dyn Write) -> io::Result<()> {
+        writer.write_all(&self.to_le_bytes())
+    }
+
+    fn load(reader: &mut dyn Read) -> io::Result<Self> {
+        let mut bytes = [0; 8];
+        reader.read_exact(&mut bytes)?;
+        Ok(f64::from_le_bytes(bytes))
+    }
+}
+
+impl Checkpoint for usize {
+    fn save(&self, writer: &mut dyn Write) -> io::Result<()> {
+        writer.write_all(&(*self as u64).to_le_bytes())
+    }
+
+    fn load(reader: &mut dyn Read) -> io::Result<Self> {
+        let mut bytes = [0; 8];
+        reader.read_exact(&mut bytes)?;
+        Ok(u64::from_le_bytes(bytes) as usize)
+    }
+}
+
+impl<T: Checkpoint> Checkpoint for Vec<T> {
+    fn save(&self, writer: &mut dyn Write) -> io::Result<()> {
+        self.len().save(writer)?;
+        for x in self.iter() {
+            x.save(writer)?;
+        }
+        Ok(())
+    }
+
+    fn load(reader: &mut dyn Read) -> io::Result<Self> {
+        let len = usize::load(reader)?;
+        (0..len).map(|_| T::load(reader)).collect()
+    }
+}
+
+impl Checkpoint for DMatrix<f64> {
+    fn save(&self, writer: &mut dyn Write) -> io::Result<()> {
+        self.nrows().save(writer)?;
+        self.ncols().save(writer)?;
+        for x in self.iter() {
+            x.save(writer)?;
+        }
+        Ok(())
+    }
+
+    fn load(reader: &mut dyn Read) -> io::Result<Self> {
+        let nrows = usize::load(reader)?;
+        let ncols = usize::load(reader)?;
+        let data = (0..nrows * ncols)
+            .map(|_| f64::load(reader))
+            .collect::<io::Result<Vec<_>>>()?;
+        Ok(DMatrix::from_vec(nrows, ncols, data))
+    }
+}
+
+impl Checkpoint for DVector<f64> {
+    fn save(&self, writer: &mut dyn Write) -> io::Result<()> {
+        self.as_slice().to_vec().save(writer)
+    }
+
+    fn load(reader: &mut dyn Read) -> io::Result<Self> {
+        Ok(DVector::from_vec(Vec::load(reader)?))
+    }
+}
+
+impl<A: Checkpoint, B: Checkpoint> Checkpoint for (A, B) {
+    fn save(&self, writer: &mut dyn Write) -> io::Result<()> {
+        self.0.save(writer)?;
+        self.1.save(writer)
+    }
+
+    fn load(reader: &mut dyn Read) -> io::Result<Self> {
+        Ok((A::load(reader)?, B::load(reader)?))
+    }
+}
+
+impl<A: Checkpoint, B: Checkpoint, C: Checkpoint> Checkpoint for (A, B, C) {
+    fn save(&self, writer: &mut dyn Write) -> io::Result<()> {
+        self.0.save(writer)?;
+        self.1.save(writer)?;
+        self.2.save(writer)
+    }
+
+    fn load(reader: &mut dyn Read) -> io::Result<Self> {
+        Ok((A::load(reader)?, B::load(reader)?, C::load(reader)?))
+    }
+}
+
+/// Slow checkpoint tier storing one file per checkpoint in a directory
+#[derive(Debug, Clone)]
+pub struct DiskCheckpoints {
+    /// Directory the checkpoint files are created in
+    pub dir: PathBuf,
+    /// Maximum number of checkpoints on disk
+    pub ncheckpoints: usize,
+    /// Cost of writing and reading one checkpoint in units of forward steps
+    pub cost: f64,
+}
+
+impl DiskCheckpoints {
+    pub fn new(dir: PathBuf, ncheckpoints: usize, cost: f64) -> Self {
+        Self {
+            dir,
+            ncheckpoints,
+            cost,
+        }
+    }
+}
+
+/// Checkpoint file that is removed when dropped
+struct DiskCheckpoint {
+    path: PathBuf,
+}
+
+impl DiskCheckpoint {
+    fn store<T: Checkpoint>(dir: &Path, x: &T) -> io::Result<Self> {
+        static NEXT_ID: AtomicUsize = AtomicUsize::new(0);
+        let id = NEXT_ID.fetch_add(1, Ordering::Relaxed);
+        // Created before the file so a partially written file is removed as well
+        let checkpoint = Self {
+            path: dir.join(format!("adv-checkpoint-{}-{}", std::process::id(), id)),
+        };
+        let mut writer = BufWriter::new(File::create(&checkpoint.path)?);
+        x.save(&mut writer)?;
+        writer.flush()?;
+        Ok(checkpoint)
+    }
+
+    fn load<T: Checkpoint>(&self) -> io::Result<T> {
+        let mut reader = BufReader::new(File::open(&self.path)?);
+        T::load(&mut reader)
+    }
+}
+
+impl Drop for DiskCheckpoint {
+    fn drop(&mut self) {
+        let _ = std::fs::remove_file(&self.path);
+    }
+}
+
+/// Generate a sequence and walk it in reverse using memory and disk checkpoints
+///
+/// The sequence is split into intervals starting at disk checkpoints, each of which is reversed
+/// with `ncheckpoints` checkpoints in memory. The start of the preceding interval is read from
+/// disk while an interval is reversed. Fails if a checkpoint cannot be written to or read from
+/// `disk.dir`.
+pub fn reverse_sequence_two_level<T, FW, RV, R, ID>(
+    x: T,
+    nsteps: usize,
+    ncheckpoints: usize,
+    disk: &DiskCheckpoints,
+    forward: FW,
+    reverse: RV,
+    identity: ID,
+) -> io::Result<R>
+where
+    T: Clone + Debug + Send + Checkpoint,
+    R: Debug + Send,
+    FW: Fn(T) -> T + Sync,
+    RV: Fn(T, R) -> R + Sync,
+    ID: Fn(T) -> R + Sync,
+{
+    assert!(ncheckpoints >= 2);
+
+    // Number of elements in the sequence
+    let r = nsteps + 1;
+    let starts = two_level_schedule(disk.ncheckpoints, ncheckpoints, r, disk.cost);
+
+    // Write the start of every interval but the last one to disk
+    let mut stored = Vec::with_capacity(starts.len());
+    let mut current = x;
+    for (i, start) in starts.iter().enumerate() {
+        if i + 1 == starts.len() {
+            break;
+        }
+        stored.push(DiskCheckpoint::store(&disk.dir, &current)?);
+        profile::count(Counter::Checkpoints, 1);
+        profile::count(Counter::CheckpointForwards, (starts[i + 1] - start) as u64);
+        for _ in *start..starts[i + 1] {
+            current = forward(current);
+        }
+    }
+
+    let mut result: Option<R> = None;
+    for i in (0..starts.len()).rev() {
+        let end = starts.get(i + 1).cloned().unwrap_or(r);
+        let right = Mutex::new(result.take());
+        let (reversed, previous) = rayon::join(
+            || {
+                // The last element of the interval continues the already reversed part
+                reverse_sequence(
+                    current,
+                    end - starts[i] - 1,
+                    ncheckpoints,
+                    &forward,
+                    &reverse,
+                    |x| match right.lock().unwrap().take() {
+                        Some(right) => reverse(x, right),
+                        None => identity(x),
+                    },
+                )
+            },
+            || stored.pop().map(|checkpoint| checkpoint.load::<T>()),
+        );
+        result = Some(reversed);
+        match previous {
+            Some(previous) => current = previous?,
+            None => break,
+        }
+    }
+
+    Ok(result.unwrap())
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
@@ -203,4 +585,102 @@ mod tests {
         let result = reverse_sequence(0, r, 9, |x| x + 1, |x, y| x + y, |x| x);
         assert_eq!(result, reference);
     }
+
+    #[test]
+    fn sequence_reverse_parallel_gauss_sum() {
+        for (r, ncheckpoints, nforwards) in &[(37, 9, 1), (37, 20, 3), (100, 30, 4), (5, 2, 1)] {
+            let reference = r * (r + 1) / 2;
+            let result = reverse_sequence_parallel(
+                0,
+                *r,
+                *ncheckpoints,
+                *nforwards,
+                |x| x + 1,
+                |x, y| x + y,
+                |x| x,
+            );
+            assert_eq!(result, reference);
+        }
+    }
+
+    #[test]
+    fn sequence_reverse_parallel_order() {
+        // The reverse steps have to be applied from the end of the sequence to its beginning
+        let result = reverse_sequence_parallel(
+            0,
+            20,
+            12,
+            2,
+            |x| x + 1,
+            |x, mut y: Vec<usize>| {
+                y.push(x);
+                y
+            },
+            |x| vec![x],
+        );
+        assert_eq!(result, (0..=20).rev().collect::<Vec<_>>());
+    }
+
+    #[test]
+    fn pipeline_layout_budget() {
+        assert_eq!(pipeline_layout(100, 2, 1), None);
+        for (r, ncheckpoints, nforwards) in &[(100, 40, 4), (1000, 100, 8), (10, 100, 3)] {
+            let (len, nforwards_) = pipeline_layout(*r, *ncheckpoints, *nforwards).unwrap();
+            assert!(nforwards_ <= *nforwards);
+            assert!((r + len - 1) / len + (nforwards_ + 1) * len <= *ncheckpoints);
+        }
+    }
+
+    #[test]
+    fn two_level_schedule_costs() {
+        // Expensive disk access avoids the slow tier
+        assert_eq!(two_level_schedule(10, 3, 100, 1e9), vec![0]);
+        // Cheap disk access uses it
+        let starts = two_level_schedule(10, 3, 100, 1.0);
+        assert!(starts.len() > 1 && starts.len() <= 10);
+        assert!(starts.windows(2).all(|w| w[0] < w[1] && w[1] < 100));
+    }
+
+    #[test]
+    fn sequence_reverse_two_level() {
+        let disk = DiskCheckpoints::new(std::env::temp_dir(), 5, 0.5);
+        let result = reverse_sequence_two_level(
+            (0, 0.0),
+            40,
+            3,
+            &disk,
+            |(i, x): (usize, f64)| (i + 1, x + 0.5),
+            |(i, x), mut y: Vec<(usize, f64)>| {
+                y.push((i, x));
+                y
+            },
+            |x| vec![x],
+        )
+        .unwrap();
+        let reference = (0..=40)
+            .rev()
+            .map(|i| (i, i as f64 * 0.5))
+            .collect::<Vec<_>>();
+        assert_eq!(result, reference);
+
+        let x: (usize, DVector<f64>) = (3, adv_dvec![1.0, 2.5]);
+        let checkpoint = DiskCheckpoint::store(&disk.dir, &x).unwrap();
+        assert_eq!(checkpoint.load::<(usize, DVector<f64>)>().unwrap(), x);
+    }
+
+    #[test]
+    fn sequence_reverse_two_level_missing_dir() {
+        let dir = std::env::temp_dir().join("adv-checkpoint-missing-dir");
+        let disk = DiskCheckpoints::new(dir, 5, 0.5);
+        let result = reverse_sequence_two_level(
+            0.0,
+            40,
+            3,
+            &disk,
+            |x: f64| x + 0.5,
+            |x, y: f64| x + y,
+            |x| x,
+        );
+        assert!(result.is_err());
+    }
 }
@@ -1,4 +1,5 @@
 use super::*;
+use rayon::prelude::*;
 use std::iter::Iterator;
 
 #[derive(Debug, Clone, PartialEq)]
@@ -8,6 +9,21 @@ pub struct GeneralizedJacobian {
     pub multiplicity: usize,
 }
 
+/// Method used to solve the triangular systems of the Abs-Normal Form
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum AbsNormalSolver {
+    /// Forward and back substitution through the tape
+    Substitution,
+    /// Fixed-point iteration with up to `s` full products with `L`
+    FixedPoint,
+}
+
+impl Default for AbsNormalSolver {
+    fn default() -> Self {
+        AbsNormalSolver::Substitution
+    }
+}
+
 fn bit_iter<'a>(bytes: &'a [u8]) -> impl Iterator<Item = bool> + 'a {
     let mut idx = 0;
     std::iter::from_fn(move || {
@@ -23,6 +39,41 @@ fn bit_iter<'a>(bytes: &'a [u8]) -> impl Iterator<Item = bool> + 'a {
     })
 }
 
+/// Signature vector σ of `dz` and the number of zero entries whose sign is taken from `sign_bits`
+fn signature(dz: &DVector<f64>, sign_bits: &[u8]) -> (DVector<f64>, usize) {
+    let mut sigma = DVector::zeros(dz.nrows());
+    let mut multiplicity = 0_usize;
+    let mut signs = bit_iter(sign_bits);
+    for i in 0..dz.nrows() {
+        if dz[i] < 0.0 {
+            sigma[i] = -1.0;
+        } else if dz[i] > 0.0 {
+            sigma[i] = 1.0;
+        } else {
+            multiplicity += 1;
+            sigma[i] = if signs.next().unwrap() { 1.0 } else { -1.0 };
+        }
+    }
+    (sigma, multiplicity)
+}
+
+/// Homogenous part, inhomogenous part and total multiplicity of the succeeding function
+fn outer_jacobian(
+    next: Option<GeneralizedJacobian>,
+    m: usize,
+    multiplicity: usize,
+) -> (DMatrix<f64>, DVector<f64>, usize) {
+    if let Some(next) = next {
+        (
+            next.homogenous,
+            next.inhomogenous,
+            multiplicity + next.multiplicity,
+        )
+    } else {
+        (DMatrix::identity(m, m), DVector::zeros(m), multiplicity)
+    }
+}
+
 /// Derive the Generalized Jacobian of a function
 pub fn generalized_jacobian(
     func: &dyn Function,
@@ -37,19 +88,29 @@ pub fn generalized_jacobian(
 }
 
 /// Derive the Generalized Jacobian of a tape
-#[allow(clippy::many_single_char_names)]
 pub fn generalized_jacobian_tape(
     tape: Box<dyn Tape>,
     dx: &DVector<f64>,
     sign_bits: &[u8],
     next: Option<GeneralizedJacobian>,
 ) -> GeneralizedJacobian {
-    let n = tape.num_indeps();
-    let m = tape.num_deps();
-    let s = tape.num_abs();
-    assert_eq!(dx.nrows(), n);
+    generalized_jacobian_tape_with(tape, dx, sign_bits, next, AbsNormalSolver::default())
+}
 
+/// Derive the Generalized Jacobian of a tape using the given solver
+#[allow(clippy::many_single_char_names)]
+pub fn generalized_jacobian_tape_with(
+    tape: Box<dyn Tape>,
+    dx: &DVector<f64>,
+    sign_bits: &[u8],
+    next: Option<GeneralizedJacobian>,
+    solver: AbsNormalSolver,
+) -> GeneralizedJacobian {
     let abs_tape = AbsNormalTape::new(tape);
+    let n = abs_tape.n();
+    let m = abs_tape.m();
+    let s = abs_tape.s();
+    assert_eq!(dx.nrows(), n);
 
     // Create subtapes
     let z_tape = AbsNormalZ::new(&abs_tape);
@@ -64,79 +125,97 @@ pub fn generalized_jacobian_tape(
     let b = -y_tape.mul_right(&z_abs);
 
     // Calculate Δz
-    let dzt = &a + z_tape.mul_right(&dx);
-    let mut dz = dzt.clone();
-    for _ in 0..s {
-        let dz_ = dz.clone();
-        dz = &dzt + l_tape.mul_right(&dz.abs());
-        if dz == dz_ {
-            break;
+    let dz = match solver {
+        AbsNormalSolver::Substitution => abs_tape.forward_substitution(&a, dx),
+        AbsNormalSolver::FixedPoint => {
+            let dzt = &a + z_tape.mul_right(&dx);
+            let mut dz = dzt.clone();
+            for _ in 0..s {
+                let dz_ = dz.clone();
+                dz = &dzt + l_tape.mul_right(&dz.abs());
+                if dz == dz_ {
+                    break;
+                }
+            }
+            dz
         }
-    }
+    };
 
     // Calculate σ and multiplicity
-    let mut sigma = DVector::zeros(s);
-    let mut multiplicity = 0_usize;
-    let mut signs = bit_iter(sign_bits);
-    for i in 0..s {
-        if dz[i] < 0.0 {
-            sigma[i] = -1.0;
-        } else if dz[i] > 0.0 {
-            sigma[i] = 1.0;
-        } else {
-            multiplicity += 1;
-            sigma[i] = if signs.next().unwrap() { 1.0 } else { -1.0 };
-        }
-    }
+    let (sigma, multiplicity) = signature(&dz, sign_bits);
+    let (g2, gamma2, multiplicity) = outer_jacobian(next, m, multiplicity);
 
-    let (g2, gamma2, multiplicity) = if let Some(next) = next {
-        (
-            next.homogenous,
-            next.inhomogenous,
-            multiplicity + next.multiplicity,
-        )
-    } else {
-        (DMatrix::identity(m, m), DVector::zeros(m), multiplicity)
-    };
-
-    // Calcuta YΣA
-    let g2ysamat = {
-        // YΣ
-        let mut g2_ymat_sigma = y_tape.mul_left(&g2);
-        for i in 0..g2.nrows() {
-            for j in 0..s {
-                g2_ymat_sigma[(i, j)] *= sigma[j];
+    // Calculate G2YΣA and the homogenous part
+    let (homogenous, g2ysamat) = match solver {
+        AbsNormalSolver::Substitution => {
+            // One adjoint sweep per row of G2 yields the rows of both
+            let rows = (0..g2.nrows())
+                .into_par_iter()
+                .map(|r| {
+                    let w = (0..m).map(|j| g2[(r, j)]).collect::<Vec<_>>();
+                    let mut u = vec![0.0; s];
+                    let mut xbar = vec![0.0; n];
+                    Workspace::with_local(|ws| {
+                        abs_tape.reverse_substitution(&sigma, &w, &mut u, &mut xbar, ws)
+                    });
+                    (u, xbar)
+                })
+                .collect::<Vec<_>>();
+            let mut homogenous = DMatrix::zeros(g2.nrows(), n);
+            let mut g2ysamat = DMatrix::zeros(g2.nrows(), s);
+            for (r, (u, xbar)) in rows.into_iter().enumerate() {
+                for (j, u) in u.into_iter().enumerate() {
+                    g2ysamat[(r, j)] = u;
+                }
+                for (j, xbar) in xbar.into_iter().enumerate() {
+                    homogenous[(r, j)] = xbar;
+                }
             }
+            (homogenous, g2ysamat)
         }
-        let g2_ymat_sigma = g2_ymat_sigma;
-        // Initially u1 = YΣ
-        let mut u1 = g2_ymat_sigma.clone();
-        // Copy of u1 for comparison
-        let mut u2 = u1.clone();
-        // Main iteration
-        for _ in 0..s {
-            // u1 = u1*L = u2*L
-            u1 = l_tape.mul_left(&u1);
-            // u1 = u1*Σ = u2*LΣ
-            for i in 0..g2.nrows() {
-                for j in 0..s {
-                    u1[(i, j)] *= sigma[j];
+        AbsNormalSolver::FixedPoint => {
+            // Calcuta YΣA
+            let g2ysamat = {
+                // YΣ
+                let mut g2_ymat_sigma = y_tape.mul_left(&g2);
+                for i in 0..g2.nrows() {
+                    for j in 0..s {
+                        g2_ymat_sigma[(i, j)] *= sigma[j];
+                    }
                 }
-            }
-            // u1 = u1+YΣ = u2*LΣ + YΣ
-            u1 += &g2_ymat_sigma;
-            // No change -> terminate iteration early
-            if u1 == u2 {
-                break;
-            }
-            // Set u2 = u1 for next comparison
-            u2 = u1.clone();
+                let g2_ymat_sigma = g2_ymat_sigma;
+                // Initially u1 = YΣ
+                let mut u1 = g2_ymat_sigma.clone();
+                // Copy of u1 for comparison
+                let mut u2 = u1.clone();
+                // Main iteration
+                for _ in 0..s {
+                    // u1 = u1*L = u2*L
+                    u1 = l_tape.mul_left(&u1);
+                    // u1 = u1*Σ = u2*LΣ
+                    for i in 0..g2.nrows() {
+                        for j in 0..s {
+                            u1[(i, j)] *= sigma[j];
+                        }
+                    }
+                    // u1 = u1+YΣ = u2*LΣ + YΣ
+                    u1 += &g2_ymat_sigma;
+                    // No change -> terminate iteration early
+                    if u1 == u2 {
+                        break;
+                    }
+                    // Set u2 = u1 for next comparison
+                    u2 = u1.clone();
+                }
+                // This is our result
+                u1
+            };
+
+            let homogenous = j_tape.mul_left(&g2) + z_tape.mul_left(&g2ysamat);
+            (homogenous, g2ysamat)
         }
-        // This is our result
-        u1
     };
 
-    let homogenous = j_tape.mul_left(&g2) + z_tape.mul_left(&g2ysamat);
     let inhomogenous = gamma2 + &g2 * b + g2ysamat * a;
     GeneralizedJacobian {
         homogenous,
@@ -145,18 +224,76 @@ pub fn generalized_jacobian_tape(
     }
 }
 
+/// Derive the Generalized Jacobian from a sparse Abs-Normal Form
+///
+/// Uses substitution with the strictly lower triangular `L` instead of fixed-point iterations.
+#[allow(clippy::many_single_char_names)]
+pub fn generalized_jacobian_anf(
+    anf: &SparseAbsNormalForm,
+    dx: &DVector<f64>,
+    sign_bits: &[u8],
+    next: Option<GeneralizedJacobian>,
+) -> GeneralizedJacobian {
+    let m = anf.m();
+    let s = anf.s();
+    assert_eq!(dx.nrows(), anf.n());
+
+    // Calculate Δz, σ and multiplicity
+    let dz = anf.dz(dx);
+    let (sigma, multiplicity) = signature(&dz, sign_bits);
+    let (g2, gamma2, multiplicity) = outer_jacobian(next, m, multiplicity);
+
+    // Solve U = G2YΣ + ULΣ column by column from the back
+    let mut u = anf.ymat.mul_left(&g2);
+    let lmat_t = anf.lmat.transpose();
+    for j in (0..s).rev() {
+        let (rows, vals) = lmat_t.row(j);
+        for r in 0..g2.nrows() {
+            let ul = rows
+                .iter()
+                .zip(vals.iter())
+                .map(|(i, val)| u[(r, *i)] * val)
+                .sum::<f64>();
+            u[(r, j)] = (u[(r, j)] + ul) * sigma[j];
+        }
+    }
+
+    let homogenous = anf.jmat.mul_left(&g2) + anf.zmat.mul_left(&u);
+    let inhomogenous = gamma2 + &g2 * &anf.b + u * &anf.a;
+    GeneralizedJacobian {
+        homogenous,
+        inhomogenous,
+        multiplicity,
+    }
+}
+
 /// Derive the Generalized Jacobian of a chain of functions
+///
+/// The preceding nodes are re-evaluated from checkpoints while a node is differentiated.
 pub fn generalized_jacobian_chain(
     chain: &FunctionChain,
     x: DVector<f64>,
     dx: DVector<f64>,
     ncheckpoints: Option<usize>,
+) -> GeneralizedJacobian {
+    generalized_jacobian_chain_parallel(chain, x, dx, ncheckpoints, 1)
+}
+
+/// Derive the Generalized Jacobian of a chain of functions with up to `nforwards` concurrent
+/// re-evaluations from checkpoints
+pub fn generalized_jacobian_chain_parallel(
+    chain: &FunctionChain,
+    x: DVector<f64>,
+    dx: DVector<f64>,
+    ncheckpoints: Option<usize>,
+    nforwards: usize,
 ) -> GeneralizedJacobian {
     let ncheckpoints = ncheckpoints.unwrap_or_else(|| chain.len());
-    reverse_sequence(
+    reverse_sequence_parallel(
         (0, x, dx),
         chain.len(),
         ncheckpoints,
+        nforwards,
         |(idx, x, dx)| {
             let input = DVector::from_vec(
                 x.as_slice()
@@ -185,6 +322,48 @@ pub fn generalized_jacobian_chain(
     )
 }
 
+/// Derive the Generalized Jacobian of a chain of functions and keep node tapes in `cache`
+///
+/// Unlike `generalized_jacobian_chain_parallel`, which evaluates the nodes and keeps no tapes,
+/// every forward step records or replays the tape of its node. A node's tape taken from the
+/// cache when it is differentiated is not recorded again. With `TapeReuse::Structure` the tapes
+/// stay in the cache and are replayed in later calls.
+pub fn generalized_jacobian_chain_cached(
+    chain: &FunctionChain,
+    x: DVector<f64>,
+    dx: DVector<f64>,
+    ncheckpoints: Option<usize>,
+    nforwards: usize,
+    cache: &TapeCache,
+) -> GeneralizedJacobian {
+    let ncheckpoints = ncheckpoints.unwrap_or_else(|| chain.len());
+    reverse_sequence_parallel(
+        (0, x, dx),
+        chain.len(),
+        ncheckpoints,
+        nforwards,
+        |(idx, x, dx)| {
+            let tape = cache.take(idx, chain.nth(idx), &x);
+            let y = tape.y();
+            let dy = tape.first_order_forward(&dx);
+            cache.insert(idx, tape);
+            (idx + 1, y, dy)
+        },
+        |(idx, x, dx), g2: GeneralizedJacobian| {
+            let tape = cache.take(idx, chain.nth(idx), &x);
+            if cache.reuse() == TapeReuse::Structure {
+                cache.insert(idx, tape.clone());
+            }
+            generalized_jacobian_tape(Box::new(tape), &dx, &[0], Some(g2))
+        },
+        |(_idx, x, _dx)| GeneralizedJacobian {
+            homogenous: DMatrix::identity(x.nrows(), x.nrows()),
+            inhomogenous: DVector::zeros(x.nrows()),
+            multiplicity: 0,
+        },
+    )
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
@@ -232,6 +411,87 @@ mod tests {
         }
     }
 
+    #[test]
+    fn halfpipe_function_fixed_point() {
+        let func = adv_fn_obj!(halfpipe);
+
+        for x1 in (0..10).map(|i| (i as f64) * 0.5) {
+            for x2 in (0..10).map(|i| (i as f64) * 0.5) {
+                for dx1 in (0..2).map(|i| (i as f64) * 0.5) {
+                    for dx2 in (0..2).map(|i| (i as f64) * 0.5) {
+                        let x = DVector::from_vec(vec![x1, x2]);
+                        let dx = DVector::from_vec(vec![dx1, dx2]);
+                        let jac_ref = halfpipe_jacobian(&x, &dx);
+                        let jac = generalized_jacobian_tape_with(
+                            func.tape(&x),
+                            &dx,
+                            &[0],
+                            None,
+                            AbsNormalSolver::FixedPoint,
+                        );
+                        assert_eq!(jac, jac_ref);
+                    }
+                }
+            }
+        }
+    }
+
+    adv_fn! {
+        fn nested_abs_func([[x1, x2, x3]]) -> [[2]] {
+            let v1 = (x1 - x2).abs() * 2.0 - x3;
+            let v2 = (v1.abs() + x2 * x3).abs() - (x1 + v1).abs();
+            let v3 = (v2 - v1.abs() * 0.5).abs() + x1 * x2;
+            adv_dvec![v3 - v2.abs(), (v1 * v3).abs() + x3.sin()]
+        }
+    }
+
+    #[test]
+    fn substitution_matches_fixed_point() {
+        let func = adv_fn_obj!(nested_abs_func);
+        let next = GeneralizedJacobian {
+            homogenous: DMatrix::from_vec(2, 2, vec![1.0, -0.5, 2.0, 0.25]),
+            inhomogenous: DVector::from_vec(vec![0.5, 1.0]),
+            multiplicity: 1,
+        };
+        for (x, dx) in &[
+            (adv_dvec![0.5, -1.0, 2.0], adv_dvec![0.1, 0.2, -0.3]),
+            (adv_dvec![-1.5, 0.3, 0.7], adv_dvec![1.0, -2.0, 0.5]),
+            (adv_dvec![1.0, 1.0, 2.0], adv_dvec![0.0, 0.0, 0.0]),
+        ] {
+            let jac = |solver| {
+                let tape = func.tape(x);
+                generalized_jacobian_tape_with(tape, dx, &[0b101], Some(next.clone()), solver)
+            };
+            let substitution = jac(AbsNormalSolver::Substitution);
+            let fixed_point = jac(AbsNormalSolver::FixedPoint);
+            assert_eq!(substitution.multiplicity, fixed_point.multiplicity);
+            let diff = &substitution.homogenous - &fixed_point.homogenous;
+            assert!(diff.iter().all(|d| d.abs() < 1e-12));
+            let diff = &substitution.inhomogenous - &fixed_point.inhomogenous;
+            assert!(diff.iter().all(|d| d.abs() < 1e-12));
+        }
+    }
+
+    #[test]
+    fn halfpipe_function_anf() {
+        let func = adv_fn_obj!(halfpipe);
+
+        for x1 in (0..10).map(|i| (i as f64) * 0.5) {
+            for x2 in (0..10).map(|i| (i as f64) * 0.5) {
+                let x = DVector::from_vec(vec![x1, x2]);
+                let anf = sparse_abs_normal(&func, &x);
+                for dx1 in (0..2).map(|i| (i as f64) * 0.5) {
+                    for dx2 in (0..2).map(|i| (i as f64) * 0.5) {
+                        let dx = DVector::from_vec(vec![dx1, dx2]);
+                        let jac_ref = halfpipe_jacobian(&x, &dx);
+                        let jac = generalized_jacobian_anf(&anf, &dx, &[0], None);
+                        assert_eq!(jac, jac_ref);
+                    }
+                }
+            }
+        }
+    }
+
     #[test]
     fn halfpipe_function_with_next() {
         let func = adv_fn_obj!(halfpipe);
@@ -256,6 +516,37 @@ mod tests {
         }
     }
 
+    #[test]
+    fn halfpipe_function_long_chain() {
+        let mut chain = FunctionChain::new(adv_fn_obj!(halfpipe_1));
+        for _ in 0..20 {
+            chain.append(adv_fn_obj!(halfpipe_1));
+        }
+        chain.append(adv_fn_obj!(halfpipe_2));
+
+        let x = DVector::from_vec(vec![1.5, -0.5]);
+        let dx = DVector::from_vec(vec![0.5, 1.0]);
+        let reference = generalized_jacobian_chain_parallel(&chain, x.clone(), dx.clone(), None, 0);
+        for (ncheckpoints, nforwards) in &[(Some(3), 1), (Some(12), 2), (None, 4)] {
+            let jac = generalized_jacobian_chain_parallel(
+                &chain,
+                x.clone(),
+                dx.clone(),
+                *ncheckpoints,
+                *nforwards,
+            );
+            assert_eq!(jac, reference);
+        }
+
+        // Tapes recorded at one point are replayed at another
+        let cache = TapeCache::new(usize::max_value(), TapeReuse::Structure);
+        let y = DVector::from_vec(vec![0.5, 2.0]);
+        generalized_jacobian_chain_cached(&chain, y, dx.clone(), Some(3), 1, &cache);
+        assert_eq!(cache.len(), chain.len());
+        let jac = generalized_jacobian_chain_cached(&chain, x, dx, Some(3), 1, &cache);
+        assert_eq!(jac, reference);
+    }
+
     #[test]
     fn halfpipe_function_chain() {
         let mut chain = FunctionChain::new(adv_fn_obj!(halfpipe_1));
@@ -0,0 +1,321 @@
+use super::*;
+use rayon::prelude::*;
+use std::collections::BTreeSet;
+
+/// Compute `(∑ ybar_j H_j) dx` for the Hessians `H_j` of the dependents by forward-over-reverse
+/// differentiation
+pub fn hessian_vector_product(
+    tape: &dyn Tape,
+    ybar: &DVector<f64>,
+    dx: &DVector<f64>,
+) -> DVector<f64> {
+    let n = tape.num_indeps();
+    let mut xbar = vec![0.0; n];
+    let mut dxbar = DVector::zeros(n);
+    Workspace::with_local(|ws| {
+        tape.second_order_reverse_into(
+            dx.as_slice(),
+            ybar.as_slice(),
+            &mut xbar,
+            dxbar.as_mut_slice(),
+            ws,
+        )
+    });
+    dxbar
+}
+
+/// Compute the dense Hessian `∑ ybar_j H_j` with one Hessian-vector product per independent
+pub fn hessian(tape: &dyn Tape, ybar: &DVector<f64>) -> DMatrix<f64> {
+    let n = tape.num_indeps();
+    let mut hessian = DMatrix::zeros(n, n);
+    if n > 0 {
+        hessian
+            .as_mut_slice()
+            .par_chunks_mut(n)
+            .enumerate()
+            .for_each(|(j, column)| {
+                let mut dx = DVector::zeros(n);
+                dx[j] = 1.0;
+                column.copy_from_slice(hessian_vector_product(tape, ybar, &dx).as_slice());
+            });
+    }
+    hessian
+}
+
+/// Merge two sorted index sets
+fn union(a: &[usize], b: &[usize]) -> Vec<usize> {
+    let mut result = Vec::with_capacity(a.len() + b.len());
+    let (mut i, mut j) = (0, 0);
+    while i < a.len() || j < b.len() {
+        if j == b.len() || (i < a.len() && a[i] < b[j]) {
+            result.push(a[i]);
+            i += 1;
+        } else if i == a.len() || b[j] < a[i] {
+            result.push(b[j]);
+            j += 1;
+        } else {
+            result.push(a[i]);
+            i += 1;
+            j += 1;
+        }
+    }
+    result
+}
+
+/// Determine the sparsity pattern of the Hessians of all dependents
+///
+/// The independents every value depends on are propagated forward. Each nonlinear operation
+/// that influences a dependent couples the independents of its arguments.
+pub fn hessian_pattern(tape: &dyn Tape) -> SparsityPattern {
+    let n = tape.num_indeps();
+    let len = tape.values().len();
+
+    // Operations whose result reaches a dependent
+    let mut live = vec![false; len];
+    for vid in tape.deps() {
+        live[*vid] = true;
+    }
+    let mut needed = tape
+        .ops_iter()
+        .rev()
+        .map(|op| {
+            let needed = op.opcode != OpCode::Nop && live[op.vid];
+            if op.opcode != OpCode::Nop {
+                live[op.vid] = false;
+            }
+            if needed {
+                for arg in op.arg1.iter().chain(op.arg2.iter()) {
+                    live[*arg] = true;
+                }
+            }
+            needed
+        })
+        .collect::<Vec<_>>();
+    needed.reverse();
+
+    let mut rows = vec![BTreeSet::new(); n];
+    let mut couple = |a: &[usize], b: &[usize]| {
+        for i in a {
+            for j in b {
+                rows[*i].insert(*j);
+                rows[*j].insert(*i);
+            }
+        }
+    };
+    let mut domains = vec![Vec::new(); len];
+    for (idx, vid) in tape.indeps().iter().enumerate() {
+        domains[*vid] = vec![idx];
+    }
+    for (op, needed) in tape.ops_iter().zip(needed.into_iter()) {
+        if op.opcode == OpCode::Nop {
+            continue;
+        }
+        let empty = Vec::new();
+        let a1 = op.arg1.map_or(&empty, |i| &domains[i]);
+        let a2 = op.arg2.map_or(&empty, |i| &domains[i]);
+        if needed {
+            match op.opcode {
+                OpCode::Nop | OpCode::Const | OpCode::Add | OpCode::Sub | OpCode::Abs => {}
+                OpCode::Mul => couple(a1, a2),
+                OpCode::Div => {
+                    couple(a1, a2);
+                    couple(a2, a2);
+                }
+                OpCode::Powf => {
+                    let a = union(a1, a2);
+                    couple(&a, &a);
+                }
+                _ => couple(a1, a1),
+            }
+        }
+        domains[op.vid] = union(a1, a2);
+    }
+
+    SparsityPattern::from_rows(
+        n,
+        rows.into_iter()
+            .map(|row| row.into_iter().collect())
+            .collect(),
+    )
+}
+
+/// Greedy star coloring of the symmetric `pattern`
+///
+/// Adjacent indices get different colors and every path on four indices uses at least three
+/// colors, so each entry of a Hessian can be read off a compressed product directly. Returns the
+/// number of colors and the color of each index.
+pub fn star_coloring(pattern: &SparsityPattern) -> (usize, Vec<usize>) {
+    let n = pattern.nrows();
+    let uncolored = usize::max_value();
+    let neighbors = |v: usize| pattern.row(v).iter().cloned().filter(move |w| *w != v);
+    let mut colors = vec![uncolored; n];
+    let mut forbidden = Vec::new();
+    let mut num_colors = 0;
+    for v in 0..n {
+        for w in neighbors(v) {
+            if colors[w] != uncolored {
+                forbidden[colors[w]] = v;
+            }
+            for x in neighbors(w).filter(|x| *x != v && colors[*x] != uncolored) {
+                // Avoid the two-colored paths v-w-x and v-w-x-y
+                if colors[w] == uncolored || neighbors(x).any(|y| y != w && colors[y] == colors[w])
+                {
+                    forbidden[colors[x]] = v;
+                }
+            }
+        }
+        let color = (0..num_colors)
+            .find(|color| forbidden[*color] != v)
+            .unwrap_or(num_colors);
+        if color == num_colors {
+            num_colors += 1;
+            forbidden.push(usize::max_value());
+        }
+        colors[v] = color;
+    }
+    (num_colors, colors)
+}
+
+/// Compute the Hessian `∑ ybar_j H_j` with the given symmetric pattern
+///
+/// Indices of the same star color are seeded together, so one Hessian-vector product is needed
+/// per color.
+pub fn sparse_hessian_with(
+    tape: &dyn Tape,
+    ybar: &DVector<f64>,
+    pattern: &SparsityPattern,
+) -> CsrMatrix {
+    let n = tape.num_indeps();
+    assert_eq!(pattern.nrows(), n);
+    assert_eq!(pattern.ncols(), n);
+    let (num_colors, colors) = star_coloring(pattern);
+
+    // Column c holds the product of the Hessian with the indicator of color c
+    let products = (0..num_colors)
+        .into_par_iter()
+        .map(|c| {
+            let dx = DVector::from_fn(n, |j, _| if colors[j] == c { 1.0 } else { 0.0 });
+            hessian_vector_product(tape, ybar, &dx)
+        })
+        .collect::<Vec<_>>();
+
+    let mut hessian = CsrMatrix::zeros(pattern.clone());
+    let mut count = vec![0; num_colors];
+    for i in 0..n {
+        for j in pattern.row(i) {
+            count[colors[*j]] += 1;
+        }
+        for (offset, j) in pattern.row(i).iter().enumerate() {
+            // Entry (i, j) is the only one of its color in row i or, by symmetry, in row j
+            let val = if count[colors[*j]] == 1 {
+                products[colors[*j]][i]
+            } else {
+                products[colors[i]][*j]
+            };
+            hessian.values_mut()[pattern.row_offsets()[i] + offset] = val;
+        }
+        for j in pattern.row(i) {
+            count[colors[*j]] = 0;
+        }
+    }
+    hessian
+}
+
+/// Compute a sparse Hessian `∑ ybar_j H_j` of `tape`
+pub fn sparse_hessian(tape: &dyn Tape, ybar: &DVector<f64>) -> CsrMatrix {
+    sparse_hessian_with(tape, ybar, &hessian_pattern(tape))
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Tape using every smooth operation
+    fn smooth_tape() -> impl Tape {
+        let mut ctx = AContext::new();
+        let x = ctx.new_indep_vec(4, 0.0);
+        let y1 = x[0] * x[0] * x[1] + x[2].sin() * x[0] - x[3].exp() / x[1];
+        let y2 = x[1].powf(x[2]) + x[3].ln().cos() * x[2].tan();
+        let y3 = (x[0] * 0.5).asin() * (x[3] * 0.5).acos() + x[1].atan();
+        ctx.set_dep_slice(&[y1, y2, y3]);
+        let mut tape = ctx.tape();
+        tape.zero_order(&adv_dvec![0.3, 1.7, 0.8, 1.2]);
+        tape
+    }
+
+    #[test]
+    fn hessian_matches_finite_differences() {
+        let tape = smooth_tape();
+        let ybar = adv_dvec![1.0, -0.5, 2.0];
+        let x = tape.x();
+        let h = hessian(&tape, &ybar);
+        let step = 1e-6;
+        for j in 0..4 {
+            let gradient = |offset: f64| {
+                let mut tape = smooth_tape();
+                let mut x = x.clone();
+                x[j] += offset;
+                tape.zero_order(&x);
+                tape.first_order_reverse(&ybar)
+            };
+            let fd = (gradient(step) - gradient(-step)) / (2.0 * step);
+            for i in 0..4 {
+                assert!((h[(i, j)] - fd[i]).abs() < 1e-6);
+                assert!((h[(i, j)] - h[(j, i)]).abs() < 1e-12);
+            }
+        }
+
+        // The gradient is produced alongside
+        let mut xbar = vec![0.0; 4];
+        let mut dxbar = vec![0.0; 4];
+        Workspace::with_local(|ws| {
+            tape.second_order_reverse_into(&[1.0; 4], ybar.as_slice(), &mut xbar, &mut dxbar, ws)
+        });
+        let gradient = tape.first_order_reverse(&ybar);
+        for i in 0..4 {
+            assert!((xbar[i] - gradient[i]).abs() < 1e-12);
+        }
+    }
+
+    /// Arrowhead plus tridiagonal Hessian
+    fn arrow_tape(n: usize) -> impl Tape {
+        let mut ctx = AContext::new();
+        let x = ctx.new_indep_vec(n, 0.0);
+        let mut y = x[0] * x[0];
+        for i in 1..n {
+            y += x[0] * x[i].sin();
+            if i + 1 < n {
+                y += x[i] * x[i + 1];
+            }
+        }
+        ctx.set_dep(&y);
+        let mut tape = ctx.tape();
+        tape.zero_order(&DVector::from_fn(n, |i, _| 0.1 * i as f64 + 0.5));
+        tape
+    }
+
+    #[test]
+    fn sparse_hessian_star_coloring() {
+        let n = 30;
+        let tape = arrow_tape(n);
+        let pattern = hessian_pattern(&tape);
+        for i in 1..n {
+            let mut expected = vec![0];
+            expected.extend((i.max(2) - 1)..(i + 2).min(n));
+            assert_eq!(pattern.row(i), expected.as_slice());
+        }
+        assert_eq!(pattern.row(0).len(), n);
+
+        let (num_colors, _) = star_coloring(&pattern);
+        assert!(num_colors <= 5);
+
+        let ybar = adv_dvec![1.0];
+        let dense = hessian(&tape, &ybar);
+        let sparse = sparse_hessian(&tape, &ybar).to_dense();
+        for i in 0..n {
+            for j in 0..n {
+                assert!((sparse[(i, j)] - dense[(i, j)]).abs() < 1e-12);
+            }
+        }
+    }
+}
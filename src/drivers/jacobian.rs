@@ -49,30 +49,34 @@ pub fn jacobian_reverse(tape: &dyn Tape) -> DMatrix<f64> {
     let n = tape.num_indeps();
     let m = tape.num_deps();
 
-    let rows = (0..m)
-        .collect::<Vec<usize>>()
-        .par_iter()
-        .map(|i| {
-            let mut ybar = DVector::from_element(m, 0.0);
-            ybar[*i] = 1.0;
-
-            let xbar = tape.first_order_reverse(&ybar);
-            (*i, xbar)
-        })
-        .map(|x| vec![x])
-        .reduce(Vec::new, |mut a, mut b| {
-            a.append(&mut b);
-            a
-        });
-
-    let mut jacobian = DMatrix::from_element(m, n, 0.0);
-    for (i, xbar) in rows {
-        for j in 0..n {
-            jacobian[(i, j)] = xbar[j];
-        }
+    // Rows of the jacobian are computed as columns of its transpose in blocks of
+    // `SWEEP_BLOCK_WIDTH` unit adjoints
+    let mut jacobian_t = DMatrix::from_element(n, m, 0.0);
+    if n > 0 {
+        jacobian_t
+            .as_mut_slice()
+            .par_chunks_mut(n * SWEEP_BLOCK_WIDTH)
+            .enumerate()
+            .for_each(|(b, block)| {
+                let i0 = b * SWEEP_BLOCK_WIDTH;
+                let k = block.len() / n;
+                let mut ybar = vec![0.0; m * k];
+                for l in 0..k {
+                    ybar[(i0 + l) * k + l] = 1.0;
+                }
+                let mut xbar = vec![0.0; n * k];
+                Workspace::with_local(|ws| {
+                    tape.first_order_reverse_vector_into(&ybar, &mut xbar, k, ws)
+                });
+                for l in 0..k {
+                    for j in 0..n {
+                        block[l * n + j] = xbar[j * k + l];
+                    }
+                }
+            });
     }
 
-    jacobian
+    jacobian_t.transpose()
 }
 
 #[cfg(test)]
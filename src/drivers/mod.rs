@@ -4,6 +4,9 @@ use super::*;
 mod generalized_jacobian;
 pub use generalized_jacobian::*;
 
+mod hessian;
+pub use hessian::*;
+
 mod jacobian;
 pub use jacobian::*;
 
@@ -13,6 +16,15 @@ pub use abs_normal::*;
 mod checkpointing;
 pub use checkpointing::*;
 
+mod sparse_jacobian;
+pub use sparse_jacobian::*;
+
+mod tape_cache;
+pub use tape_cache::*;
+
+mod vertex_elimination;
+pub use vertex_elimination::*;
+
 #[cfg(test)]
 mod testfunc;
 #[cfg(test)]
@@ -0,0 +1,275 @@
+use super::*;
+use rayon::prelude::*;
+
+/// Number of 64-bit words of independents tracked per pattern sweep
+const PATTERN_WORDS: usize = 4;
+
+/// Determine the sparsity pattern of the Jacobian of `tape` by propagating bit vectors
+///
+/// The dependencies on blocks of independents are propagated in parallel.
+pub fn jacobian_pattern(tape: &dyn Tape) -> SparsityPattern {
+    let n = tape.num_indeps();
+    let m = tape.num_deps();
+    let len = tape.values().len();
+    let ops = tape.ops_iter().collect::<Vec<_>>();
+    let block = 64 * PATTERN_WORDS;
+
+    let blocks = (0..(n + block - 1) / block)
+        .into_par_iter()
+        .map(|b| {
+            let words = PATTERN_WORDS;
+            let mut bits = vec![0_u64; len * words];
+            for (idx, vid) in tape.indeps().iter().enumerate().skip(b * block).take(block) {
+                let bit = idx - b * block;
+                bits[vid * words + bit / 64] |= 1 << (bit % 64);
+            }
+            for op in ops.iter().filter(|op| op.opcode != OpCode::Nop) {
+                let (args, result) = bits.split_at_mut(op.vid * words);
+                let result = &mut result[..words];
+                for w in result.iter_mut() {
+                    *w = 0;
+                }
+                for arg in op.arg1.iter().chain(op.arg2.iter()) {
+                    let arg = &args[arg * words..(arg + 1) * words];
+                    for (w, a) in result.iter_mut().zip(arg.iter()) {
+                        *w |= a;
+                    }
+                }
+            }
+            tape.deps()
+                .iter()
+                .map(|vid| {
+                    let mut row = Vec::new();
+                    for (k, word) in bits[vid * words..(vid + 1) * words].iter().enumerate() {
+                        let mut word = *word;
+                        while word != 0 {
+                            row.push(b * block + k * 64 + word.trailing_zeros() as usize);
+                            word &= word - 1;
+                        }
+                    }
+                    row
+                })
+                .collect::<Vec<_>>()
+        })
+        .collect::<Vec<_>>();
+
+    let mut rows = vec![Vec::new(); m];
+    for block_rows in blocks {
+        for (row, block_row) in rows.iter_mut().zip(block_rows.into_iter()) {
+            row.extend(block_row);
+        }
+    }
+    SparsityPattern::from_rows(n, rows)
+}
+
+/// Greedy coloring of the columns of `pattern` such that no two columns sharing a row have the
+/// same color
+///
+/// Returns the number of colors and the color of each column.
+pub fn color_columns(pattern: &SparsityPattern) -> (usize, Vec<usize>) {
+    let columns = pattern.transpose();
+    let mut colors = vec![usize::max_value(); pattern.ncols()];
+    let mut forbidden = Vec::new();
+    let mut num_colors = 0;
+    for j in 0..pattern.ncols() {
+        for i in columns.row(j) {
+            for k in pattern.row(*i) {
+                let color = colors[*k];
+                if color != usize::max_value() {
+                    forbidden[color] = j;
+                }
+            }
+        }
+        let color = (0..num_colors)
+            .find(|color| forbidden[*color] != j)
+            .unwrap_or(num_colors);
+        if color == num_colors {
+            num_colors += 1;
+            forbidden.push(usize::max_value());
+        }
+        colors[j] = color;
+    }
+    (num_colors, colors)
+}
+
+/// Compute the Jacobian with the given pattern from compressed forward sweeps
+///
+/// Columns of the same color are seeded together, so the number of tangents equals the number of
+/// column colors.
+pub fn sparse_jacobian_forward(tape: &dyn Tape, pattern: &SparsityPattern) -> CsrMatrix {
+    forward_with_colors(tape, pattern, color_columns(pattern))
+}
+
+/// Compressed forward sweeps with the column coloring `(num_colors, colors)` of `pattern`
+fn forward_with_colors(
+    tape: &dyn Tape,
+    pattern: &SparsityPattern,
+    (num_colors, colors): (usize, Vec<usize>),
+) -> CsrMatrix {
+    assert_eq!(pattern.nrows(), tape.num_deps());
+    assert_eq!(pattern.ncols(), tape.num_indeps());
+    let (n, m) = (pattern.ncols(), pattern.nrows());
+
+    let entries = compressed_sweeps(num_colors, |c0, k| {
+        let mut dx = vec![0.0; n * k];
+        for (j, color) in colors.iter().enumerate() {
+            if (c0..c0 + k).contains(color) {
+                dx[j * k + color - c0] = 1.0;
+            }
+        }
+        let mut dy = vec![0.0; m * k];
+        Workspace::with_local(|ws| tape.first_order_forward_vector_into(&dx, &mut dy, k, ws));
+        let mut entries = Vec::new();
+        for i in 0..m {
+            for (offset, j) in pattern.row(i).iter().enumerate() {
+                if (c0..c0 + k).contains(&colors[*j]) {
+                    let idx = pattern.row_offsets()[i] + offset;
+                    entries.push((idx, dy[i * k + colors[*j] - c0]));
+                }
+            }
+        }
+        entries
+    });
+
+    let mut jacobian = CsrMatrix::zeros(pattern.clone());
+    for (idx, val) in entries {
+        jacobian.values_mut()[idx] = val;
+    }
+    jacobian
+}
+
+/// Compute the Jacobian with the given pattern from compressed reverse sweeps
+///
+/// Rows of the same color are seeded together, so the number of adjoints equals the number of
+/// row colors.
+pub fn sparse_jacobian_reverse(tape: &dyn Tape, pattern: &SparsityPattern) -> CsrMatrix {
+    reverse_with_colors(tape, pattern, color_columns(&pattern.transpose()))
+}
+
+/// Compressed reverse sweeps with the row coloring `(num_colors, colors)` of `pattern`
+fn reverse_with_colors(
+    tape: &dyn Tape,
+    pattern: &SparsityPattern,
+    (num_colors, colors): (usize, Vec<usize>),
+) -> CsrMatrix {
+    assert_eq!(pattern.nrows(), tape.num_deps());
+    assert_eq!(pattern.ncols(), tape.num_indeps());
+    let (n, m) = (pattern.ncols(), pattern.nrows());
+
+    let entries = compressed_sweeps(num_colors, |c0, k| {
+        let mut ybar = vec![0.0; m * k];
+        for (i, color) in colors.iter().enumerate() {
+            if (c0..c0 + k).contains(color) {
+                ybar[i * k + color - c0] = 1.0;
+            }
+        }
+        let mut xbar = vec![0.0; n * k];
+        Workspace::with_local(|ws| tape.first_order_reverse_vector_into(&ybar, &mut xbar, k, ws));
+        let mut entries = Vec::new();
+        for i in (0..m).filter(|i| (c0..c0 + k).contains(&colors[*i])) {
+            for (offset, j) in pattern.row(i).iter().enumerate() {
+                let idx = pattern.row_offsets()[i] + offset;
+                entries.push((idx, xbar[j * k + colors[i] - c0]));
+            }
+        }
+        entries
+    });
+
+    let mut jacobian = CsrMatrix::zeros(pattern.clone());
+    for (idx, val) in entries {
+        jacobian.values_mut()[idx] = val;
+    }
+    jacobian
+}
+
+/// Compute a sparse Jacobian of `tape`
+///
+/// Detects the sparsity pattern and uses forward or reverse sweeps depending on which needs
+/// fewer colors.
+pub fn sparse_jacobian(tape: &dyn Tape) -> CsrMatrix {
+    let pattern = jacobian_pattern(tape);
+    let column_coloring = color_columns(&pattern);
+    let row_coloring = color_columns(&pattern.transpose());
+    if column_coloring.0 <= row_coloring.0 {
+        forward_with_colors(tape, &pattern, column_coloring)
+    } else {
+        reverse_with_colors(tape, &pattern, row_coloring)
+    }
+}
+
+/// Run `sweep(first_color, num_colors)` in parallel for blocks of `SWEEP_BLOCK_WIDTH` colors and
+/// collect the recovered `(storage index, value)` entries
+fn compressed_sweeps<F>(num_colors: usize, sweep: F) -> Vec<(usize, f64)>
+where
+    F: Fn(usize, usize) -> Vec<(usize, f64)> + Sync,
+{
+    let num_blocks = (num_colors + SWEEP_BLOCK_WIDTH - 1) / SWEEP_BLOCK_WIDTH;
+    (0..num_blocks)
+        .into_par_iter()
+        .map(|b| {
+            let c0 = b * SWEEP_BLOCK_WIDTH;
+            sweep(c0, SWEEP_BLOCK_WIDTH.min(num_colors - c0))
+        })
+        .reduce(Vec::new, |mut a, mut b| {
+            a.append(&mut b);
+            a
+        })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Banded function with `y_i` depending on `x_{i-1}`, `x_i` and `x_{i+1}`
+    fn banded_tape(n: usize) -> impl Tape {
+        let mut ctx = AContext::new();
+        let x = ctx.new_indep_vec(n, 0.0);
+        let y = (0..n)
+            .map(|i| {
+                let mut y = x[i].sin() * 2.0;
+                if i > 0 {
+                    y += x[i - 1] * x[i];
+                }
+                if i + 1 < n {
+                    y += x[i + 1].exp();
+                }
+                y
+            })
+            .collect::<Vec<_>>();
+        ctx.set_dep_slice(&y);
+        let mut tape = ctx.tape();
+        tape.zero_order(&DVector::from_fn(n, |i, _| 0.1 * i as f64 - 1.0));
+        tape
+    }
+
+    #[test]
+    fn jacobian_pattern_banded() {
+        let tape = banded_tape(300);
+        let pattern = jacobian_pattern(&tape);
+        assert_eq!(pattern.nnz(), 3 * 300 - 2);
+        for i in 0..300 {
+            let expected = (i.max(1) - 1..(i + 2).min(300)).collect::<Vec<_>>();
+            assert_eq!(pattern.row(i), expected.as_slice());
+        }
+        let (num_colors, colors) = color_columns(&pattern);
+        assert_eq!(num_colors, 3);
+        assert_eq!(&colors[..4], &[0, 1, 2, 0]);
+    }
+
+    #[test]
+    fn sparse_jacobian_banded() {
+        let tape = banded_tape(20);
+        let dense = jacobian_reverse(&tape);
+        let pattern = jacobian_pattern(&tape);
+
+        let forward = sparse_jacobian_forward(&tape, &pattern);
+        let reverse = sparse_jacobian_reverse(&tape, &pattern);
+        for i in 0..20 {
+            for j in 0..20 {
+                assert!((forward.get(i, j) - dense[(i, j)]).abs() < 1e-12);
+                assert!((reverse.get(i, j) - dense[(i, j)]).abs() < 1e-12);
+            }
+        }
+        assert_eq!(sparse_jacobian(&tape).to_dense(), forward.to_dense());
+    }
+}
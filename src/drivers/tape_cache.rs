@@ -0,0 +1,161 @@
+use super::*;
+use std::collections::BTreeMap;
+use std::sync::Mutex;
+
+/// Suggested memory limit of a `TapeCache` passed to `generalized_jacobian_chain_cached`
+pub const DEFAULT_TAPE_CACHE_BYTES: usize = 256 << 20;
+
+/// Condition under which a cached tape is reused at an argument
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum TapeReuse {
+    /// Only at the argument it was recorded at
+    Point,
+    /// At every argument by replaying it with `zero_order`
+    ///
+    /// Only valid for functions whose operations do not depend on the argument.
+    Structure,
+}
+
+#[derive(Debug, Default)]
+struct TapeCacheInner {
+    tapes: BTreeMap<usize, AContextTape>,
+    bytes: usize,
+}
+
+/// Tapes of chain nodes, keyed by chain index, with a limit on the memory they occupy
+///
+/// When the limit is reached the tapes with the lowest indices are dropped first because a
+/// chain is reversed back to front.
+#[derive(Debug)]
+pub struct TapeCache {
+    capacity: usize,
+    reuse: TapeReuse,
+    inner: Mutex<TapeCacheInner>,
+}
+
+#[allow(clippy::len_without_is_empty)]
+impl TapeCache {
+    /// Create a cache that holds up to `capacity` bytes of tapes
+    pub fn new(capacity: usize, reuse: TapeReuse) -> Self {
+        Self {
+            capacity,
+            reuse,
+            inner: Mutex::new(TapeCacheInner::default()),
+        }
+    }
+
+    /// Reuse condition of the cache
+    pub fn reuse(&self) -> TapeReuse {
+        self.reuse
+    }
+
+    /// Number of cached tapes
+    pub fn len(&self) -> usize {
+        self.inner.lock().unwrap().tapes.len()
+    }
+
+    /// Memory occupied by the cached tapes in bytes
+    pub fn bytes(&self) -> usize {
+        self.inner.lock().unwrap().bytes
+    }
+
+    /// Drop all cached tapes
+    pub fn clear(&self) {
+        let mut inner = self.inner.lock().unwrap();
+        inner.tapes.clear();
+        inner.bytes = 0;
+    }
+
+    /// Remove the tape of node `idx` from the cache and bring it to `x`
+    ///
+    /// Records a new tape of `func` if no cached tape can be reused.
+    pub(crate) fn take(&self, idx: usize, func: &dyn Function, x: &DVector<f64>) -> AContextTape {
+        let cached = {
+            let mut inner = self.inner.lock().unwrap();
+            let tape = inner.tapes.remove(&idx);
+            if let Some(ref tape) = tape {
+                inner.bytes -= tape.bytes();
+            }
+            tape
+        };
+        match cached {
+            Some(tape) if tape.x() == *x => tape,
+            Some(mut tape) if self.reuse == TapeReuse::Structure => {
+                tape.zero_order(x);
+                tape
+            }
+            _ => function::record(func, x),
+        }
+    }
+
+    /// Store the tape of node `idx` if it fits into the memory limit
+    pub(crate) fn insert(&self, idx: usize, tape: AContextTape) {
+        let bytes = tape.bytes();
+        let mut inner = self.inner.lock().unwrap();
+        while inner.bytes + bytes > self.capacity {
+            let lowest = match inner.tapes.keys().next() {
+                Some(lowest) if *lowest < idx => *lowest,
+                _ => return,
+            };
+            let evicted = inner.tapes.remove(&lowest).unwrap();
+            inner.bytes -= evicted.bytes();
+        }
+        inner.bytes += bytes;
+        if let Some(replaced) = inner.tapes.insert(idx, tape) {
+            inner.bytes -= replaced.bytes();
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    adv_fn! {
+        fn scale(x: [[2]]) -> [[2]] {
+            let mut result = x.clone();
+            for i in 0..2 {
+                result[i] = x[i] + x[i];
+            }
+            result
+        }
+    }
+
+    #[test]
+    fn tape_cache_reuse() {
+        let func = adv_fn_obj!(scale);
+        let x = adv_dvec![1.0, 2.0];
+        let cache = TapeCache::new(usize::max_value(), TapeReuse::Structure);
+        let tape = cache.take(0, &func, &x);
+        let bytes = tape.bytes();
+        cache.insert(0, tape);
+        assert_eq!(cache.len(), 1);
+        assert_eq!(cache.bytes(), bytes);
+
+        let x = adv_dvec![3.0, 4.0];
+        let tape = cache.take(0, &func, &x);
+        assert_eq!(cache.len(), 0);
+        assert_eq!(tape.y(), adv_dvec![6.0, 8.0]);
+    }
+
+    #[test]
+    fn tape_cache_capacity() {
+        let func = adv_fn_obj!(scale);
+        let x = adv_dvec![1.0, 2.0];
+        let bytes = function::record(&func, &x).bytes();
+        let cache = TapeCache::new(2 * bytes, TapeReuse::Point);
+        for idx in 0..3 {
+            let tape = cache.take(idx, &func, &x);
+            cache.insert(idx, tape);
+        }
+        // The lowest index was evicted
+        assert_eq!(cache.len(), 2);
+        assert_eq!(cache.bytes(), 2 * bytes);
+        assert!(cache.inner.lock().unwrap().tapes.contains_key(&2));
+
+        // Lower indices do not evict higher ones
+        let tape = cache.take(0, &func, &x);
+        cache.insert(0, tape);
+        assert!(!cache.inner.lock().unwrap().tapes.contains_key(&0));
+    }
+}
@@ -0,0 +1,276 @@
+use super::*;
+use std::collections::{BTreeMap, BTreeSet};
+
+/// Order in which the intermediate vertices of the linearized computational graph are eliminated
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum EliminationOrder {
+    /// Tape order, which performs the multiplications of forward mode
+    Forward,
+    /// Reverse tape order, which performs the multiplications of reverse mode
+    Reverse,
+    /// Vertex with the fewest predecessor-successor pairs first
+    Markowitz,
+}
+
+/// Linearized computational graph of a tape
+///
+/// Vertices `0..n` are the independents and every dependent gets a sink vertex of its own, so all
+/// other vertices are intermediate. The edge `(p, v)` carries the local partial `∂v/∂p` and is
+/// stored in `succs[p]`.
+struct LinearizedGraph {
+    preds: Vec<BTreeSet<usize>>,
+    succs: Vec<BTreeMap<usize, f64>>,
+    n: usize,
+    sinks: Vec<usize>,
+}
+
+impl LinearizedGraph {
+    fn new(tape: &dyn Tape) -> Self {
+        let n = tape.num_indeps();
+        let values = tape.values();
+        let mut graph = Self {
+            preds: vec![BTreeSet::new(); n],
+            succs: vec![BTreeMap::new(); n],
+            n,
+            sinks: Vec::new(),
+        };
+
+        // Vertex currently held by each value slot, `None` for passive values
+        let mut current = vec![None; values.len()];
+        for (idx, vid) in tape.indeps().iter().enumerate() {
+            current[*vid] = Some(idx);
+        }
+        for op in tape.ops_iter() {
+            match op.opcode {
+                OpCode::Nop => {}
+                OpCode::Const => current[op.vid] = None,
+                _ => {
+                    let (d1, d2) = first_order_partials(
+                        op.opcode,
+                        values[op.arg1.unwrap()],
+                        op.arg2.map(|i| values[i]),
+                    );
+                    let v = graph.add_vertex();
+                    for (arg, partial) in op
+                        .arg1
+                        .iter()
+                        .zip(Some(d1))
+                        .chain(op.arg2.iter().zip(Some(d2)))
+                    {
+                        if let Some(p) = current[*arg] {
+                            graph.add_edge(p, v, partial);
+                        }
+                    }
+                    current[op.vid] = Some(v);
+                }
+            }
+        }
+        for vid in tape.deps() {
+            let sink = graph.add_vertex();
+            if let Some(v) = current[*vid] {
+                graph.add_edge(v, sink, 1.0);
+            }
+            graph.sinks.push(sink);
+        }
+        graph
+    }
+
+    fn add_vertex(&mut self) -> usize {
+        self.preds.push(BTreeSet::new());
+        self.succs.push(BTreeMap::new());
+        self.preds.len() - 1
+    }
+
+    fn add_edge(&mut self, p: usize, v: usize, partial: f64) {
+        *self.succs[p].entry(v).or_insert(0.0) += partial;
+        self.preds[v].insert(p);
+    }
+
+    fn is_intermediate(&self, v: usize) -> bool {
+        v >= self.n && !self.succs[v].is_empty()
+    }
+
+    /// Markowitz degree of vertex `v`
+    fn markowitz(&self, v: usize) -> usize {
+        self.preds[v].len() * self.succs[v].len()
+    }
+
+    /// Remove vertices that do not reach a dependent
+    fn prune(&mut self) {
+        let mut live = vec![false; self.preds.len()];
+        for sink in self.sinks.iter() {
+            live[*sink] = true;
+        }
+        for v in (self.n..self.preds.len()).rev() {
+            if !live[v] {
+                for p in std::mem::take(&mut self.preds[v]) {
+                    self.succs[p].remove(&v);
+                }
+            } else {
+                for p in self.preds[v].iter() {
+                    live[*p] = true;
+                }
+            }
+        }
+    }
+
+    /// Eliminate vertex `v` by connecting its predecessors to its successors
+    ///
+    /// Returns the predecessors and successors whose degree changed.
+    fn eliminate(&mut self, v: usize) -> Vec<usize> {
+        let preds = std::mem::take(&mut self.preds[v]);
+        let succs = std::mem::take(&mut self.succs[v]);
+        for s in succs.keys() {
+            self.preds[*s].remove(&v);
+        }
+        for p in preds.iter() {
+            let cpv = self.succs[*p].remove(&v).unwrap();
+            for (s, cvs) in succs.iter() {
+                self.add_edge(*p, *s, cpv * cvs);
+            }
+        }
+        preds.into_iter().chain(succs.keys().cloned()).collect()
+    }
+
+    /// Eliminate all intermediate vertices and return the number of multiplications
+    fn eliminate_all(&mut self, order: EliminationOrder) -> usize {
+        self.prune();
+        let mut intermediates = (self.n..self.preds.len())
+            .filter(|v| self.is_intermediate(*v))
+            .collect::<Vec<_>>();
+        let mut cost = 0;
+        match order {
+            EliminationOrder::Forward | EliminationOrder::Reverse => {
+                if order == EliminationOrder::Reverse {
+                    intermediates.reverse();
+                }
+                for v in intermediates {
+                    cost += self.markowitz(v);
+                    self.eliminate(v);
+                }
+            }
+            EliminationOrder::Markowitz => {
+                let mut degrees = vec![0; self.preds.len()];
+                let mut queue = BTreeSet::new();
+                for v in intermediates {
+                    degrees[v] = self.markowitz(v);
+                    queue.insert((degrees[v], v));
+                }
+                while let Some(&(degree, v)) = queue.iter().next() {
+                    queue.remove(&(degree, v));
+                    cost += degree;
+                    for w in self.eliminate(v) {
+                        if queue.remove(&(degrees[w], w)) {
+                            degrees[w] = self.markowitz(w);
+                            queue.insert((degrees[w], w));
+                        }
+                    }
+                }
+            }
+        }
+        cost
+    }
+
+    /// Jacobian read off the edges from the independents to the sinks
+    fn jacobian(&self) -> CsrMatrix {
+        let rows = self
+            .sinks
+            .iter()
+            .map(|sink| self.preds[*sink].iter().cloned().collect())
+            .collect::<Vec<Vec<usize>>>();
+        let values = self
+            .sinks
+            .iter()
+            .zip(rows.iter())
+            .flat_map(|(sink, row)| row.iter().map(move |j| self.succs[*j][sink]))
+            .collect();
+        CsrMatrix::new(SparsityPattern::from_rows(self.n, rows), values)
+    }
+}
+
+/// Accumulate the Jacobian of `tape` by eliminating the vertices of its linearized computational
+/// graph in the given order
+///
+/// Cross-country orders like Markowitz can need far fewer multiplications than forward or reverse
+/// mode when the graph has narrow bottlenecks. Abs-functions are not supported.
+pub fn cross_country_jacobian(tape: &dyn Tape, order: EliminationOrder) -> CsrMatrix {
+    let mut graph = LinearizedGraph::new(tape);
+    graph.eliminate_all(order);
+    graph.jacobian()
+}
+
+/// Number of multiplications `cross_country_jacobian` performs with the given order
+pub fn cross_country_cost(tape: &dyn Tape, order: EliminationOrder) -> usize {
+    LinearizedGraph::new(tape).eliminate_all(order)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// `n` inputs reduced to a single value and expanded to `n` outputs
+    fn bottleneck_tape(n: usize) -> impl Tape {
+        let mut ctx = AContext::new();
+        let x = ctx.new_indep_vec(n, 0.0);
+        let mut x = x.into_iter().map(|x| x.sin()).collect::<Vec<_>>();
+        for _ in 0..4 {
+            x = x.iter().map(|x| (x.cos() * *x).sin()).collect();
+        }
+        let mut t = x[0];
+        for x in x.iter().skip(1) {
+            t *= x.cos();
+        }
+        let mut y = (0..n).map(|_| t).collect::<Vec<_>>();
+        for _ in 0..4 {
+            y = y
+                .iter()
+                .enumerate()
+                .map(|(i, y)| (*y * (i as f64 + 1.0)).sin())
+                .collect();
+        }
+        ctx.set_dep_slice(&y);
+        let mut tape = ctx.tape();
+        tape.zero_order(&DVector::from_fn(n, |i, _| 0.1 * i as f64 - 0.3));
+        tape
+    }
+
+    #[test]
+    fn cross_country_matches_reverse() {
+        let tape = bottleneck_tape(12);
+        let reference = jacobian_reverse(&tape);
+        for order in &[
+            EliminationOrder::Forward,
+            EliminationOrder::Reverse,
+            EliminationOrder::Markowitz,
+        ] {
+            let jacobian = cross_country_jacobian(&tape, *order).to_dense();
+            for i in 0..12 {
+                for j in 0..12 {
+                    assert!((jacobian[(i, j)] - reference[(i, j)]).abs() < 1e-12);
+                }
+            }
+        }
+
+        let forward = cross_country_cost(&tape, EliminationOrder::Forward);
+        let reverse = cross_country_cost(&tape, EliminationOrder::Reverse);
+        let markowitz = cross_country_cost(&tape, EliminationOrder::Markowitz);
+        assert!(markowitz * 3 < forward.min(reverse));
+    }
+
+    #[test]
+    fn cross_country_special_vertices() {
+        let mut ctx = AContext::new();
+        let x = ctx.new_indep_vec(2, 0.0);
+        let c = AFloat::new(3.0, 0.0);
+        let v = x[0] * x[0] + x[1] / c;
+        let _unused = v.exp();
+        ctx.set_dep_slice(&[v, x[1], c, v]);
+        let mut tape = ctx.tape();
+        tape.zero_order(&adv_dvec![2.0, 1.0]);
+
+        let jacobian = cross_country_jacobian(&tape, EliminationOrder::Markowitz);
+        assert_eq!(jacobian.to_dense(), jacobian_reverse(&tape));
+        assert_eq!(jacobian.row(1), (&[1][..], &[1.0][..]));
+        assert_eq!(jacobian.row(2).0.len(), 0);
+    }
+}
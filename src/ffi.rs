@@ -1,6 +1,59 @@
 #![allow(non_camel_case_types)]
+use super::drivers::*;
 use super::*;
-use num::Zero;
+use std::convert::TryFrom;
+
+/// Plain-old-data representation of an `ADouble` that is passed by value across the FFI boundary
+///
+/// A context id of zero denotes a passive value that is not recorded on any context.
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct adv_adouble {
+    value: f64,
+    dvalue: f64,
+    cid: usize,
+    vid: usize,
+}
+
+impl From<ADouble> for adv_adouble {
+    fn from(x: ADouble) -> Self {
+        let (cid, vid) = x.context().unwrap_or((0, 0));
+        Self {
+            value: x.value(),
+            dvalue: x.dvalue(),
+            cid,
+            vid,
+        }
+    }
+}
+
+impl From<adv_adouble> for ADouble {
+    fn from(x: adv_adouble) -> Self {
+        let mut this = ADouble::new(x.value, x.dvalue);
+        if x.cid != 0 {
+            this.set_context(x.cid, x.vid);
+        }
+        this
+    }
+}
+
+/// Slice of `len` elements at `ptr`, which may be null if `len` is zero
+unsafe fn slice<'a, T>(ptr: *const T, len: usize) -> &'a [T] {
+    if len == 0 {
+        &[]
+    } else {
+        std::slice::from_raw_parts(ptr, len)
+    }
+}
+
+/// Mutable slice of `len` elements at `ptr`, which may be null if `len` is zero
+unsafe fn slice_mut<'a, T>(ptr: *mut T, len: usize) -> &'a mut [T] {
+    if len == 0 {
+        &mut []
+    } else {
+        std::slice::from_raw_parts_mut(ptr, len)
+    }
+}
 
 // `AContext` bindings
 
@@ -11,52 +64,282 @@ pub extern "C" fn adv_acontext_new() -> *mut AContext {
 
 #[no_mangle]
 pub unsafe extern "C" fn adv_acontext_free(this: *mut AContext) {
-    Box::from_raw(this);
+    drop(Box::from_raw(this));
+}
+
+#[no_mangle]
+pub extern "C" fn adv_acontext_new_independent(this: &mut AContext) -> adv_adouble {
+    this.new_indep(0.0).into()
+}
+
+#[no_mangle]
+pub extern "C" fn adv_acontext_set_dependent(this: &mut AContext, val: adv_adouble) {
+    this.set_dep(&ADouble::from(val));
 }
 
 #[no_mangle]
-pub extern "C" fn adv_acontext_new_independent(this: &'static mut AContext) -> *mut ADouble {
-    Box::leak(Box::new(this.new_indep(0.0)))
+pub unsafe extern "C" fn adv_acontext_new_independents(
+    this: &mut AContext,
+    vals: *mut adv_adouble,
+    len: usize,
+) {
+    let vals = slice_mut(vals, len);
+    let mut indeps = this.new_indep_vec(len, 0.0);
+    for (val, indep) in vals.iter_mut().zip(indeps.drain(..)) {
+        *val = indep.into();
+    }
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn adv_acontext_set_dependents(
+    this: &mut AContext,
+    vals: *const adv_adouble,
+    len: usize,
+) {
+    let vals = slice(vals, len);
+    let deps = vals
+        .iter()
+        .map(|val| ADouble::from(*val))
+        .collect::<Vec<_>>();
+    this.set_dep_slice(&deps);
+}
+
+#[no_mangle]
+pub extern "C" fn adv_acontext_reserve(this: &mut AContext, ops: usize, values: usize) {
+    this.reserve(ops, values);
+}
+
+// `Tape` bindings
+
+/// Tape recorded by a context whose clones share its operations
+pub struct adv_tape {
+    tape: AContextTape,
+}
+
+/// Copy a matrix to a row-major buffer
+unsafe fn write_row_major(mat: &DMatrix<f64>, out: *mut f64) {
+    let out = slice_mut(out, mat.nrows() * mat.ncols());
+    for i in 0..mat.nrows() {
+        for j in 0..mat.ncols() {
+            out[i * mat.ncols() + j] = mat[(i, j)];
+        }
+    }
+}
+
+/// Copy a string and a terminating zero byte to a buffer of `len` bytes
+///
+/// The string is truncated if the buffer is too small. Returns the length of the full string, so
+/// callers can retry with a larger buffer.
+unsafe fn copy_string(string: &str, buf: *mut u8, len: usize) -> usize {
+    if len > 0 {
+        let count = string.len().min(len - 1);
+        let buf = slice_mut(buf, count + 1);
+        buf[..count].copy_from_slice(&string.as_bytes()[..count]);
+        buf[count] = 0;
+    }
+    string.len()
 }
 
+/// Copy a vector to a buffer
+unsafe fn write_vector(vec: &DVector<f64>, out: *mut f64) {
+    slice_mut(out, vec.nrows()).copy_from_slice(vec.as_slice());
+}
+
+/// Create a tape from a context and free the context
 #[no_mangle]
-pub extern "C" fn adv_acontext_set_dependent(this: &mut AContext, val: &ADouble) {
-    this.set_dep(val);
+pub unsafe extern "C" fn adv_tape_new(ctx: *mut AContext) -> *mut adv_tape {
+    let ctx = Box::from_raw(ctx);
+    Box::leak(Box::new(adv_tape {
+        tape: ctx.context_tape(),
+    }))
 }
 
-// `ADouble` bindings
+#[no_mangle]
+pub unsafe extern "C" fn adv_tape_free(this: *mut adv_tape) {
+    drop(Box::from_raw(this));
+}
 
 #[no_mangle]
-pub unsafe extern "C" fn adv_adouble_default() -> *mut ADouble {
-    Box::leak(Box::new(ADouble::zero()))
+pub extern "C" fn adv_tape_num_independents(this: &adv_tape) -> usize {
+    this.tape.num_indeps()
 }
 
 #[no_mangle]
-pub unsafe extern "C" fn adv_adouble_from_value(val: f64) -> *mut ADouble {
-    Box::leak(Box::new(ADouble::from(val)))
+pub extern "C" fn adv_tape_num_dependents(this: &adv_tape) -> usize {
+    this.tape.num_deps()
 }
 
 #[no_mangle]
-pub unsafe extern "C" fn adv_adouble_free(this: *mut ADouble) {
-    Box::from_raw(this);
+pub extern "C" fn adv_tape_num_abs(this: &adv_tape) -> usize {
+    this.tape.num_abs()
 }
 
 #[no_mangle]
-pub extern "C" fn adv_adouble_copy(this: &ADouble) -> *mut ADouble {
-    Box::leak(Box::new(this.clone()))
+pub unsafe extern "C" fn adv_tape_zero_order(this: &mut adv_tape, x: *const f64, y: *mut f64) {
+    let x = slice(x, this.tape.num_indeps());
+    this.tape.zero_order(&DVector::from_column_slice(x));
+    write_vector(&this.tape.y(), y);
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn adv_tape_first_order_forward(
+    this: &adv_tape,
+    dx: *const f64,
+    dy: *mut f64,
+) {
+    let dx = slice(dx, this.tape.num_indeps());
+    let dy = slice_mut(dy, this.tape.num_deps());
+    Workspace::with_local(|ws| this.tape.first_order_forward_into(dx, dy, ws));
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn adv_tape_first_order_reverse(
+    this: &adv_tape,
+    dy: *const f64,
+    dx: *mut f64,
+) {
+    let dy = slice(dy, this.tape.num_deps());
+    let dx = slice_mut(dx, this.tape.num_indeps());
+    Workspace::with_local(|ws| this.tape.first_order_reverse_into(dy, dx, ws));
+}
+
+/// Write the row-major `m`×`n` Jacobian to `jac`
+#[no_mangle]
+pub unsafe extern "C" fn adv_tape_jacobian(this: &adv_tape, jac: *mut f64) {
+    write_row_major(&jacobian_reverse(&this.tape), jac);
+}
+
+/// Write the `TapeStats` of the tape to `buf` as JSON with `copy_string`
+#[no_mangle]
+pub unsafe extern "C" fn adv_tape_stats_json(this: &adv_tape, buf: *mut u8, len: usize) -> usize {
+    copy_string(
+        &profile::TapeStats::from_tape(&this.tape).to_json(),
+        buf,
+        len,
+    )
+}
+
+/// Write the Abs-Normal Form with row-major matrices to the given buffers
+#[no_mangle]
+pub unsafe extern "C" fn adv_tape_abs_normal(
+    this: &adv_tape,
+    a: *mut f64,
+    zmat: *mut f64,
+    lmat: *mut f64,
+    b: *mut f64,
+    jmat: *mut f64,
+    ymat: *mut f64,
+) {
+    // Clones share the operations, so only the values are copied
+    let anf = abs_normal_tape(Box::new(this.tape.clone()));
+    write_vector(&anf.a, a);
+    write_row_major(&anf.zmat, zmat);
+    write_row_major(&anf.lmat, lmat);
+    write_vector(&anf.b, b);
+    write_row_major(&anf.jmat, jmat);
+    write_row_major(&anf.ymat, ymat);
+}
+
+// `profile` bindings
+
+#[no_mangle]
+pub extern "C" fn adv_profile_enable() {
+    profile::enable();
+}
+
+#[no_mangle]
+pub extern "C" fn adv_profile_disable() {
+    profile::disable();
+}
+
+#[no_mangle]
+pub extern "C" fn adv_profile_is_enabled() -> bool {
+    profile::is_enabled()
+}
+
+#[no_mangle]
+pub extern "C" fn adv_profile_reset() {
+    profile::reset();
+}
+
+/// Write the current profile report to `buf` as JSON with `copy_string`
+#[no_mangle]
+pub unsafe extern "C" fn adv_profile_json(buf: *mut u8, len: usize) -> usize {
+    copy_string(&profile::report().to_json(), buf, len)
 }
 
 // `ADouble` operation bindings
 
+/// Operation of an expression block with `u32::MAX` marking an absent second argument
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct adv_block_op {
+    opcode: u32,
+    arg1: u32,
+    arg2: u32,
+}
+
+impl adv_block_op {
+    /// Operation at position `pos` of a block if it is valid there
+    fn decode(self, pos: usize) -> Option<BlockOp> {
+        let opcode = u8::try_from(self.opcode).ok().and_then(OpCode::from_u8)?;
+        let arg1 = self.arg1 as usize;
+        let arg2 = if self.arg2 == u32::MAX {
+            None
+        } else {
+            Some(self.arg2 as usize)
+        };
+        let valid = opcode != OpCode::Nop
+            && opcode != OpCode::Const
+            && opcode.is_binary() == arg2.is_some()
+            && arg1 < pos
+            && arg2.iter().all(|idx| *idx < pos);
+        if valid {
+            Some(BlockOp { opcode, arg1, arg2 })
+        } else {
+            None
+        }
+    }
+}
+
+/// Evaluate and record a block of operations with `ADouble::from_block`
+///
+/// Returns a passive NaN and records nothing if the block is empty or an operation has an unknown
+/// op code, a wrong number of arguments or an argument that is not computed before it.
+#[no_mangle]
+pub unsafe extern "C" fn adv_record_block(
+    inputs: *const adv_adouble,
+    num_inputs: usize,
+    ops: *const adv_block_op,
+    num_ops: usize,
+) -> adv_adouble {
+    let inputs = slice(inputs, num_inputs);
+    let ops = slice(ops, num_ops);
+    let valid = ops
+        .iter()
+        .enumerate()
+        .all(|(k, op)| op.decode(num_inputs + k).is_some());
+    if num_inputs + num_ops == 0 || !valid {
+        return ADouble::new(std::f64::NAN, std::f64::NAN).into();
+    }
+    ADouble::from_block_iter(
+        inputs.iter().map(|x| ADouble::from(*x)),
+        ops.iter()
+            .enumerate()
+            .map(|(k, op)| op.decode(num_inputs + k).unwrap()),
+    )
+    .into()
+}
+
 macro_rules! binary_operation {
     ($op_name:ident, $op:tt) => {
         paste::item! {
             #[no_mangle]
-            pub extern "C" fn [<adv_op_ $op_name>](a: &'static ADouble, b: &'static ADouble, result: &'static mut *mut ADouble) {
-                *result = Box::leak(Box::new(*a $op *b));
+            pub extern "C" fn [<adv_op_ $op_name>](a: adv_adouble, b: adv_adouble) -> adv_adouble {
+                (ADouble::from(a) $op ADouble::from(b)).into()
             }
         }
-    }
+    };
 }
 
 binary_operation!(add, +);
@@ -68,11 +351,11 @@ macro_rules! unary_function {
     ($func_name:ident) => {
         paste::item! {
             #[no_mangle]
-            pub extern "C" fn [<adv_ $func_name>](x: &'static ADouble, result: &'static mut *mut ADouble) {
-                *result = Box::leak(Box::new(x.$func_name()));
+            pub extern "C" fn [<adv_ $func_name>](x: adv_adouble) -> adv_adouble {
+                ADouble::from(x).$func_name().into()
             }
         }
-    }
+    };
 }
 
 unary_function!(sin);
@@ -86,11 +369,11 @@ macro_rules! binary_function {
     ($func_name:ident) => {
         paste::item! {
             #[no_mangle]
-            pub extern "C" fn [<adv_ $func_name>](a: &'static ADouble, b: &'static ADouble, result: &'static mut *mut ADouble) {
-                *result = Box::leak(Box::new(a.$func_name(*b)));
+            pub extern "C" fn [<adv_ $func_name>](a: adv_adouble, b: adv_adouble) -> adv_adouble {
+                ADouble::from(a).$func_name(ADouble::from(b)).into()
             }
         }
-    }
+    };
 }
 
 binary_function!(min);
@@ -24,17 +24,22 @@ pub trait Function: Send + Sync {
 
     /// Create a tape of the function
     fn tape(&self, x: &DVector<f64>) -> Box<dyn Tape> {
-        let mut ctx = AContext::new();
-        let mut input = x.map(|x| x.into());
-        for x in input.iter_mut() {
-            ctx.set_indep(x);
-        }
-        let output = self.eval(input);
-        for y in output.iter() {
-            ctx.set_dep(y);
-        }
-        Box::new(ctx.tape())
+        Box::new(record(self, x))
+    }
+}
+
+/// Record `func` at `x` into a tape owned by the caller
+pub(crate) fn record<F: Function + ?Sized>(func: &F, x: &DVector<f64>) -> AContextTape {
+    let mut ctx = AContext::new();
+    let mut input = x.map(|x| x.into());
+    for x in input.iter_mut() {
+        ctx.set_indep(x);
+    }
+    let output = func.eval(input);
+    for y in output.iter() {
+        ctx.set_dep(y);
     }
+    ctx.context_tape()
 }
 
 #[derive(Clone)]
@@ -77,13 +82,18 @@ where
 /// A chain of function where each node takes its input from its predecessor
 pub struct FunctionChain {
     funcs: Vec<Box<dyn Function>>,
+    /// Index into `funcs` and into the inner chain of every flattened node
+    nodes: Vec<(usize, usize)>,
 }
 
 #[allow(clippy::len_without_is_empty)]
 impl FunctionChain {
     pub fn from_boxed(f: Box<dyn Function>) -> Self {
-        let mut this = Self { funcs: Vec::new() };
-        this.funcs.push(f);
+        let mut this = Self {
+            funcs: Vec::new(),
+            nodes: Vec::new(),
+        };
+        this.push(f);
         this
     }
 
@@ -97,25 +107,31 @@ impl FunctionChain {
 
     pub fn append_boxed(&mut self, f: Box<dyn Function>) {
         assert_eq!(self.funcs.last().unwrap().m(), f.n());
+        self.push(f);
+    }
+
+    fn push(&mut self, f: Box<dyn Function>) {
+        let idx = self.funcs.len();
+        let len = f.chain().map_or(1, |chain| chain.len());
+        self.nodes.extend((0..len).map(|inner| (idx, inner)));
         self.funcs.push(f);
     }
 
     pub fn iter(&self) -> impl std::iter::Iterator<Item = &dyn Function> {
-        self.funcs.iter().flat_map(|f| {
-            let iter: Box<dyn std::iter::Iterator<Item = &dyn Function>> = match f.chain() {
-                Some(chain) => Box::new(chain.iter()),
-                None => Box::new(std::iter::once(&**f)),
-            };
-            iter
-        })
+        (0..self.len()).map(move |idx| self.nth(idx))
     }
 
     pub fn len(&self) -> usize {
-        self.iter().count()
+        self.nodes.len()
     }
 
     pub fn nth(&self, idx: usize) -> &dyn Function {
-        self.iter().nth(idx).unwrap()
+        let (outer, inner) = self.nodes[idx];
+        let func = &*self.funcs[outer];
+        match func.chain() {
+            Some(chain) => chain.nth(inner),
+            None => func,
+        }
     }
 }
 
@@ -213,6 +229,19 @@ mod tests {
         assert!((y[0].value() - 10.0).abs() < std::f64::EPSILON);
     }
 
+    #[test]
+    fn function_chain_nested() {
+        let mut inner = FunctionChain::new(adv_fn_obj!(five_to_two));
+        inner.append(adv_fn_obj!(two_to_one));
+        let mut chain = FunctionChain::new(adv_fn_obj!(ten_to_five));
+        chain.append(inner);
+
+        assert_eq!(chain.len(), 3);
+        let dims = chain.iter().map(|f| (f.n(), f.m())).collect::<Vec<_>>();
+        assert_eq!(dims, vec![(10, 5), (5, 2), (2, 1)]);
+        assert_eq!(chain.nth(2).n(), 2);
+    }
+
     #[test]
     fn function_chain_eval_float() {
         let mut chain = FunctionChain::new(adv_fn_obj!(ten_to_five));
@@ -1,3 +1,5 @@
+#[cfg(unix)]
+extern crate libc;
 extern crate nalgebra;
 extern crate num;
 #[doc(hidden)]
@@ -22,21 +24,51 @@ pub use acontext::*;
 mod afloat;
 pub use afloat::*;
 
+mod compact_tape;
+pub use compact_tape::*;
+
+mod compiled_tape;
+pub use compiled_tape::*;
+
 #[cfg(feature = "ffi")]
 pub mod ffi;
 
 mod function;
 pub use function::*;
 
+mod mapped_tape;
+pub use mapped_tape::*;
+
 mod operation;
 pub use operation::*;
 
+mod optimize;
+pub use optimize::*;
+
+pub mod profile;
+use profile::{Counter, Timer};
+
+mod replay_tape;
+pub use replay_tape::*;
+
 mod scalar;
 pub use scalar::*;
 
+mod single_tape;
+pub use single_tape::*;
+
+mod sparse;
+pub use sparse::*;
+
+mod stream_tape;
+pub use stream_tape::*;
+
 mod tape;
 pub use tape::*;
 
+mod workspace;
+pub use workspace::*;
+
 /// Default imports that all projects using this crate should have in scope
 pub mod prelude {
     pub use super::Function as _;
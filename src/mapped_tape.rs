@@ -0,0 +1,384 @@
+use super::*;
+use std::fmt;
+use std::fs::File;
+use std::io::{self, BufWriter, Write};
+use std::path::Path;
+use std::sync::Arc;
+
+/// Magic bytes at the start of a tape file
+const MAGIC: &[u8; 8] = b"ADVTAPE\0";
+
+/// Version of the tape file format
+pub const TAPE_FORMAT_VERSION: u32 = 1;
+
+/// Size of the file header in bytes
+///
+/// The header holds the magic bytes, the format version, a reserved word and the number of
+/// independents, dependents, values and operations as little endian `u64`. It is followed by the
+/// independents, dependents and values as 8 byte words and the operations encoded like in a
+/// `StreamTape`.
+const HEADER_BYTES: usize = 48;
+
+fn invalid_data(msg: &str) -> io::Error {
+    io::Error::new(io::ErrorKind::InvalidData, msg)
+}
+
+/// Read-only mapping of a file
+#[cfg(unix)]
+struct Mapping {
+    ptr: *const u8,
+    len: usize,
+}
+
+#[cfg(unix)]
+impl Mapping {
+    fn new(file: &File) -> io::Result<Self> {
+        use std::os::unix::io::AsRawFd;
+        let len = file.metadata()?.len() as usize;
+        let ptr = unsafe {
+            libc::mmap(
+                std::ptr::null_mut(),
+                len,
+                libc::PROT_READ,
+                libc::MAP_PRIVATE,
+                file.as_raw_fd(),
+                0,
+            )
+        };
+        if ptr == libc::MAP_FAILED {
+            return Err(io::Error::last_os_error());
+        }
+        Ok(Self {
+            ptr: ptr as *const u8,
+            len,
+        })
+    }
+
+    fn bytes(&self) -> &[u8] {
+        unsafe { std::slice::from_raw_parts(self.ptr, self.len) }
+    }
+}
+
+#[cfg(unix)]
+impl Drop for Mapping {
+    fn drop(&mut self) {
+        unsafe {
+            libc::munmap(self.ptr as *mut libc::c_void, self.len);
+        }
+    }
+}
+
+// The mapping is read-only
+#[cfg(unix)]
+unsafe impl Send for Mapping {}
+#[cfg(unix)]
+unsafe impl Sync for Mapping {}
+
+/// File contents read into word-aligned memory where mapping is unavailable
+#[cfg(not(unix))]
+struct Mapping {
+    words: Vec<u64>,
+    len: usize,
+}
+
+#[cfg(not(unix))]
+impl Mapping {
+    fn new(file: &File) -> io::Result<Self> {
+        use std::io::Read;
+        let len = file.metadata()?.len() as usize;
+        let mut words = vec![0_u64; (len + 7) / 8];
+        let bytes = unsafe { std::slice::from_raw_parts_mut(words.as_mut_ptr() as *mut u8, len) };
+        (&*file).read_exact(bytes)?;
+        Ok(Self { words, len })
+    }
+
+    fn bytes(&self) -> &[u8] {
+        unsafe { std::slice::from_raw_parts(self.words.as_ptr() as *const u8, self.len) }
+    }
+}
+
+/// Tape operating directly on a memory-mapped tape file
+///
+/// Independents, dependents, operations and values are read from the mapping. The values are
+/// copied on the first write, so many processes can share one file.
+#[derive(Clone)]
+pub struct MappedTape {
+    map: Arc<Mapping>,
+    num_indeps: usize,
+    num_deps: usize,
+    num_vals: usize,
+    num_ops: usize,
+    vals: Option<Vec<f64>>,
+}
+
+impl MappedTape {
+    /// Write a tape to a file
+    pub fn save(tape: &dyn Tape, path: &Path) -> io::Result<()> {
+        let mut writer = BufWriter::new(File::create(path)?);
+        let num_ops = tape.ops_iter().count();
+        writer.write_all(MAGIC)?;
+        writer.write_all(&TAPE_FORMAT_VERSION.to_le_bytes())?;
+        writer.write_all(&0_u32.to_le_bytes())?;
+        for len in &[
+            tape.num_indeps(),
+            tape.num_deps(),
+            tape.values().len(),
+            num_ops,
+        ] {
+            writer.write_all(&(*len as u64).to_le_bytes())?;
+        }
+        for idx in tape.indeps().iter().chain(tape.deps().iter()) {
+            writer.write_all(&(*idx as u64).to_le_bytes())?;
+        }
+        for val in tape.values() {
+            writer.write_all(&val.to_le_bytes())?;
+        }
+        let mut bytes = [0; OP_BYTES];
+        for op in tape.ops_iter() {
+            encode_op(&op, &mut bytes);
+            writer.write_all(&bytes)?;
+        }
+        writer.flush()
+    }
+
+    /// Map a tape file written by `save`
+    pub fn open(path: &Path) -> io::Result<Self> {
+        if !cfg!(all(target_endian = "little", target_pointer_width = "64")) {
+            return Err(io::Error::new(
+                io::ErrorKind::Other,
+                "Mapped tapes require a 64-bit little endian target",
+            ));
+        }
+        let map = Mapping::new(&File::open(path)?)?;
+        let bytes = map.bytes();
+        if bytes.len() < HEADER_BYTES {
+            return Err(invalid_data("Tape file too short"));
+        }
+        if &bytes[..8] != MAGIC {
+            return Err(invalid_data("Not a tape file"));
+        }
+        let word = |idx: usize| {
+            let mut word = [0; 8];
+            word.copy_from_slice(&bytes[16 + 8 * idx..24 + 8 * idx]);
+            u64::from_le_bytes(word) as usize
+        };
+        let mut version = [0; 4];
+        version.copy_from_slice(&bytes[8..12]);
+        if u32::from_le_bytes(version) != TAPE_FORMAT_VERSION {
+            return Err(invalid_data("Unsupported tape format version"));
+        }
+        let (num_indeps, num_deps, num_vals, num_ops) = (word(0), word(1), word(2), word(3));
+        let expected_len = (num_indeps + num_deps + num_vals)
+            .checked_mul(8)
+            .and_then(|len| len.checked_add(num_ops.checked_mul(OP_BYTES)?))
+            .and_then(|len| len.checked_add(HEADER_BYTES));
+        if expected_len != Some(bytes.len()) {
+            return Err(invalid_data("Tape file size does not match its header"));
+        }
+        let tape = Self {
+            map: Arc::new(map),
+            num_indeps,
+            num_deps,
+            num_vals,
+            num_ops,
+            vals: None,
+        };
+        if !tape.is_consistent() {
+            return Err(invalid_data(
+                "Tape file contains invalid operations or indices",
+            ));
+        }
+        Ok(tape)
+    }
+
+    /// Whether all op codes are valid, operations have the arguments of their op code and all
+    /// indices refer to values of the tape
+    ///
+    /// Checked once on opening, so sweeps over the mapping cannot fail.
+    fn is_consistent(&self) -> bool {
+        let in_range = |idx: &usize| *idx < self.num_vals;
+        let valid_op = |op: Operation| match op.opcode {
+            OpCode::Nop => true,
+            OpCode::Const => in_range(&op.vid),
+            opcode => {
+                in_range(&op.vid)
+                    && op.arg1.iter().all(in_range)
+                    && op.arg1.is_some()
+                    && op.arg2.iter().all(in_range)
+                    && op.arg2.is_some() == opcode.is_binary()
+            }
+        };
+        self.indeps().iter().chain(self.deps().iter()).all(in_range)
+            && self
+                .ops_bytes()
+                .chunks_exact(OP_BYTES)
+                .all(|bytes| matches!(try_decode_op(bytes), Some(op) if valid_op(op)))
+    }
+
+    /// Number of operations
+    pub fn num_ops(&self) -> usize {
+        self.num_ops
+    }
+
+    /// Mapped section of 8 byte words starting `offset` words after the header
+    fn words<T>(&self, offset: usize, len: usize) -> &[T] {
+        // Sections are 8 byte aligned because the mapping is page aligned
+        let ptr = self.map.bytes()[HEADER_BYTES + 8 * offset..].as_ptr();
+        unsafe { std::slice::from_raw_parts(ptr as *const T, len) }
+    }
+
+    fn mapped_values(&self) -> &[f64] {
+        self.words(self.num_indeps + self.num_deps, self.num_vals)
+    }
+
+    fn ops_bytes(&self) -> &[u8] {
+        let offset = HEADER_BYTES + 8 * (self.num_indeps + self.num_deps + self.num_vals);
+        &self.map.bytes()[offset..]
+    }
+}
+
+impl fmt::Debug for MappedTape {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        f.debug_struct("MappedTape")
+            .field("num_indeps", &self.num_indeps)
+            .field("num_deps", &self.num_deps)
+            .field("num_vals", &self.num_vals)
+            .field("num_ops", &self.num_ops)
+            .field("copied_values", &self.vals.is_some())
+            .finish()
+    }
+}
+
+impl Tape for MappedTape {
+    fn indeps(&self) -> &[usize] {
+        self.words(0, self.num_indeps)
+    }
+
+    fn deps(&self) -> &[usize] {
+        self.words(self.num_indeps, self.num_deps)
+    }
+
+    fn values(&self) -> &[f64] {
+        match self.vals {
+            Some(ref vals) => vals,
+            None => self.mapped_values(),
+        }
+    }
+
+    fn values_mut(&mut self) -> &mut [f64] {
+        if self.vals.is_none() {
+            self.vals = Some(self.mapped_values().to_vec());
+        }
+        self.vals.as_mut().unwrap()
+    }
+
+    fn ops_iter<'a>(&'a self) -> Box<dyn DoubleEndedIterator<Item = Operation> + 'a> {
+        Box::new(self.ops_bytes().chunks_exact(OP_BYTES).map(decode_op))
+    }
+
+    fn zero_order(&mut self, x: &DVector<f64>) {
+        let mut vals = match self.vals.take() {
+            Some(vals) => vals,
+            None => self.mapped_values().to_vec(),
+        };
+        zero_order_sweep(self.ops_iter(), self.indeps(), &mut vals, x);
+        self.vals = Some(vals);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn tape_path(name: &str) -> std::path::PathBuf {
+        std::env::temp_dir().join(format!("adv-mapped-{}-{}", std::process::id(), name))
+    }
+
+    fn test_tape() -> impl Tape + Clone {
+        let mut ctx = AContext::new();
+        let x = ctx.new_indep_vec(2, 1.0);
+        let v = (x[0] * x[1]).sin() + x[0].exp();
+        ctx.set_dep(&v);
+        ctx.set_dep(&(v / x[1]));
+        ctx.set_dep(&AFloat::new(2.0, 0.0));
+        ctx.tape()
+    }
+
+    #[test]
+    fn mapped_tape_matches_tape() {
+        let path = tape_path("matches");
+        let mut tape = test_tape();
+        MappedTape::save(&tape, &path).unwrap();
+        let mut mapped = MappedTape::open(&path).unwrap();
+        std::fs::remove_file(&path).unwrap();
+
+        assert_eq!(mapped.indeps(), tape.indeps());
+        assert_eq!(mapped.deps(), tape.deps());
+        assert_eq!(mapped.values(), tape.values());
+        assert_eq!(
+            mapped.ops_iter().collect::<Vec<_>>(),
+            tape.ops_iter().collect::<Vec<_>>()
+        );
+        assert!(mapped.vals.is_none());
+
+        let shared = mapped.clone();
+        let x = adv_dvec![0.5, 2.0];
+        tape.zero_order(&x);
+        mapped.zero_order(&x);
+        assert_eq!(mapped.y(), tape.y());
+        assert_ne!(shared.y(), mapped.y());
+        let ybar = adv_dvec![1.0, -1.0, 3.0];
+        assert_eq!(
+            mapped.first_order_reverse(&ybar),
+            tape.first_order_reverse(&ybar)
+        );
+    }
+
+    #[test]
+    fn mapped_tape_rejects_invalid_files() {
+        let path = tape_path("invalid");
+        MappedTape::save(&test_tape(), &path).unwrap();
+        let mut bytes = std::fs::read(&path).unwrap();
+
+        bytes[8] = 2;
+        std::fs::write(&path, &bytes).unwrap();
+        assert!(MappedTape::open(&path).is_err());
+
+        bytes[8] = 1;
+        bytes.pop();
+        std::fs::write(&path, &bytes).unwrap();
+        assert!(MappedTape::open(&path).is_err());
+
+        // Invalid op code, out of range result, missing argument and out of range dependent
+        bytes.push(0);
+        let num_ops = test_tape().ops_iter().count();
+        let ops = bytes.len() - num_ops * OP_BYTES;
+        let mul = (ops..bytes.len())
+            .step_by(OP_BYTES)
+            .find(|pos| bytes[*pos] == OpCode::Mul as u8)
+            .unwrap();
+        let corruptions = [
+            (mul, vec![0xff]),
+            (mul + 1, vec![0xfe; 8]),
+            (mul + 17, vec![0xff; 8]),
+            (HEADER_BYTES + 8 * 2, vec![0xfe; 8]),
+        ];
+        for (pos, corruption) in corruptions.iter() {
+            let mut corrupt = bytes.clone();
+            corrupt[*pos..*pos + corruption.len()].copy_from_slice(corruption);
+            std::fs::write(&path, &corrupt).unwrap();
+            let err = MappedTape::open(&path).unwrap_err();
+            assert_eq!(err.kind(), io::ErrorKind::InvalidData);
+        }
+        std::fs::write(&path, &bytes).unwrap();
+        assert!(MappedTape::open(&path).is_ok());
+
+        // Shorter than the header
+        std::fs::write(&path, &bytes[..10]).unwrap();
+        assert!(MappedTape::open(&path).is_err());
+        std::fs::write(&path, &[]).unwrap();
+        assert!(MappedTape::open(&path).is_err());
+
+        std::fs::remove_file(&path).unwrap();
+    }
+}
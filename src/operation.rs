@@ -1,7 +1,9 @@
 use num::traits::Float;
+use std::ops::AddAssign;
 
 /// Enum of possible elementary operations
-#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+#[repr(u8)]
 pub enum OpCode {
     Nop,
     Const,
@@ -20,6 +22,40 @@ pub enum OpCode {
     Atan,
     Powf,
 }
+assert_eq_size!(OpCode, u8);
+
+impl OpCode {
+    /// Op code with the given discriminant
+    pub fn from_u8(code: u8) -> Option<OpCode> {
+        const OPCODES: [OpCode; 16] = [
+            OpCode::Nop,
+            OpCode::Const,
+            OpCode::Add,
+            OpCode::Sub,
+            OpCode::Mul,
+            OpCode::Div,
+            OpCode::Sin,
+            OpCode::Cos,
+            OpCode::Tan,
+            OpCode::Abs,
+            OpCode::Exp,
+            OpCode::Ln,
+            OpCode::Asin,
+            OpCode::Acos,
+            OpCode::Atan,
+            OpCode::Powf,
+        ];
+        OPCODES.get(code as usize).cloned()
+    }
+
+    /// Whether operations with this op code take two arguments
+    pub fn is_binary(self) -> bool {
+        matches!(
+            self,
+            OpCode::Add | OpCode::Sub | OpCode::Mul | OpCode::Div | OpCode::Powf
+        )
+    }
+}
 
 pub(crate) fn zero_order_value<S: Float>(opcode: OpCode, arg1: S, arg2: Option<S>) -> S {
     match opcode {
@@ -84,6 +120,56 @@ pub(crate) fn first_order_value<S: Float>(
     }
 }
 
+/// First partial derivatives of a smooth operation with respect to its arguments
+pub(crate) fn first_order_partials(opcode: OpCode, a1: f64, a2: Option<f64>) -> (f64, f64) {
+    match opcode {
+        OpCode::Add => (1.0, 1.0),
+        OpCode::Sub => (1.0, -1.0),
+        OpCode::Mul => (a2.unwrap(), a1),
+        OpCode::Div => {
+            let a2 = a2.unwrap();
+            (1.0 / a2, -a1 / a2.powi(2))
+        }
+        OpCode::Powf => {
+            let y = a2.unwrap();
+            (y * a1.powf(y - 1.0), a1.ln() * a1.powf(y))
+        }
+        OpCode::Abs => panic!("Abs-function encountered in first_order_partials"),
+        _ => (first_order_value(opcode, a1, None, 1.0, None), 0.0),
+    }
+}
+
+/// Second partial derivatives `(∂²/∂a1², ∂²/∂a1∂a2, ∂²/∂a2²)` of a smooth operation
+pub(crate) fn second_order_partials(opcode: OpCode, a1: f64, a2: Option<f64>) -> (f64, f64, f64) {
+    match opcode {
+        OpCode::Add | OpCode::Sub => (0.0, 0.0, 0.0),
+        OpCode::Mul => (0.0, 1.0, 0.0),
+        OpCode::Div => {
+            let a2 = a2.unwrap();
+            (0.0, -1.0 / a2.powi(2), 2.0 * a1 / a2.powi(3))
+        }
+        OpCode::Sin => (-a1.sin(), 0.0, 0.0),
+        OpCode::Cos => (-a1.cos(), 0.0, 0.0),
+        OpCode::Tan => (2.0 * a1.tan() / a1.cos().powi(2), 0.0, 0.0),
+        OpCode::Exp => (a1.exp(), 0.0, 0.0),
+        OpCode::Ln => (-1.0 / a1.powi(2), 0.0, 0.0),
+        OpCode::Asin => (a1 / (1.0 - a1.powi(2)).powf(1.5), 0.0, 0.0),
+        OpCode::Acos => (-a1 / (1.0 - a1.powi(2)).powf(1.5), 0.0, 0.0),
+        OpCode::Atan => (-2.0 * a1 / (1.0 + a1.powi(2)).powi(2), 0.0, 0.0),
+        OpCode::Powf => {
+            let y = a2.unwrap();
+            let ln = a1.ln();
+            (
+                y * (y - 1.0) * a1.powf(y - 2.0),
+                a1.powf(y - 1.0) * (1.0 + y * ln),
+                ln.powi(2) * a1.powf(y),
+            )
+        }
+        OpCode::Abs => panic!("Abs-function encountered in second_order_partials"),
+        _ => panic!("Invalid opcode in second_order_partials"),
+    }
+}
+
 /// Representation of a single elementary operation and inputs and output
 #[derive(Debug, Clone, Copy, PartialEq)]
 pub struct Operation {
@@ -242,7 +328,7 @@ impl Operation {
         }
     }
 
-    pub fn zero_order(self, v: &mut [f64]) {
+    pub fn zero_order<S: Float>(self, v: &mut [S]) {
         match self.opcode {
             OpCode::Nop => {}
             OpCode::Const => {}
@@ -253,11 +339,11 @@ impl Operation {
         }
     }
 
-    pub fn first_order(self, v: &[f64], dv: &mut [f64]) {
+    pub fn first_order<S: Float>(self, v: &[S], dv: &mut [S]) {
         match self.opcode {
             OpCode::Nop => {}
             OpCode::Const => {
-                dv[self.vid] = 0.0;
+                dv[self.vid] = S::zero();
             }
             _ => {
                 dv[self.vid] = first_order_value(
@@ -271,10 +357,19 @@ impl Operation {
         }
     }
 
-    pub fn first_order_reverse(self, v: &[f64], vbar: &mut [f64]) {
+    /// Adjoint propagation with values of type `V` and adjoints of type `A`
+    ///
+    /// Values are widened to `A` before the partial derivatives are taken, so single precision
+    /// values can be combined with double precision adjoints.
+    pub fn first_order_reverse<V, A>(self, v: &[V], vbar: &mut [A])
+    where
+        V: Float + Into<A>,
+        A: Float + AddAssign,
+    {
         // ∂s/∂v_i = sum_j ∂s/∂v_j * ∂v_j/∂v_i  + ...
         // vbar_i := ∂s/∂v_i
         // => vbar_i = sum_j vbar_j * ∂v_j/∂v_i
+        let val = |idx: Option<usize>| -> A { v[idx.unwrap()].into() };
         match self.opcode {
             OpCode::Nop => {}
             OpCode::Const => {}
@@ -283,43 +378,47 @@ impl Operation {
                 // =>
                 // vbar_j += vbar_i * ∂v_i/∂v_j = vbar_i
                 // vbar_k += vbar_i * ∂v_i/∂v_k = vbar_i
-                vbar[self.arg1.unwrap()] += vbar[self.vid];
-                vbar[self.arg2.unwrap()] += vbar[self.vid];
+                let vbar_i = vbar[self.vid];
+                vbar[self.arg1.unwrap()] += vbar_i;
+                vbar[self.arg2.unwrap()] += vbar_i;
             }
             OpCode::Sub => {
                 // v_i = v_j - v_k
                 // =>
                 // vbar_j += vbar_i * ∂v_i/∂v_j = vbar_i
                 // vbar_k += vbar_i * ∂v_i/∂v_k = -vbar_i
-                vbar[self.arg1.unwrap()] += vbar[self.vid];
-                vbar[self.arg2.unwrap()] += -vbar[self.vid];
+                let vbar_i = vbar[self.vid];
+                vbar[self.arg1.unwrap()] += vbar_i;
+                vbar[self.arg2.unwrap()] += -vbar_i;
             }
             OpCode::Mul => {
                 // v_i = v_j * v_k
                 // =>
                 // vbar_j += vbar_i * ∂v_i/∂v_j = vbar_i * v_k
                 // vbar_k += vbar_i * ∂v_i/∂v_k = vbar_i * v_j
-                vbar[self.arg1.unwrap()] += vbar[self.vid] * v[self.arg2.unwrap()];
-                vbar[self.arg2.unwrap()] += vbar[self.vid] * v[self.arg1.unwrap()];
+                let vbar_i = vbar[self.vid];
+                vbar[self.arg1.unwrap()] += vbar_i * val(self.arg2);
+                vbar[self.arg2.unwrap()] += vbar_i * val(self.arg1);
             }
             OpCode::Div => {
                 // v_i = v_j / v_k
                 // =>
                 // vbar_j += vbar_i * ∂v_i/∂v_j = vbar_i * 1/v_k
                 // vbar_k += vbar_i * ∂v_i/∂v_k = vbar_i * -v_j/(v_k^2)
-                vbar[self.arg1.unwrap()] += vbar[self.vid] * 1.0 / v[self.arg2.unwrap()];
-                vbar[self.arg2.unwrap()] +=
-                    vbar[self.vid] * (-v[self.arg1.unwrap()] / v[self.arg2.unwrap()].powi(2));
+                let vbar_i = vbar[self.vid];
+                vbar[self.arg1.unwrap()] += vbar_i * A::one() / val(self.arg2);
+                vbar[self.arg2.unwrap()] += vbar_i * (-val(self.arg1) / val(self.arg2).powi(2));
             }
             OpCode::Powf => {
                 // v_i = v_j^v_k
                 // =>
                 // vbar_j += vbar_i * ∂v_i/∂v_j = vbar_i * v_k * v_j.powf(v_k - 1)
                 // vbar_k += vbar_i * ∂v_i/∂v_k = vbar_i * v_j.ln() * v_j.powf(v_k)
-                let x = v[self.arg1.unwrap()];
-                let y = v[self.arg2.unwrap()];
-                vbar[self.arg1.unwrap()] += vbar[self.vid] * y * x.powf(y - 1.0);
-                vbar[self.arg2.unwrap()] += vbar[self.vid] * x.ln() * x.powf(y);
+                let x = val(self.arg1);
+                let y = val(self.arg2);
+                let vbar_i = vbar[self.vid];
+                vbar[self.arg1.unwrap()] += vbar_i * y * x.powf(y - A::one());
+                vbar[self.arg2.unwrap()] += vbar_i * x.ln() * x.powf(y);
             }
             OpCode::Abs => {
                 panic!("Abs-function encountered in first_order_reverse");
@@ -327,8 +426,222 @@ impl Operation {
             _ => {
                 // Unary function
                 // vbar_j += vbar_i * ∂v_i/∂v_j
-                vbar[self.arg1.unwrap()] += vbar[self.vid]
-                    * first_order_value(self.opcode, v[self.arg1.unwrap()], None, 1.0, None);
+                let vbar_i = vbar[self.vid];
+                vbar[self.arg1.unwrap()] +=
+                    vbar_i * first_order_value(self.opcode, val(self.arg1), None, A::one(), None);
+            }
+        }
+    }
+
+    /// Evaluation at `k` points stored as `v[vid * k..(vid + 1) * k]`
+    ///
+    /// Produces the same values as `zero_order` for each point. Arguments must precede the result
+    /// on the tape.
+    pub fn zero_order_vector(self, v: &mut [f64], k: usize) {
+        let (args, result) = v.split_at_mut(self.vid * k);
+        let result = &mut result[..k];
+        let row = |idx: Option<usize>| {
+            let idx = idx.unwrap();
+            &args[idx * k..(idx + 1) * k]
+        };
+        match self.opcode {
+            OpCode::Nop => {}
+            OpCode::Const => {}
+            OpCode::Add | OpCode::Sub | OpCode::Mul | OpCode::Div | OpCode::Powf => {
+                let (a1, a2) = (row(self.arg1), row(self.arg2));
+                let lanes = result.iter_mut().zip(a1.iter().zip(a2.iter()));
+                match self.opcode {
+                    OpCode::Add => lanes.for_each(|(r, (a1, a2))| *r = a1 + a2),
+                    OpCode::Sub => lanes.for_each(|(r, (a1, a2))| *r = a1 - a2),
+                    OpCode::Mul => lanes.for_each(|(r, (a1, a2))| *r = a1 * a2),
+                    OpCode::Div => lanes.for_each(|(r, (a1, a2))| *r = a1 / a2),
+                    _ => lanes.for_each(|(r, (a1, a2))| *r = a1.powf(*a2)),
+                }
+            }
+            OpCode::Abs => {
+                for (r, a1) in result.iter_mut().zip(row(self.arg1).iter()) {
+                    *r = a1.abs();
+                }
+            }
+            _ => {
+                let f: fn(f64) -> f64 = match self.opcode {
+                    OpCode::Sin => f64::sin,
+                    OpCode::Cos => f64::cos,
+                    OpCode::Tan => f64::tan,
+                    OpCode::Exp => f64::exp,
+                    OpCode::Ln => f64::ln,
+                    OpCode::Asin => f64::asin,
+                    OpCode::Acos => f64::acos,
+                    OpCode::Atan => f64::atan,
+                    _ => panic!("Invalid opcode in zero_order_vector"),
+                };
+                for (r, a1) in result.iter_mut().zip(row(self.arg1).iter()) {
+                    *r = f(*a1);
+                }
+            }
+        }
+    }
+
+    /// Forward propagation of `k` tangents stored as `dv[vid * k..(vid + 1) * k]`
+    ///
+    /// Produces the same values as `first_order` for each direction. Arguments must precede the
+    /// result on the tape.
+    pub fn first_order_vector(self, v: &[f64], dv: &mut [f64], k: usize) {
+        let (args, result) = dv.split_at_mut(self.vid * k);
+        let result = &mut result[..k];
+        let row = |idx: Option<usize>| {
+            let idx = idx.unwrap();
+            &args[idx * k..(idx + 1) * k]
+        };
+        match self.opcode {
+            OpCode::Nop => {}
+            OpCode::Const => {
+                for x in result.iter_mut() {
+                    *x = 0.0;
+                }
+            }
+            OpCode::Add | OpCode::Sub | OpCode::Mul | OpCode::Div | OpCode::Powf => {
+                let a1 = v[self.arg1.unwrap()];
+                let a2 = v[self.arg2.unwrap()];
+                let (d1, d2) = (row(self.arg1), row(self.arg2));
+                let lanes = result.iter_mut().zip(d1.iter().zip(d2.iter()));
+                match self.opcode {
+                    OpCode::Add => lanes.for_each(|(r, (d1, d2))| *r = d1 + d2),
+                    OpCode::Sub => lanes.for_each(|(r, (d1, d2))| *r = d1 - d2),
+                    OpCode::Mul => lanes.for_each(|(r, (d1, d2))| *r = d1 * a2 + a1 * d2),
+                    OpCode::Div => {
+                        let a2_sq = a2.powi(2);
+                        lanes.for_each(|(r, (d1, d2))| *r = (d1 * a2 - a1 * d2) / a2_sq)
+                    }
+                    _ => {
+                        let p1 = a2 * a1.powf(a2 - 1.0);
+                        let p2 = a1.ln() * a1.powf(a2);
+                        lanes.for_each(|(r, (d1, d2))| {
+                            let rv1 = if *d1 != 0.0 { p1 * d1 } else { 0.0 };
+                            let rv2 = if *d2 != 0.0 { p2 * d2 } else { 0.0 };
+                            *r = rv1 + rv2
+                        })
+                    }
+                }
+            }
+            OpCode::Abs => {
+                let a1 = v[self.arg1.unwrap()];
+                let d1 = row(self.arg1);
+                for (r, d1) in result.iter_mut().zip(d1.iter()) {
+                    *r = (a1 + d1).abs() - a1.abs();
+                }
+            }
+            OpCode::Asin | OpCode::Acos | OpCode::Atan => {
+                let a1 = v[self.arg1.unwrap()];
+                let d1 = row(self.arg1);
+                let c = match self.opcode {
+                    OpCode::Asin => (1.0 - a1.powi(2)).sqrt(),
+                    OpCode::Acos => -(1.0 - a1.powi(2)).sqrt(),
+                    _ => 1.0 + a1.powi(2),
+                };
+                for (r, d1) in result.iter_mut().zip(d1.iter()) {
+                    *r = d1 / c;
+                }
+            }
+            _ => {
+                let a1 = v[self.arg1.unwrap()];
+                let d1 = row(self.arg1);
+                let c = match self.opcode {
+                    OpCode::Sin => a1.cos(),
+                    OpCode::Cos => -a1.sin(),
+                    OpCode::Tan => 1.0 / a1.cos().powi(2),
+                    OpCode::Exp => a1.exp(),
+                    OpCode::Ln => 1.0 / a1,
+                    _ => panic!("Invalid opcode in first_order_vector"),
+                };
+                for (r, d1) in result.iter_mut().zip(d1.iter()) {
+                    *r = d1 * c;
+                }
+            }
+        }
+    }
+
+    /// Reverse propagation of `k` adjoints stored as `vbar[vid * k..(vid + 1) * k]`
+    ///
+    /// Produces the same values as `first_order_reverse` for each direction. Arguments must
+    /// precede the result on the tape.
+    pub fn first_order_reverse_vector(self, v: &[f64], vbar: &mut [f64], k: usize) {
+        // Add `f(vbar_i)` to the adjoint of argument `idx`
+        fn update<F: Fn(f64) -> f64>(args: &mut [f64], result: &[f64], idx: usize, k: usize, f: F) {
+            for (a, r) in args[idx * k..(idx + 1) * k].iter_mut().zip(result.iter()) {
+                *a += f(*r);
+            }
+        }
+
+        let (args, result) = vbar.split_at_mut(self.vid * k);
+        let result = &result[..k];
+        match self.opcode {
+            OpCode::Nop => {}
+            OpCode::Const => {}
+            OpCode::Add => {
+                update(args, result, self.arg1.unwrap(), k, |r| r);
+                update(args, result, self.arg2.unwrap(), k, |r| r);
+            }
+            OpCode::Sub => {
+                update(args, result, self.arg1.unwrap(), k, |r| r);
+                update(args, result, self.arg2.unwrap(), k, |r| -r);
+            }
+            OpCode::Mul => {
+                let a1 = v[self.arg1.unwrap()];
+                let a2 = v[self.arg2.unwrap()];
+                update(args, result, self.arg1.unwrap(), k, |r| r * a2);
+                update(args, result, self.arg2.unwrap(), k, |r| r * a1);
+            }
+            OpCode::Div => {
+                let a1 = v[self.arg1.unwrap()];
+                let a2 = v[self.arg2.unwrap()];
+                let c2 = -a1 / a2.powi(2);
+                update(args, result, self.arg1.unwrap(), k, |r| r * 1.0 / a2);
+                update(args, result, self.arg2.unwrap(), k, |r| r * c2);
+            }
+            OpCode::Powf => {
+                let x = v[self.arg1.unwrap()];
+                let y = v[self.arg2.unwrap()];
+                let c1 = x.powf(y - 1.0);
+                let c2 = x.ln();
+                let c3 = x.powf(y);
+                update(args, result, self.arg1.unwrap(), k, |r| r * y * c1);
+                update(args, result, self.arg2.unwrap(), k, |r| r * c2 * c3);
+            }
+            OpCode::Abs => {
+                panic!("Abs-function encountered in first_order_reverse_vector");
+            }
+            _ => {
+                let c = first_order_value(self.opcode, v[self.arg1.unwrap()], None, 1.0, None);
+                update(args, result, self.arg1.unwrap(), k, |r| r * c);
+            }
+        }
+    }
+
+    /// Reverse propagation of first-order adjoints and their tangents
+    ///
+    /// `dv` holds the tangents of the values and `dvbar` receives the tangents of the adjoints
+    /// `vbar`, i.e. the second-order adjoints of forward-over-reverse differentiation.
+    pub fn second_order_reverse(self, v: &[f64], dv: &[f64], vbar: &mut [f64], dvbar: &mut [f64]) {
+        match self.opcode {
+            OpCode::Nop => {}
+            OpCode::Const => {}
+            _ => {
+                let i1 = self.arg1.unwrap();
+                let a1 = v[i1];
+                let a2 = self.arg2.map(|i| v[i]);
+                let (p1, p2) = first_order_partials(self.opcode, a1, a2);
+                let (h11, h12, h22) = second_order_partials(self.opcode, a1, a2);
+                let r = vbar[self.vid];
+                let dr = dvbar[self.vid];
+                let da1 = dv[i1];
+                let da2 = self.arg2.map_or(0.0, |i| dv[i]);
+                vbar[i1] += r * p1;
+                dvbar[i1] += dr * p1 + r * (h11 * da1 + h12 * da2);
+                if let Some(i2) = self.arg2 {
+                    vbar[i2] += r * p2;
+                    dvbar[i2] += dr * p2 + r * (h12 * da1 + h22 * da2);
+                }
             }
         }
     }
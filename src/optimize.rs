@@ -0,0 +1,244 @@
+use super::*;
+use std::collections::HashMap;
+use std::sync::Arc;
+
+/// Operation of the intermediate tape built while optimizing
+#[derive(Debug, Clone, Copy)]
+struct Node {
+    opcode: OpCode,
+    arg1: Option<usize>,
+    arg2: Option<usize>,
+    value: f64,
+}
+
+/// Value numbering state of the forward pass
+#[derive(Default)]
+struct Builder {
+    nodes: Vec<Node>,
+    consts: HashMap<u64, usize>,
+    exprs: HashMap<(OpCode, Option<usize>, Option<usize>), usize>,
+}
+
+impl Builder {
+    fn push(&mut self, node: Node) -> usize {
+        self.nodes.push(node);
+        self.nodes.len() - 1
+    }
+
+    fn constant(&mut self, value: f64) -> usize {
+        if let Some(id) = self.consts.get(&value.to_bits()) {
+            return *id;
+        }
+        let id = self.push(Node {
+            opcode: OpCode::Const,
+            arg1: None,
+            arg2: None,
+            value,
+        });
+        self.consts.insert(value.to_bits(), id);
+        id
+    }
+
+    fn is_const(&self, id: usize) -> bool {
+        self.nodes[id].opcode == OpCode::Const
+    }
+
+    fn operation(&mut self, opcode: OpCode, arg1: usize, arg2: Option<usize>, value: f64) -> usize {
+        // Fold operations on constants
+        if self.is_const(arg1) && arg2.map_or(true, |arg2| self.is_const(arg2)) {
+            let value = zero_order_value(
+                opcode,
+                self.nodes[arg1].value,
+                arg2.map(|arg2| self.nodes[arg2].value),
+            );
+            return self.constant(value);
+        }
+
+        // Reuse a common subexpression
+        let key = match (opcode, arg2) {
+            (OpCode::Add, Some(arg2)) | (OpCode::Mul, Some(arg2)) if arg2 < arg1 => {
+                (opcode, Some(arg2), Some(arg1))
+            }
+            _ => (opcode, Some(arg1), arg2),
+        };
+        if let Some(id) = self.exprs.get(&key) {
+            return *id;
+        }
+        let id = self.push(Node {
+            opcode,
+            arg1: Some(arg1),
+            arg2,
+            value,
+        });
+        self.exprs.insert(key, id);
+        id
+    }
+}
+
+/// Create a smaller tape that evaluates the same function as `tape`
+///
+/// Constants are deduplicated, operations on constants are folded, common subexpressions are
+/// merged and operations that do not influence a dependent are dropped. The result uses dense
+/// value ids with the independents in the first slots.
+pub fn optimize_tape(tape: &dyn Tape) -> impl Tape + Clone {
+    let values = tape.values();
+    let mut builder = Builder::default();
+    let mut map = HashMap::new();
+    for vid in tape.indeps() {
+        let id = builder.push(Node {
+            opcode: OpCode::Nop,
+            arg1: None,
+            arg2: None,
+            value: values[*vid],
+        });
+        map.insert(*vid, id);
+    }
+
+    // Slots without a defining operation hold values that never change
+    let lookup =
+        |builder: &mut Builder, map: &HashMap<usize, usize>, vid: usize| match map.get(&vid) {
+            Some(id) => *id,
+            None => builder.constant(values[vid]),
+        };
+
+    for op in tape.ops_iter() {
+        let id = match op.opcode {
+            OpCode::Nop => continue,
+            OpCode::Const => builder.constant(values[op.vid]),
+            _ => {
+                let arg1 = lookup(&mut builder, &map, op.arg1.unwrap());
+                let arg2 = op.arg2.map(|arg2| lookup(&mut builder, &map, arg2));
+                builder.operation(op.opcode, arg1, arg2, values[op.vid])
+            }
+        };
+        map.insert(op.vid, id);
+    }
+    let deps = tape
+        .deps()
+        .iter()
+        .map(|vid| lookup(&mut builder, &map, *vid))
+        .collect::<Vec<_>>();
+
+    // Mark everything the dependents and independents rely on
+    let nodes = builder.nodes;
+    let num_indeps = tape.num_indeps();
+    let mut live = vec![false; nodes.len()];
+    for id in (0..num_indeps).chain(deps.iter().cloned()) {
+        live[id] = true;
+    }
+    for id in (0..nodes.len()).rev() {
+        if live[id] {
+            for arg in nodes[id].arg1.iter().chain(nodes[id].arg2.iter()) {
+                live[*arg] = true;
+            }
+        }
+    }
+
+    // Renumber the live nodes densely
+    let mut new_ids = vec![0; nodes.len()];
+    let mut ops = Vec::new();
+    let mut vals = Vec::new();
+    for (id, node) in nodes.iter().enumerate().filter(|(id, _)| live[*id]) {
+        let vid = vals.len();
+        new_ids[id] = vid;
+        vals.push(node.value);
+        if node.opcode != OpCode::Nop {
+            ops.push(Operation {
+                opcode: node.opcode,
+                vid,
+                arg1: node.arg1.map(|arg| new_ids[arg]),
+                arg2: node.arg2.map(|arg| new_ids[arg]),
+            });
+        }
+    }
+
+    AContextTape {
+        indeps: (0..num_indeps).collect(),
+        deps: deps.into_iter().map(|id| new_ids[id]).collect(),
+        ops: Arc::new(ops),
+        vals,
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn redundant_func_tape() -> impl Tape {
+        let mut ctx = AContext::new();
+        let x = ctx.new_indep_vec(2, 0.0);
+        let zero = ADouble::from(0.0);
+        let _unused = x[0].sin() * x[1];
+        let v1 = x[0].max(zero).min(ADouble::from(1.0));
+        let v2 = x[0].max(zero) * 2.0 + (x[1] * 2.0 + 1.0).exp();
+        let v3 = x[1] * x[0] + x[0] * x[1];
+        ctx.set_dep_slice(&[v1, v2, v3]);
+        ctx.tape()
+    }
+
+    #[test]
+    fn optimize_tape_removes_ops() {
+        let tape = redundant_func_tape();
+        let optimized = optimize_tape(&tape);
+        assert!(optimized.ops_iter().count() < tape.ops_iter().count());
+        assert!(optimized.num_abs() < tape.num_abs());
+        assert_eq!(optimized.num_indeps(), tape.num_indeps());
+        assert_eq!(optimized.num_deps(), tape.num_deps());
+
+        // Every constant is stored once
+        let mut consts = optimized
+            .ops_iter()
+            .filter(|op| op.opcode == OpCode::Const)
+            .map(|op| optimized.values()[op.vid].to_bits())
+            .collect::<Vec<_>>();
+        let num_consts = consts.len();
+        consts.sort();
+        consts.dedup();
+        assert_eq!(consts.len(), num_consts);
+
+        // Value ids are dense and ordered
+        for (op, vid) in optimized.ops_iter().zip(tape.num_indeps()..) {
+            assert_eq!(op.vid, vid);
+        }
+        assert_eq!(optimized.values().len(), optimized.max_id() + 1);
+    }
+
+    #[test]
+    fn optimize_tape_preserves_function() {
+        let mut tape = redundant_func_tape();
+        let mut optimized = optimize_tape(&tape);
+        assert_eq!(optimized.y(), tape.y());
+        for x in &[
+            adv_dvec![0.5, 2.0],
+            adv_dvec![-1.0, 0.3],
+            adv_dvec![3.0, -0.7],
+        ] {
+            tape.zero_order(x);
+            optimized.zero_order(x);
+            assert_eq!(optimized.y(), tape.y());
+            let dx = adv_dvec![1.0, -2.0];
+            assert_eq!(
+                optimized.first_order_forward(&dx),
+                tape.first_order_forward(&dx)
+            );
+        }
+    }
+
+    #[test]
+    fn optimize_tape_folds_constants() {
+        // y = x + 2 * 3
+        let ops = [
+            Operation::constant(1),
+            Operation::constant(2),
+            Operation::mul(3, 1, 2),
+            Operation::add(4, 0, 3),
+        ];
+        let tape = CompactTape::new(vec![0], vec![4], &ops, vec![1.0, 2.0, 3.0, 6.0, 7.0]);
+        let optimized = optimize_tape(&tape);
+        assert_eq!(
+            optimized.ops_iter().collect::<Vec<_>>(),
+            vec![Operation::constant(1), Operation::add(2, 0, 1)]
+        );
+        assert_eq!(optimized.values(), &[1.0, 6.0, 7.0]);
+    }
+}
@@ -0,0 +1,446 @@
+//! Opt-in counters and timers for finding hot spots
+//!
+//! Profiling is disabled by default. While disabled every instrumented call site costs a single
+//! relaxed atomic load. All counters are process-wide and shared by all threads.
+use super::*;
+use std::fmt::Write;
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use std::time::Instant;
+
+/// Number of op codes
+const NUM_OPCODES: usize = 16;
+
+static ENABLED: AtomicBool = AtomicBool::new(false);
+
+/// Event counted while profiling is enabled
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Counter {
+    /// Tapes taken from a context
+    RecordedTapes,
+    /// Bytes of the tapes taken from a context
+    RecordedBytes,
+    /// Abs-Normal Forms built from scratch
+    AbsNormalForms,
+    /// Abs-Normal Forms updated in place
+    AbsNormalUpdates,
+    /// Re-evaluations of abs-normal tapes
+    AbsNormalRetapes,
+    /// Checkpoints stored while reversing a sequence
+    Checkpoints,
+    /// Forward steps taken while reversing a sequence, including recomputations
+    CheckpointForwards,
+    /// Reverse steps taken while reversing a sequence
+    CheckpointReverses,
+}
+
+const COUNTERS: [Counter; 8] = [
+    Counter::RecordedTapes,
+    Counter::RecordedBytes,
+    Counter::AbsNormalForms,
+    Counter::AbsNormalUpdates,
+    Counter::AbsNormalRetapes,
+    Counter::Checkpoints,
+    Counter::CheckpointForwards,
+    Counter::CheckpointReverses,
+];
+
+impl Counter {
+    /// Name of the counter in reports
+    pub fn name(self) -> &'static str {
+        match self {
+            Counter::RecordedTapes => "recorded_tapes",
+            Counter::RecordedBytes => "recorded_bytes",
+            Counter::AbsNormalForms => "abs_normal_forms",
+            Counter::AbsNormalUpdates => "abs_normal_updates",
+            Counter::AbsNormalRetapes => "abs_normal_retapes",
+            Counter::Checkpoints => "checkpoints",
+            Counter::CheckpointForwards => "checkpoint_forwards",
+            Counter::CheckpointReverses => "checkpoint_reverses",
+        }
+    }
+}
+
+/// Phase timed while profiling is enabled
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Timer {
+    /// From the first recorded operation of a context until its tape is taken
+    Record,
+    /// Zero order sweeps
+    ZeroOrder,
+    /// First order forward sweeps
+    Forward,
+    /// First order reverse sweeps
+    Reverse,
+    /// Second order reverse sweeps
+    SecondOrder,
+    /// Construction and updates of Abs-Normal Forms
+    AbsNormal,
+}
+
+const TIMERS: [Timer; 6] = [
+    Timer::Record,
+    Timer::ZeroOrder,
+    Timer::Forward,
+    Timer::Reverse,
+    Timer::SecondOrder,
+    Timer::AbsNormal,
+];
+
+impl Timer {
+    /// Name of the timer in reports
+    pub fn name(self) -> &'static str {
+        match self {
+            Timer::Record => "record",
+            Timer::ZeroOrder => "zero_order",
+            Timer::Forward => "forward",
+            Timer::Reverse => "reverse",
+            Timer::SecondOrder => "second_order",
+            Timer::AbsNormal => "abs_normal",
+        }
+    }
+}
+
+#[allow(clippy::declare_interior_mutable_const)]
+const ZERO: AtomicU64 = AtomicU64::new(0);
+
+static COUNTS: [AtomicU64; 8] = [ZERO; 8];
+static OPCODE_COUNTS: [AtomicU64; NUM_OPCODES] = [ZERO; NUM_OPCODES];
+static TIMER_CALLS: [AtomicU64; 6] = [ZERO; 6];
+static TIMER_NANOS: [AtomicU64; 6] = [ZERO; 6];
+
+/// Start collecting counters and timers
+pub fn enable() {
+    ENABLED.store(true, Ordering::Relaxed);
+}
+
+/// Stop collecting counters and timers
+///
+/// Collected values are kept until `reset` is called.
+pub fn disable() {
+    ENABLED.store(false, Ordering::Relaxed);
+}
+
+/// Whether counters and timers are collected
+#[inline]
+pub fn is_enabled() -> bool {
+    ENABLED.load(Ordering::Relaxed)
+}
+
+/// Set all counters and timers to zero
+pub fn reset() {
+    for count in COUNTS
+        .iter()
+        .chain(OPCODE_COUNTS.iter())
+        .chain(TIMER_CALLS.iter())
+        .chain(TIMER_NANOS.iter())
+    {
+        count.store(0, Ordering::Relaxed);
+    }
+}
+
+/// Add `n` to `counter`
+#[inline]
+pub fn count(counter: Counter, n: u64) {
+    if is_enabled() {
+        COUNTS[counter as usize].fetch_add(n, Ordering::Relaxed);
+    }
+}
+
+/// Count a recorded operation
+#[inline]
+pub(crate) fn count_op(opcode: OpCode) {
+    if is_enabled() {
+        OPCODE_COUNTS[opcode as usize].fetch_add(1, Ordering::Relaxed);
+    }
+}
+
+/// Add the time elapsed since `start` to `timer`
+pub fn add_time(timer: Timer, start: Instant) {
+    TIMER_CALLS[timer as usize].fetch_add(1, Ordering::Relaxed);
+    TIMER_NANOS[timer as usize].fetch_add(start.elapsed().as_nanos() as u64, Ordering::Relaxed);
+}
+
+/// Guard adding the time until it is dropped to a timer
+#[derive(Debug)]
+pub struct TimerGuard {
+    timer: Timer,
+    start: Instant,
+}
+
+impl Drop for TimerGuard {
+    fn drop(&mut self) {
+        add_time(self.timer, self.start);
+    }
+}
+
+/// Time the current scope with `timer` if profiling is enabled
+#[inline]
+pub fn time(timer: Timer) -> Option<TimerGuard> {
+    if is_enabled() {
+        Some(TimerGuard {
+            timer,
+            start: Instant::now(),
+        })
+    } else {
+        None
+    }
+}
+
+/// Number of calls and accumulated time of a timer
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct TimerStats {
+    pub calls: u64,
+    pub nanos: u64,
+}
+
+/// Copy of all counters and timers
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct Report {
+    /// Recorded operations per op code
+    pub opcodes: [u64; NUM_OPCODES],
+    counts: [u64; 8],
+    timers: [TimerStats; 6],
+}
+
+impl Report {
+    /// Value of `counter`
+    pub fn counter(&self, counter: Counter) -> u64 {
+        self.counts[counter as usize]
+    }
+
+    /// Calls and time of `timer`
+    pub fn timer(&self, timer: Timer) -> TimerStats {
+        self.timers[timer as usize]
+    }
+
+    /// Total number of recorded operations
+    pub fn recorded_ops(&self) -> u64 {
+        self.opcodes.iter().sum()
+    }
+
+    /// Report as a JSON object
+    pub fn to_json(&self) -> String {
+        let mut json = format!(
+            "{{\"enabled\":{},\"recorded_ops\":{},\"opcodes\":",
+            is_enabled(),
+            self.recorded_ops()
+        );
+        write_opcodes(&mut json, &self.opcodes);
+        json.push_str(",\"counters\":{");
+        for (idx, counter) in COUNTERS.iter().enumerate() {
+            if idx > 0 {
+                json.push(',');
+            }
+            write!(json, "\"{}\":{}", counter.name(), self.counter(*counter)).unwrap();
+        }
+        json.push_str("},\"timers\":{");
+        for (idx, timer) in TIMERS.iter().enumerate() {
+            if idx > 0 {
+                json.push(',');
+            }
+            let stats = self.timer(*timer);
+            write!(
+                json,
+                "\"{}\":{{\"calls\":{},\"nanos\":{}}}",
+                timer.name(),
+                stats.calls,
+                stats.nanos
+            )
+            .unwrap();
+        }
+        json.push_str("}}");
+        json
+    }
+}
+
+/// Copy the current counters and timers
+pub fn report() -> Report {
+    let load = |count: &AtomicU64| count.load(Ordering::Relaxed);
+    let mut report = Report {
+        opcodes: [0; NUM_OPCODES],
+        counts: [0; 8],
+        timers: [TimerStats::default(); 6],
+    };
+    for (dst, src) in report.opcodes.iter_mut().zip(OPCODE_COUNTS.iter()) {
+        *dst = load(src);
+    }
+    for (dst, src) in report.counts.iter_mut().zip(COUNTS.iter()) {
+        *dst = load(src);
+    }
+    for (idx, dst) in report.timers.iter_mut().enumerate() {
+        dst.calls = load(&TIMER_CALLS[idx]);
+        dst.nanos = load(&TIMER_NANOS[idx]);
+    }
+    report
+}
+
+/// Write a JSON object mapping the names of the op codes with nonzero counts to their counts
+fn write_opcodes(json: &mut String, counts: &[u64; NUM_OPCODES]) {
+    json.push('{');
+    let mut first = true;
+    for (code, count) in counts.iter().enumerate().filter(|(_, count)| **count > 0) {
+        if !first {
+            json.push(',');
+        }
+        first = false;
+        let opcode = OpCode::from_u8(code as u8).unwrap();
+        write!(json, "\"{:?}\":{}", opcode, count).unwrap();
+    }
+    json.push('}');
+}
+
+/// Static statistics of a tape
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct TapeStats {
+    pub num_indeps: usize,
+    pub num_deps: usize,
+    pub num_values: usize,
+    pub num_ops: usize,
+    /// Operations per op code
+    pub opcodes: [u64; NUM_OPCODES],
+    /// Bytes of the independents, dependents, operations and values
+    pub bytes: usize,
+    /// Largest number of values that are live at the same time during a zero order sweep
+    ///
+    /// A value is live from its assignment until its last use. Independents are live from the
+    /// start and dependents until the end.
+    pub peak_live_values: usize,
+}
+
+impl TapeStats {
+    pub fn from_tape(tape: &dyn Tape) -> Self {
+        let len = tape.values().len();
+        let mut opcodes = [0; NUM_OPCODES];
+        let mut num_ops = 0;
+
+        // Position of the last use of every value, `num_ops` for the dependents
+        let mut last_use = vec![None; len];
+        for (pos, op) in tape.ops_iter().enumerate() {
+            opcodes[op.opcode as usize] += 1;
+            num_ops += 1;
+            for arg in op.arg1.iter().chain(op.arg2.iter()) {
+                last_use[*arg] = Some(pos);
+            }
+        }
+        for vid in tape.deps() {
+            last_use[*vid] = Some(num_ops);
+        }
+
+        let mut live = vec![false; len];
+        let mut num_live = 0;
+        for vid in tape.indeps() {
+            if !live[*vid] {
+                live[*vid] = true;
+                num_live += 1;
+            }
+        }
+        let mut peak_live_values = num_live;
+        for (pos, op) in tape.ops_iter().enumerate() {
+            if op.opcode != OpCode::Nop && !live[op.vid] {
+                live[op.vid] = true;
+                num_live += 1;
+            }
+            peak_live_values = peak_live_values.max(num_live);
+            for vid in op.arg1.iter().chain(op.arg2.iter()).chain(Some(&op.vid)) {
+                if live[*vid] && last_use[*vid].map_or(true, |last| last <= pos) {
+                    live[*vid] = false;
+                    num_live -= 1;
+                }
+            }
+        }
+
+        let word = std::mem::size_of::<usize>();
+        Self {
+            num_indeps: tape.num_indeps(),
+            num_deps: tape.num_deps(),
+            num_values: len,
+            num_ops,
+            opcodes,
+            bytes: (tape.num_indeps() + tape.num_deps()) * word
+                + std::mem::size_of_val(tape.values())
+                + num_ops * std::mem::size_of::<Operation>(),
+            peak_live_values,
+        }
+    }
+
+    /// Statistics as a JSON object
+    pub fn to_json(&self) -> String {
+        let mut json = format!(
+            "{{\"num_indeps\":{},\"num_deps\":{},\"num_values\":{},\"num_ops\":{},\"bytes\":{},\
+             \"peak_live_values\":{},\"opcodes\":",
+            self.num_indeps,
+            self.num_deps,
+            self.num_values,
+            self.num_ops,
+            self.bytes,
+            self.peak_live_values
+        );
+        write_opcodes(&mut json, &self.opcodes);
+        json.push('}');
+        json
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn tape_stats_peak_live_values() {
+        let mut ctx = AContext::new();
+        let x = ctx.new_indep_vec(3, 1.0);
+        // Every partial sum dies with the next operation
+        let y = x[0].sin() + x[1].sin() + x[2].sin();
+        ctx.set_dep(&y);
+        let tape = ctx.tape();
+        let stats = TapeStats::from_tape(&tape);
+        assert_eq!(stats.num_ops, 5);
+        assert_eq!(stats.opcodes[OpCode::Sin as usize], 3);
+        assert_eq!(stats.opcodes[OpCode::Add as usize], 2);
+        assert_eq!(stats.peak_live_values, 4);
+        assert_eq!(
+            stats.bytes,
+            4 * std::mem::size_of::<usize>() + 8 * 8 + 5 * std::mem::size_of::<Operation>()
+        );
+        assert!(stats
+            .to_json()
+            .contains("\"opcodes\":{\"Add\":2,\"Sin\":3}"));
+    }
+
+    #[test]
+    fn profile_counts_and_times() {
+        reset();
+        let mut ctx = AContext::new();
+        let x = ctx.new_indep_vec(2, 1.0);
+        ctx.set_dep(&(x[0] * x[1]).sin());
+        assert_eq!(report().recorded_ops(), 0);
+
+        enable();
+        let mut ctx = AContext::new();
+        let x = ctx.new_indep_vec(2, 1.0);
+        ctx.set_dep(&(x[0] * x[1]).sin());
+        let mut tape = ctx.tape();
+        tape.zero_order(&adv_dvec![2.0, 3.0]);
+        tape.first_order_reverse(&adv_dvec![1.0]);
+        tape.first_order_reverse(&adv_dvec![1.0]);
+        let result = drivers::reverse_sequence(0, 5, 3, |x| x + 1, |x, r| r + x, |x| x);
+        disable();
+        tape.zero_order(&adv_dvec![2.0, 3.0]);
+
+        // Tests running concurrently may add to the counters while profiling is enabled
+        let report = report();
+        assert_eq!(result, 15);
+        assert!(report.opcodes[OpCode::Mul as usize] >= 1);
+        assert!(report.opcodes[OpCode::Sin as usize] >= 1);
+        assert!(report.counter(Counter::RecordedTapes) >= 1);
+        assert!(report.timer(Timer::Record).calls >= 1);
+        assert!(report.timer(Timer::ZeroOrder).calls >= 1);
+        assert!(report.timer(Timer::Reverse).calls >= 2);
+        assert!(report.counter(Counter::CheckpointReverses) >= 6);
+        assert!(report.counter(Counter::CheckpointForwards) > 5);
+        let json = report.to_json();
+        assert!(json.starts_with("{\"enabled\":false,\"recorded_ops\":"));
+        assert!(json.contains("\"timers\":{\"record\":{\"calls\":"));
+        reset();
+    }
+}
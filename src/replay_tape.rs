@@ -0,0 +1,282 @@
+use super::*;
+use std::collections::HashMap;
+
+/// Tape for zero order and forward sweeps that reuses the slots of dead values
+///
+/// Every value gets a slot only from its definition until its last use, so the value and tangent
+/// arrays need about as many slots as values are live at the same time instead of one per
+/// operation. Constants occupy slots of their own, one per distinct value. The values of
+/// intermediates are overwritten during a sweep, so reverse sweeps are not supported and need the
+/// tape the replay tape was created from.
+#[derive(Debug, Clone)]
+pub struct ReplayTape {
+    indeps: Vec<usize>,
+    deps: Vec<usize>,
+    ops: Vec<Operation>,
+    vals: Vec<f64>,
+}
+
+impl ReplayTape {
+    /// Allocate the slots of the values of `tape`
+    ///
+    /// Operations that do not influence a dependent are dropped.
+    pub fn from_tape(tape: &dyn Tape) -> Self {
+        let values = tape.values();
+        let len = values.len();
+        let ops = tape
+            .ops_iter()
+            .filter(|op| op.opcode != OpCode::Nop)
+            .collect::<Vec<_>>();
+
+        // Operations whose result reaches a dependent
+        let mut live = vec![false; len];
+        for vid in tape.deps() {
+            live[*vid] = true;
+        }
+        let mut needed = vec![false; ops.len()];
+        for (pos, op) in ops.iter().enumerate().rev() {
+            needed[pos] = live[op.vid];
+            live[op.vid] = false;
+            if needed[pos] {
+                for arg in op.arg1.iter().chain(op.arg2.iter()) {
+                    live[*arg] = true;
+                }
+            }
+        }
+
+        // Definition `d < len` is the initial content of slot `d` and `len + pos` is the result
+        // of the operation at `pos`. Initial contents other than independents never change, so
+        // they are pinned like constants.
+        let mut is_indep = vec![false; len];
+        for vid in tape.indeps() {
+            is_indep[*vid] = true;
+        }
+        let mut pinned = vec![false; len + ops.len()];
+        let mut last_use = vec![None; len + ops.len()];
+        let mut current = (0..len).collect::<Vec<_>>();
+        for (pos, op) in ops.iter().enumerate().filter(|(pos, _)| needed[*pos]) {
+            for arg in op.arg1.iter().chain(op.arg2.iter()) {
+                let def = current[*arg];
+                last_use[def] = Some(pos);
+                if def < len && !is_indep[def] {
+                    pinned[def] = true;
+                }
+            }
+            current[op.vid] = len + pos;
+            pinned[len + pos] = op.opcode == OpCode::Const;
+        }
+        for vid in tape.deps() {
+            let def = current[*vid];
+            last_use[def] = Some(ops.len());
+            if def < len && !is_indep[def] {
+                pinned[def] = true;
+            }
+        }
+
+        let mut slots = vec![0; len + ops.len()];
+        let mut vals = Vec::new();
+        let mut free = Vec::new();
+        for vid in tape.indeps() {
+            slots[*vid] = vals.len();
+            vals.push(values[*vid]);
+        }
+        for vid in tape.indeps().iter().filter(|vid| last_use[**vid].is_none()) {
+            free.push(slots[*vid]);
+        }
+        let mut consts = HashMap::new();
+        let mut constant = |vals: &mut Vec<f64>, value: f64| {
+            *consts.entry(value.to_bits()).or_insert_with(|| {
+                vals.push(value);
+                vals.len() - 1
+            })
+        };
+        for def in (0..len).filter(|def| pinned[*def]) {
+            slots[def] = constant(&mut vals, values[def]);
+        }
+
+        let mut current = (0..len).collect::<Vec<_>>();
+        let mut replay_ops = Vec::new();
+        for (pos, op) in ops.iter().enumerate().filter(|(pos, _)| needed[*pos]) {
+            let def1 = op.arg1.map(|arg| current[arg]);
+            let def2 = op.arg2.map(|arg| current[arg]);
+            // Arguments dying here free their slots before the result is allocated, because
+            // sweeps read all arguments before they write the result
+            for def in def1
+                .iter()
+                .chain(def2.iter().filter(|def| Some(**def) != def1))
+            {
+                if !pinned[*def] && last_use[*def] == Some(pos) {
+                    free.push(slots[*def]);
+                }
+            }
+            let def = len + pos;
+            current[op.vid] = def;
+            if op.opcode == OpCode::Const {
+                slots[def] = constant(&mut vals, values[op.vid]);
+                continue;
+            }
+            slots[def] = match free.pop() {
+                Some(slot) => {
+                    vals[slot] = values[op.vid];
+                    slot
+                }
+                None => {
+                    vals.push(values[op.vid]);
+                    vals.len() - 1
+                }
+            };
+            replay_ops.push(Operation {
+                opcode: op.opcode,
+                vid: slots[def],
+                arg1: def1.map(|def| slots[def]),
+                arg2: def2.map(|def| slots[def]),
+            });
+        }
+
+        Self {
+            indeps: tape.indeps().iter().map(|vid| slots[*vid]).collect(),
+            deps: tape.deps().iter().map(|vid| slots[current[*vid]]).collect(),
+            ops: replay_ops,
+            vals,
+        }
+    }
+
+    pub fn indeps(&self) -> &[usize] {
+        &self.indeps
+    }
+
+    pub fn deps(&self) -> &[usize] {
+        &self.deps
+    }
+
+    pub fn ops(&self) -> &[Operation] {
+        &self.ops
+    }
+
+    /// Current contents of the slots
+    pub fn values(&self) -> &[f64] {
+        &self.vals
+    }
+
+    pub fn num_indeps(&self) -> usize {
+        self.indeps.len()
+    }
+
+    pub fn num_deps(&self) -> usize {
+        self.deps.len()
+    }
+
+    /// Number of value slots
+    pub fn num_slots(&self) -> usize {
+        self.vals.len()
+    }
+
+    pub fn y(&self) -> DVector<f64> {
+        DVector::from_vec(self.deps.iter().map(|vid| self.vals[*vid]).collect())
+    }
+
+    /// Evaluate the tape at `x`
+    pub fn zero_order(&mut self, x: &DVector<f64>) {
+        zero_order_sweep(self.ops.iter().cloned(), &self.indeps, &mut self.vals, x);
+    }
+
+    /// Evaluate the tape at `x` and propagate the tangent `dx` alongside into `dy`
+    pub fn first_order_forward_into(
+        &mut self,
+        x: &[f64],
+        dx: &[f64],
+        dy: &mut [f64],
+        ws: &mut Workspace,
+    ) {
+        let _timer = profile::time(Timer::Forward);
+        assert_eq!(x.len(), self.indeps.len());
+        assert_eq!(dx.len(), self.indeps.len());
+        assert_eq!(dy.len(), self.deps.len());
+        let dv = ws.zeroed(self.vals.len());
+        for (idx, vid) in self.indeps.iter().enumerate() {
+            self.vals[*vid] = x[idx];
+            dv[*vid] = dx[idx];
+        }
+        for op in self.ops.iter() {
+            // The tangent comes first because the result may overwrite an argument
+            op.first_order(&self.vals, dv);
+            op.zero_order(&mut self.vals);
+        }
+        for (idx, vid) in self.deps.iter().enumerate() {
+            dy[idx] = dv[*vid];
+        }
+    }
+
+    /// Evaluate the tape at `x` and calculate the Jacobian-vector product with `dx`
+    pub fn first_order_forward(&mut self, x: &DVector<f64>, dx: &DVector<f64>) -> DVector<f64> {
+        let mut dy = DVector::zeros(self.deps.len());
+        Workspace::with_local(|ws| {
+            self.first_order_forward_into(x.as_slice(), dx.as_slice(), dy.as_mut_slice(), ws)
+        });
+        dy
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn chain_tape(n: usize) -> impl Tape {
+        let mut ctx = AContext::new();
+        let x = ctx.new_indep_vec(n, 0.5);
+        let mut v = x.clone();
+        for _ in 0..10 {
+            v = (0..n)
+                .map(|i| (v[i] * v[(i + 1) % n]).sin() + v[(i + 2) % n] / (v[i] * v[i] + 1.0))
+                .collect();
+        }
+        let _unused = v[0].exp();
+        ctx.set_dep_slice(&v);
+        ctx.set_dep(&x[1]);
+        ctx.tape()
+    }
+
+    #[test]
+    fn replay_tape_matches_tape() {
+        let n = 20;
+        let mut tape = chain_tape(n);
+        let mut replay = ReplayTape::from_tape(&tape);
+        assert_eq!(replay.y(), tape.y());
+        assert!(replay.num_slots() <= 4 * n);
+        assert!(replay.num_slots() * 10 < tape.values().len());
+
+        for k in 0..3 {
+            let x = DVector::from_fn(n, |i, _| 0.1 * (i + k) as f64 - 0.4);
+            let dx = DVector::from_fn(n, |i, _| if i % 3 == k { 1.0 } else { -0.5 });
+            tape.zero_order(&x);
+            let dy = replay.first_order_forward(&x, &dx);
+            assert_eq!(replay.y(), tape.y());
+            assert_eq!(dy, tape.first_order_forward(&dx));
+
+            replay.zero_order(&(&x * 2.0));
+            tape.zero_order(&(&x * 2.0));
+            assert_eq!(replay.y(), tape.y());
+        }
+    }
+
+    #[test]
+    fn replay_tape_keeps_constants() {
+        // y = (x + 2 * 3) * 2 with the factor 3 stored in a slot without operation
+        let ops = [
+            Operation::constant(1),
+            Operation::mul(3, 1, 2),
+            Operation::add(4, 0, 3),
+            Operation::mul(5, 4, 1),
+        ];
+        let values = vec![1.0, 2.0, 3.0, 6.0, 7.0, 14.0];
+        let tape = CompactTape::new(vec![0], vec![5, 0, 1], &ops, values);
+        let mut replay = ReplayTape::from_tape(&tape);
+        assert_eq!(replay.y(), adv_dvec![14.0, 1.0, 2.0]);
+        for x in &[1.5, -2.0, 0.0] {
+            replay.zero_order(&adv_dvec![*x]);
+            assert_eq!(replay.y(), adv_dvec![(x + 6.0) * 2.0, *x, 2.0]);
+            let dy = replay.first_order_forward(&adv_dvec![*x], &adv_dvec![1.0]);
+            assert_eq!(dy, adv_dvec![2.0, 1.0, 0.0]);
+        }
+    }
+}
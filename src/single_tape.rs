@@ -0,0 +1,193 @@
+use super::*;
+
+/// Tape storing its values in single precision
+///
+/// Sweeps propagate values and tangents in single precision. Adjoints can be accumulated in
+/// either precision, so the reverse mode of large tapes reads half the value memory while the
+/// gradients keep double precision accumulation.
+#[derive(Debug, Clone)]
+pub struct SingleTape {
+    indeps: Vec<usize>,
+    deps: Vec<usize>,
+    ops: Vec<Operation>,
+    vals: Vec<f32>,
+}
+
+impl SingleTape {
+    pub fn new(indeps: Vec<usize>, deps: Vec<usize>, ops: Vec<Operation>, vals: Vec<f32>) -> Self {
+        Self {
+            indeps,
+            deps,
+            ops,
+            vals,
+        }
+    }
+
+    /// Narrow the values of an arbitrary tape to single precision
+    pub fn from_tape(tape: &dyn Tape) -> Self {
+        Self::new(
+            tape.indeps().to_vec(),
+            tape.deps().to_vec(),
+            tape.ops_iter().collect(),
+            tape.values().iter().map(|val| *val as f32).collect(),
+        )
+    }
+
+    pub fn indeps(&self) -> &[usize] {
+        &self.indeps
+    }
+
+    pub fn deps(&self) -> &[usize] {
+        &self.deps
+    }
+
+    pub fn ops(&self) -> &[Operation] {
+        &self.ops
+    }
+
+    pub fn values(&self) -> &[f32] {
+        &self.vals
+    }
+
+    pub fn num_indeps(&self) -> usize {
+        self.indeps.len()
+    }
+
+    pub fn num_deps(&self) -> usize {
+        self.deps.len()
+    }
+
+    /// Number of bytes used by the values
+    pub fn values_size_in_bytes(&self) -> usize {
+        self.vals.len() * std::mem::size_of::<f32>()
+    }
+
+    pub fn x(&self) -> DVector<f32> {
+        DVector::from_vec(self.indeps.iter().map(|vid| self.vals[*vid]).collect())
+    }
+
+    pub fn y(&self) -> DVector<f32> {
+        DVector::from_vec(self.deps.iter().map(|vid| self.vals[*vid]).collect())
+    }
+
+    /// Evaluate the tape at `x`
+    pub fn zero_order(&mut self, x: &DVector<f32>) {
+        zero_order_sweep(self.ops.iter().cloned(), &self.indeps, &mut self.vals, x);
+    }
+
+    /// Calculate the Jacobian-vector product in single precision
+    pub fn first_order_forward(&self, dx: &DVector<f32>) -> DVector<f32> {
+        assert_eq!(dx.nrows(), self.indeps.len());
+        let mut dv = vec![0.0_f32; self.vals.len()];
+        for (idx, vid) in self.indeps.iter().enumerate() {
+            dv[*vid] = dx[idx];
+        }
+        for op in self.ops.iter() {
+            op.first_order(&self.vals, &mut dv);
+        }
+        DVector::from_vec(self.deps.iter().map(|vid| dv[*vid]).collect())
+    }
+
+    /// Calculate the vector-Jacobian product in single precision
+    pub fn first_order_reverse(&self, ybar: &DVector<f32>) -> DVector<f32> {
+        assert_eq!(ybar.nrows(), self.deps.len());
+        let mut vbar = vec![0.0_f32; self.vals.len()];
+        for (idx, vid) in self.deps.iter().enumerate() {
+            vbar[*vid] += ybar[idx];
+        }
+        for op in self.ops.iter().rev() {
+            op.first_order_reverse(&self.vals, &mut vbar);
+        }
+        DVector::from_vec(self.indeps.iter().map(|vid| vbar[*vid]).collect())
+    }
+
+    /// Calculate the vector-Jacobian product with double precision adjoints into `xbar`
+    pub fn first_order_reverse_mixed_into(
+        &self,
+        ybar: &[f64],
+        xbar: &mut [f64],
+        ws: &mut Workspace,
+    ) {
+        first_order_reverse_sweep(
+            self.ops.iter().cloned(),
+            &self.indeps,
+            &self.deps,
+            &self.vals,
+            ybar,
+            xbar,
+            ws,
+        );
+    }
+
+    /// Calculate the vector-Jacobian product with double precision adjoints
+    pub fn first_order_reverse_mixed(&self, ybar: &DVector<f64>) -> DVector<f64> {
+        let mut xbar = DVector::zeros(self.indeps.len());
+        Workspace::with_local(|ws| {
+            self.first_order_reverse_mixed_into(ybar.as_slice(), xbar.as_mut_slice(), ws)
+        });
+        xbar
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn test_tape() -> impl Tape {
+        let mut ctx = AContext::new();
+        let x = ctx.new_indep_vec(3, 1.0);
+        let mut y = x[0];
+        for i in 0..50 {
+            y = (y * x[i % 3]).sin() + x[(i + 1) % 3] / (x[(i + 2) % 3] + 2.0);
+        }
+        ctx.set_dep(&y);
+        ctx.set_dep(&(x[0].exp() * x[1].powf(x[2])));
+        ctx.tape()
+    }
+
+    #[test]
+    fn single_tape_matches_tape() {
+        let mut tape = test_tape();
+        let mut single = SingleTape::from_tape(&tape);
+        assert_eq!(single.values_size_in_bytes() * 2, tape.values().len() * 8);
+
+        let x = adv_dvec![0.5, 1.5, -0.7];
+        tape.zero_order(&x);
+        single.zero_order(&x.map(|x| x as f32));
+        for (y, y32) in tape.y().iter().zip(single.y().iter()) {
+            assert!((y - *y32 as f64).abs() < 1e-5);
+        }
+
+        let dx = adv_dvec![1.0, -2.0, 0.5];
+        let dy = tape.first_order_forward(&dx);
+        let dy32 = single.first_order_forward(&dx.map(|x| x as f32));
+        for (dy, dy32) in dy.iter().zip(dy32.iter()) {
+            assert!((dy - *dy32 as f64).abs() < 1e-4);
+        }
+
+        let ybar = adv_dvec![1.0, 0.25];
+        let xbar = tape.first_order_reverse(&ybar);
+        let xbar32 = single.first_order_reverse(&ybar.map(|x| x as f32));
+        let mixed = single.first_order_reverse_mixed(&ybar);
+        for i in 0..3 {
+            assert!((xbar[i] - xbar32[i] as f64).abs() < 1e-4);
+            assert!((xbar[i] - mixed[i]).abs() < 1e-4);
+        }
+    }
+
+    #[test]
+    fn mixed_precision_accumulates_in_double() {
+        // With values exactly representable in single precision only the accumulation differs
+        let mut ctx = AContext::new();
+        let x = ctx.new_indep_vec(2, 0.0);
+        let mut y = AFloat::new(0.0, 0.0);
+        for _ in 0..1000 {
+            y += x[0] * x[1];
+        }
+        ctx.set_dep(&y);
+        let mut single = SingleTape::from_tape(&ctx.tape());
+        single.zero_order(&adv_dvec![3.0_f32, 1.0 / 3.0]);
+        let mixed = single.first_order_reverse_mixed(&adv_dvec![0.1]);
+        assert!((mixed[1] - 1000.0 * 0.1 * 3.0).abs() < 1e-10);
+    }
+}
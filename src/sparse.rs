@@ -0,0 +1,321 @@
+use super::*;
+use std::ops::Range;
+
+/// Positions of the nonzero entries of a sparse matrix in compressed row storage
+///
+/// The column indices of row `i` are `col_indices[row_offsets[i]..row_offsets[i + 1]]` and are
+/// sorted in increasing order.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct SparsityPattern {
+    nrows: usize,
+    ncols: usize,
+    row_offsets: Vec<usize>,
+    col_indices: Vec<usize>,
+}
+
+impl SparsityPattern {
+    /// Create a pattern from its compressed row representation
+    pub fn new(
+        nrows: usize,
+        ncols: usize,
+        row_offsets: Vec<usize>,
+        col_indices: Vec<usize>,
+    ) -> Self {
+        assert_eq!(row_offsets.len(), nrows + 1);
+        assert_eq!(row_offsets[0], 0);
+        assert_eq!(row_offsets[nrows], col_indices.len());
+        for i in 0..nrows {
+            let row = &col_indices[row_offsets[i]..row_offsets[i + 1]];
+            assert!(
+                row.windows(2).all(|w| w[0] < w[1]),
+                "Unsorted row in pattern"
+            );
+            assert!(row.iter().all(|j| *j < ncols), "Column index out of bounds");
+        }
+        Self {
+            nrows,
+            ncols,
+            row_offsets,
+            col_indices,
+        }
+    }
+
+    /// Create a pattern from the sorted column indices of each row
+    pub fn from_rows(ncols: usize, rows: Vec<Vec<usize>>) -> Self {
+        let mut row_offsets = Vec::with_capacity(rows.len() + 1);
+        let mut col_indices = Vec::with_capacity(rows.iter().map(Vec::len).sum());
+        row_offsets.push(0);
+        for row in rows.iter() {
+            col_indices.extend_from_slice(row);
+            row_offsets.push(col_indices.len());
+        }
+        Self::new(rows.len(), ncols, row_offsets, col_indices)
+    }
+
+    pub fn nrows(&self) -> usize {
+        self.nrows
+    }
+
+    pub fn ncols(&self) -> usize {
+        self.ncols
+    }
+
+    /// Number of nonzero entries
+    pub fn nnz(&self) -> usize {
+        self.col_indices.len()
+    }
+
+    pub fn row_offsets(&self) -> &[usize] {
+        &self.row_offsets
+    }
+
+    pub fn col_indices(&self) -> &[usize] {
+        &self.col_indices
+    }
+
+    /// Column indices of row `i`
+    pub fn row(&self, i: usize) -> &[usize] {
+        &self.col_indices[self.row_offsets[i]..self.row_offsets[i + 1]]
+    }
+
+    /// Storage index of entry `(i, j)` if it is part of the pattern
+    pub fn index(&self, i: usize, j: usize) -> Option<usize> {
+        self.row(i)
+            .binary_search(&j)
+            .ok()
+            .map(|k| self.row_offsets[i] + k)
+    }
+
+    /// Pattern of the transposed matrix, i.e. the compressed column storage of this pattern
+    pub fn transpose(&self) -> Self {
+        self.transpose_with_permutation().0
+    }
+
+    /// Transposed pattern and the storage index in `self` of each of its entries
+    pub(crate) fn transpose_with_permutation(&self) -> (Self, Vec<usize>) {
+        let mut row_offsets = vec![0; self.ncols + 1];
+        for j in self.col_indices.iter() {
+            row_offsets[j + 1] += 1;
+        }
+        for j in 0..self.ncols {
+            row_offsets[j + 1] += row_offsets[j];
+        }
+        let mut next = row_offsets.clone();
+        let mut col_indices = vec![0; self.nnz()];
+        let mut permutation = vec![0; self.nnz()];
+        for i in 0..self.nrows {
+            for k in self.row_offsets[i]..self.row_offsets[i + 1] {
+                let j = self.col_indices[k];
+                col_indices[next[j]] = i;
+                permutation[next[j]] = k;
+                next[j] += 1;
+            }
+        }
+        let pattern = Self {
+            nrows: self.ncols,
+            ncols: self.nrows,
+            row_offsets,
+            col_indices,
+        };
+        (pattern, permutation)
+    }
+}
+
+/// Sparse matrix in compressed row storage
+#[derive(Debug, Clone, PartialEq)]
+pub struct CsrMatrix {
+    pattern: SparsityPattern,
+    values: Vec<f64>,
+}
+
+impl CsrMatrix {
+    /// Create a matrix from a pattern and one value per entry of the pattern
+    pub fn new(pattern: SparsityPattern, values: Vec<f64>) -> Self {
+        assert_eq!(pattern.nnz(), values.len());
+        Self { pattern, values }
+    }
+
+    /// Create a matrix with all entries of `pattern` set to zero
+    pub fn zeros(pattern: SparsityPattern) -> Self {
+        let values = vec![0.0; pattern.nnz()];
+        Self { pattern, values }
+    }
+
+    /// Collect the entries of a dense matrix which are not zero
+    pub fn from_dense(dense: &DMatrix<f64>) -> Self {
+        let rows = (0..dense.nrows())
+            .map(|i| {
+                (0..dense.ncols())
+                    .filter(|j| dense[(i, *j)] != 0.0)
+                    .collect()
+            })
+            .collect();
+        let pattern = SparsityPattern::from_rows(dense.ncols(), rows);
+        let values = (0..pattern.nrows())
+            .flat_map(|i| pattern.row(i).iter().map(move |j| (i, *j)))
+            .map(|idx| dense[idx])
+            .collect();
+        Self::new(pattern, values)
+    }
+
+    pub fn nrows(&self) -> usize {
+        self.pattern.nrows()
+    }
+
+    pub fn ncols(&self) -> usize {
+        self.pattern.ncols()
+    }
+
+    /// Number of stored entries
+    pub fn nnz(&self) -> usize {
+        self.pattern.nnz()
+    }
+
+    pub fn pattern(&self) -> &SparsityPattern {
+        &self.pattern
+    }
+
+    /// Stored values in the order of the pattern
+    pub fn values(&self) -> &[f64] {
+        &self.values
+    }
+
+    /// Stored values in the order of the pattern (mutable)
+    pub fn values_mut(&mut self) -> &mut [f64] {
+        &mut self.values
+    }
+
+    /// Column indices and values of row `i`
+    pub fn row(&self, i: usize) -> (&[usize], &[f64]) {
+        let range = self.pattern.row_offsets[i]..self.pattern.row_offsets[i + 1];
+        (
+            &self.pattern.col_indices[range.clone()],
+            &self.values[range],
+        )
+    }
+
+    /// Entry `(i, j)` which is zero if it is not stored
+    pub fn get(&self, i: usize, j: usize) -> f64 {
+        self.pattern.index(i, j).map_or(0.0, |k| self.values[k])
+    }
+
+    /// Transposed matrix, i.e. the compressed column storage of this matrix
+    pub fn transpose(&self) -> Self {
+        let (pattern, permutation) = self.pattern.transpose_with_permutation();
+        let values = permutation.into_iter().map(|k| self.values[k]).collect();
+        Self { pattern, values }
+    }
+
+    /// Block of the rows `rows` and columns `cols`
+    pub fn submatrix(&self, rows: Range<usize>, cols: Range<usize>) -> Self {
+        let mut row_offsets = vec![0];
+        let mut col_indices = Vec::new();
+        let mut values = Vec::new();
+        for i in rows.clone() {
+            let (row_cols, row_vals) = self.row(i);
+            for (j, val) in row_cols.iter().zip(row_vals.iter()) {
+                if cols.contains(j) {
+                    col_indices.push(j - cols.start);
+                    values.push(*val);
+                }
+            }
+            row_offsets.push(col_indices.len());
+        }
+        let pattern = SparsityPattern {
+            nrows: rows.len(),
+            ncols: cols.len(),
+            row_offsets,
+            col_indices,
+        };
+        Self { pattern, values }
+    }
+
+    /// Whether all entries are strictly below the diagonal
+    pub fn is_strictly_lower_triangular(&self) -> bool {
+        (0..self.nrows()).all(|i| self.pattern.row(i).iter().all(|j| *j < i))
+    }
+
+    /// Dense representation
+    pub fn to_dense(&self) -> DMatrix<f64> {
+        let mut dense = DMatrix::zeros(self.nrows(), self.ncols());
+        for i in 0..self.nrows() {
+            let (cols, vals) = self.row(i);
+            for (j, val) in cols.iter().zip(vals.iter()) {
+                dense[(i, *j)] = *val;
+            }
+        }
+        dense
+    }
+
+    /// Product with a dense vector
+    pub fn mul_vector(&self, x: &DVector<f64>) -> DVector<f64> {
+        assert_eq!(x.nrows(), self.ncols());
+        DVector::from_fn(self.nrows(), |i, _| {
+            let (cols, vals) = self.row(i);
+            cols.iter()
+                .zip(vals.iter())
+                .map(|(j, val)| val * x[*j])
+                .sum()
+        })
+    }
+
+    /// Product `lhs * self` with a dense matrix
+    pub fn mul_left(&self, lhs: &DMatrix<f64>) -> DMatrix<f64> {
+        assert_eq!(lhs.ncols(), self.nrows());
+        let mut result = DMatrix::zeros(lhs.nrows(), self.ncols());
+        for i in 0..self.nrows() {
+            let (cols, vals) = self.row(i);
+            for (j, val) in cols.iter().zip(vals.iter()) {
+                for r in 0..lhs.nrows() {
+                    result[(r, *j)] += val * lhs[(r, i)];
+                }
+            }
+        }
+        result
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn test_matrix() -> DMatrix<f64> {
+        let mut dense = DMatrix::zeros(3, 4);
+        dense[(0, 1)] = 1.0;
+        dense[(0, 3)] = 2.0;
+        dense[(1, 0)] = 3.0;
+        dense[(2, 1)] = 4.0;
+        dense[(2, 2)] = 5.0;
+        dense
+    }
+
+    #[test]
+    fn csr_matrix_from_dense() {
+        let dense = test_matrix();
+        let csr = CsrMatrix::from_dense(&dense);
+        assert_eq!(csr.nnz(), 5);
+        assert_eq!(csr.pattern().row_offsets(), &[0, 2, 3, 5]);
+        assert_eq!(csr.pattern().col_indices(), &[1, 3, 0, 1, 2]);
+        assert_eq!(csr.values(), &[1.0, 2.0, 3.0, 4.0, 5.0]);
+        assert_eq!(csr.get(2, 2), 5.0);
+        assert_eq!(csr.get(1, 1), 0.0);
+        assert_eq!(csr.to_dense(), dense);
+    }
+
+    #[test]
+    fn csr_matrix_transpose() {
+        let dense = test_matrix();
+        let csr = CsrMatrix::from_dense(&dense);
+        assert_eq!(csr.transpose().to_dense(), dense.transpose());
+        assert_eq!(csr.transpose().transpose(), csr);
+
+        let x = adv_dvec![1.0, -1.0, 2.0, 0.5];
+        assert_eq!(csr.mul_vector(&x), &dense * &x);
+        let lhs = DMatrix::from_fn(2, 3, |i, j| (i + 2 * j) as f64);
+        assert_eq!(csr.mul_left(&lhs), &lhs * &dense);
+        assert_eq!(
+            csr.submatrix(1..3, 1..3).to_dense(),
+            dense.slice((1, 1), (2, 2)).into_owned()
+        );
+    }
+}
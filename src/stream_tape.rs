@@ -0,0 +1,512 @@
+use super::*;
+use std::fmt;
+use std::fs::{File, OpenOptions};
+use std::io::{self, BufWriter, Read, Seek, SeekFrom, Write};
+use std::path::{Path, PathBuf};
+use std::sync::mpsc::{self, Receiver, Sender};
+use std::sync::{Arc, Mutex};
+use std::thread::JoinHandle;
+
+/// Default number of operations per chunk of a streamed tape
+pub const DEFAULT_STREAM_CHUNK_LEN: usize = 1 << 16;
+
+/// Size of an encoded operation in bytes
+pub(crate) const OP_BYTES: usize = 25;
+
+/// Marker for an absent argument in an encoded operation
+const NO_ARG: u64 = u64::MAX;
+
+/// Encode an operation as opcode, result id and arguments in little endian
+pub(crate) fn encode_op(op: &Operation, bytes: &mut [u8]) {
+    let arg = |arg: Option<usize>| arg.map_or(NO_ARG, |arg| arg as u64);
+    bytes[0] = op.opcode as u8;
+    bytes[1..9].copy_from_slice(&(op.vid as u64).to_le_bytes());
+    bytes[9..17].copy_from_slice(&arg(op.arg1).to_le_bytes());
+    bytes[17..25].copy_from_slice(&arg(op.arg2).to_le_bytes());
+}
+
+/// Decode an operation written by `encode_op`
+pub(crate) fn decode_op(bytes: &[u8]) -> Operation {
+    try_decode_op(bytes).expect("Invalid op code")
+}
+
+/// Decode an operation written by `encode_op` if its op code is valid
+pub(crate) fn try_decode_op(bytes: &[u8]) -> Option<Operation> {
+    let word = |idx: usize| {
+        let mut word = [0; 8];
+        word.copy_from_slice(&bytes[idx..idx + 8]);
+        u64::from_le_bytes(word)
+    };
+    let arg = |arg: u64| {
+        if arg == NO_ARG {
+            None
+        } else {
+            Some(arg as usize)
+        }
+    };
+    Some(Operation {
+        opcode: OpCode::from_u8(bytes[0])?,
+        vid: word(1) as usize,
+        arg1: arg(word(9)),
+        arg2: arg(word(17)),
+    })
+}
+
+/// Writes the operations of a recording to a file in chunks
+///
+/// The first write error is kept and reported by `finish`, so recording continues without
+/// writing once the file cannot be written. The file is removed when the writer is dropped
+/// before `finish` hands it to a tape.
+#[derive(Debug)]
+pub(crate) struct OpStreamWriter {
+    path: PathBuf,
+    file: Option<BufWriter<File>>,
+    chunk: Vec<u8>,
+    chunk_len: usize,
+    num_ops: usize,
+    error: Option<io::Error>,
+}
+
+impl OpStreamWriter {
+    pub fn new(path: PathBuf, chunk_len: usize) -> io::Result<Self> {
+        assert!(chunk_len > 0);
+        let file = OpenOptions::new()
+            .write(true)
+            .create(true)
+            .truncate(true)
+            .open(&path)?;
+        Ok(Self {
+            path,
+            file: Some(BufWriter::new(file)),
+            chunk: Vec::with_capacity(chunk_len * OP_BYTES),
+            chunk_len,
+            num_ops: 0,
+            error: None,
+        })
+    }
+
+    /// Append an operation
+    pub fn push(&mut self, op: &Operation) {
+        let offset = self.chunk.len();
+        self.chunk.resize(offset + OP_BYTES, 0);
+        encode_op(op, &mut self.chunk[offset..]);
+        self.num_ops += 1;
+        if self.chunk.len() == self.chunk_len * OP_BYTES {
+            self.flush_chunk();
+        }
+    }
+
+    fn flush_chunk(&mut self) {
+        if self.error.is_none() {
+            let file = self.file.as_mut().unwrap();
+            if let Err(err) = file.write_all(&self.chunk) {
+                self.error = Some(err);
+            }
+        }
+        self.chunk.clear();
+    }
+
+    /// Write all pending operations and close the file
+    fn finish(mut self) -> io::Result<OpStreamFile> {
+        self.flush_chunk();
+        if let Some(err) = self.error.take() {
+            return Err(err);
+        }
+        self.file.take().unwrap().into_inner()?;
+        let file = OpStreamFile::open(self.path.clone(), self.chunk_len, self.num_ops)?;
+        self.path = PathBuf::new();
+        Ok(file)
+    }
+}
+
+impl Drop for OpStreamWriter {
+    fn drop(&mut self) {
+        // The path is empty once `finish` has handed the file off
+        drop(self.file.take());
+        if !self.path.as_os_str().is_empty() {
+            let _ = std::fs::remove_file(&self.path);
+        }
+    }
+}
+
+/// Chunk requested from the reader thread of an `OpStreamFile` and where to send it
+type ChunkRequest = (usize, Sender<io::Result<Vec<Operation>>>);
+
+/// File holding the operations of a streamed tape which is removed when dropped
+///
+/// One reader thread owns the open file for as long as the tape exists and serves the chunk
+/// requests of all iterators in order.
+#[derive(Debug)]
+struct OpStreamFile {
+    path: PathBuf,
+    chunk_len: usize,
+    num_ops: usize,
+    requests: Option<Mutex<Sender<ChunkRequest>>>,
+    reader: Option<JoinHandle<()>>,
+}
+
+impl OpStreamFile {
+    fn open(path: PathBuf, chunk_len: usize, num_ops: usize) -> io::Result<Self> {
+        let mut file = File::open(&path)?;
+        let (requests, received) = mpsc::channel::<ChunkRequest>();
+        let reader = std::thread::spawn(move || {
+            for (idx, reply) in received {
+                let _ = reply.send(read_chunk(&mut file, chunk_len, num_ops, idx));
+            }
+        });
+        Ok(Self {
+            path,
+            chunk_len,
+            num_ops,
+            requests: Some(Mutex::new(requests)),
+            reader: Some(reader),
+        })
+    }
+
+    fn num_chunks(&self) -> usize {
+        (self.num_ops + self.chunk_len - 1) / self.chunk_len
+    }
+
+    /// Ask the reader thread to send chunk `idx` to `reply`
+    fn request(&self, idx: usize, reply: &Sender<io::Result<Vec<Operation>>>) {
+        let requests = self.requests.as_ref().unwrap().lock().unwrap();
+        requests
+            .send((idx, reply.clone()))
+            .expect("Tape stream reader stopped");
+    }
+}
+
+impl Drop for OpStreamFile {
+    fn drop(&mut self) {
+        // The reader thread stops once no more requests can arrive
+        drop(self.requests.take());
+        if let Some(reader) = self.reader.take() {
+            let _ = reader.join();
+        }
+        let _ = std::fs::remove_file(&self.path);
+    }
+}
+
+/// Read and decode chunk `idx` of a stream of `num_ops` operations
+fn read_chunk(
+    file: &mut File,
+    chunk_len: usize,
+    num_ops: usize,
+    idx: usize,
+) -> io::Result<Vec<Operation>> {
+    let start = idx * chunk_len;
+    let len = chunk_len.min(num_ops - start);
+    let mut bytes = vec![0; len * OP_BYTES];
+    file.seek(SeekFrom::Start((start * OP_BYTES) as u64))?;
+    file.read_exact(&mut bytes)?;
+    bytes
+        .chunks(OP_BYTES)
+        .map(|bytes| {
+            try_decode_op(bytes)
+                .ok_or_else(|| io::Error::new(io::ErrorKind::InvalidData, "Invalid op code"))
+        })
+        .collect()
+}
+
+/// One end of a `ChunkIter` with the chunk it reads from and the chunk being prefetched
+struct ChunkCursor {
+    chunk: Vec<Operation>,
+    chunk_idx: Option<usize>,
+    /// Chunk requested from the reader thread but not received yet
+    pending: Option<usize>,
+    reply: Sender<io::Result<Vec<Operation>>>,
+    received: Receiver<io::Result<Vec<Operation>>>,
+}
+
+impl ChunkCursor {
+    fn new() -> Self {
+        let (reply, received) = mpsc::channel();
+        Self {
+            chunk: Vec::new(),
+            chunk_idx: None,
+            pending: None,
+            reply,
+            received,
+        }
+    }
+
+    /// Wait for the oldest requested chunk
+    ///
+    /// Sweeps cannot return errors, so a failed read panics.
+    fn receive(&self) -> Vec<Operation> {
+        self.received
+            .recv()
+            .expect("Tape stream reader stopped")
+            .expect("Cannot read tape stream")
+    }
+
+    /// Operation `pos` of the stream, read from chunk `idx`
+    ///
+    /// Requests chunk `next` in the background whenever a chunk is loaded.
+    fn get(
+        &mut self,
+        file: &OpStreamFile,
+        pos: usize,
+        idx: usize,
+        next: Option<usize>,
+    ) -> Operation {
+        if self.chunk_idx != Some(idx) {
+            let prefetched = match self.pending.take() {
+                Some(pending) => Some(self.receive()).filter(|_| pending == idx),
+                None => None,
+            };
+            self.chunk = match prefetched {
+                Some(chunk) => chunk,
+                None => {
+                    file.request(idx, &self.reply);
+                    self.receive()
+                }
+            };
+            self.chunk_idx = Some(idx);
+            if let Some(next) = next {
+                file.request(next, &self.reply);
+                self.pending = Some(next);
+            }
+        }
+        self.chunk[pos - idx * file.chunk_len]
+    }
+}
+
+/// Iterator reading the operations of a streamed tape chunk by chunk from both ends
+struct ChunkIter {
+    file: Arc<OpStreamFile>,
+    front: usize,
+    back: usize,
+    front_cursor: ChunkCursor,
+    back_cursor: ChunkCursor,
+}
+
+impl Iterator for ChunkIter {
+    type Item = Operation;
+
+    fn next(&mut self) -> Option<Operation> {
+        if self.front == self.back {
+            return None;
+        }
+        let idx = self.front / self.file.chunk_len;
+        let next = if (idx + 1) * self.file.chunk_len < self.back {
+            Some(idx + 1)
+        } else {
+            None
+        };
+        let op = self.front_cursor.get(&self.file, self.front, idx, next);
+        self.front += 1;
+        Some(op)
+    }
+
+    fn size_hint(&self) -> (usize, Option<usize>) {
+        let len = self.back - self.front;
+        (len, Some(len))
+    }
+}
+
+impl DoubleEndedIterator for ChunkIter {
+    fn next_back(&mut self) -> Option<Operation> {
+        if self.front == self.back {
+            return None;
+        }
+        self.back -= 1;
+        let idx = self.back / self.file.chunk_len;
+        let next = if idx > 0 && idx * self.file.chunk_len > self.front {
+            Some(idx - 1)
+        } else {
+            None
+        };
+        Some(self.back_cursor.get(&self.file, self.back, idx, next))
+    }
+}
+
+/// Tape whose operations are stored in a chunked file
+///
+/// Operations are read back chunk by chunk, in reverse order for reverse sweeps, while the next
+/// chunk is prefetched. The values stay in memory. The file is removed when the last clone of the
+/// tape is dropped.
+#[derive(Clone)]
+pub struct StreamTape {
+    indeps: Vec<usize>,
+    deps: Vec<usize>,
+    vals: Vec<f64>,
+    file: Arc<OpStreamFile>,
+}
+
+impl StreamTape {
+    pub(crate) fn new(
+        indeps: Vec<usize>,
+        deps: Vec<usize>,
+        vals: Vec<f64>,
+        stream: OpStreamWriter,
+    ) -> io::Result<Self> {
+        Ok(Self {
+            indeps,
+            deps,
+            vals,
+            file: Arc::new(stream.finish()?),
+        })
+    }
+
+    /// Path of the operation file
+    pub fn path(&self) -> &Path {
+        &self.file.path
+    }
+
+    /// Number of operations
+    pub fn num_ops(&self) -> usize {
+        self.file.num_ops
+    }
+
+    /// Number of chunks of the operation file
+    pub fn num_chunks(&self) -> usize {
+        self.file.num_chunks()
+    }
+
+    fn chunk_iter(&self) -> ChunkIter {
+        ChunkIter {
+            file: self.file.clone(),
+            front: 0,
+            back: self.file.num_ops,
+            front_cursor: ChunkCursor::new(),
+            back_cursor: ChunkCursor::new(),
+        }
+    }
+}
+
+impl fmt::Debug for StreamTape {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        f.debug_struct("StreamTape")
+            .field("path", &self.file.path)
+            .field("num_indeps", &self.indeps.len())
+            .field("num_deps", &self.deps.len())
+            .field("num_ops", &self.file.num_ops)
+            .field("chunk_len", &self.file.chunk_len)
+            .finish()
+    }
+}
+
+impl Tape for StreamTape {
+    fn indeps(&self) -> &[usize] {
+        &self.indeps
+    }
+
+    fn deps(&self) -> &[usize] {
+        &self.deps
+    }
+
+    fn values(&self) -> &[f64] {
+        &self.vals
+    }
+
+    fn values_mut(&mut self) -> &mut [f64] {
+        &mut self.vals
+    }
+
+    fn ops_iter<'a>(&'a self) -> Box<dyn DoubleEndedIterator<Item = Operation> + 'a> {
+        Box::new(self.chunk_iter())
+    }
+
+    fn zero_order(&mut self, x: &DVector<f64>) {
+        let ops = self.chunk_iter();
+        zero_order_sweep(ops, &self.indeps, &mut self.vals, x);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn stream_path(name: &str) -> PathBuf {
+        std::env::temp_dir().join(format!("adv-stream-{}-{}", std::process::id(), name))
+    }
+
+    fn record(ctx: &mut AContext) {
+        let mut x = ctx.new_indep_vec(3, 1.0);
+        for i in 0..20 {
+            let y = (x[i % 3] * x[(i + 1) % 3]).sin() + x[(i + 2) % 3];
+            x[i % 3] = y;
+        }
+        ctx.set_dep_slice(&x);
+    }
+
+    #[test]
+    fn op_encoding() {
+        let op = Operation {
+            opcode: OpCode::Powf,
+            vid: 12,
+            arg1: Some(3),
+            arg2: None,
+        };
+        let mut bytes = [0; OP_BYTES];
+        encode_op(&op, &mut bytes);
+        assert_eq!(decode_op(&bytes), op);
+    }
+
+    #[test]
+    fn stream_tape_matches_tape() {
+        let mut ctx = AContext::new();
+        record(&mut ctx);
+        let tape = ctx.tape();
+
+        let path = stream_path("matches");
+        let mut ctx = AContext::new_streaming(path.clone(), 7).unwrap();
+        record(&mut ctx);
+        let mut stream = ctx.stream_tape().unwrap();
+        assert_eq!(stream.num_ops(), tape.ops_iter().count());
+        assert_eq!(stream.num_chunks(), (stream.num_ops() + 6) / 7);
+        assert!(path.exists());
+
+        assert_eq!(
+            stream.ops_iter().collect::<Vec<_>>(),
+            tape.ops_iter().collect::<Vec<_>>()
+        );
+        assert_eq!(
+            stream.ops_iter().rev().collect::<Vec<_>>(),
+            tape.ops_iter().rev().collect::<Vec<_>>()
+        );
+        // Both ends meet in the middle
+        {
+            let mut iter = stream.ops_iter();
+            let mut ops = Vec::new();
+            while let Some(op) = iter.next() {
+                ops.push(op);
+                if let Some(op) = iter.next_back() {
+                    ops.push(op);
+                }
+            }
+            assert_eq!(ops.len(), tape.ops_iter().count());
+        }
+
+        let x = adv_dvec![0.5, -1.0, 2.0];
+        let mut reference = tape.clone();
+        reference.zero_order(&x);
+        stream.zero_order(&x);
+        assert_eq!(stream.y(), reference.y());
+        let ybar = adv_dvec![1.0, 2.0, 3.0];
+        assert_eq!(
+            stream.first_order_reverse(&ybar),
+            reference.first_order_reverse(&ybar)
+        );
+
+        drop(stream);
+        assert!(!path.exists());
+    }
+
+    #[test]
+    fn stream_dropped_without_tape() {
+        let path = stream_path("dropped");
+        let mut ctx = AContext::new_streaming(path.clone(), 7).unwrap();
+        record(&mut ctx);
+        assert!(path.exists());
+        drop(ctx);
+        assert!(!path.exists());
+    }
+
+    #[test]
+    fn stream_tape_missing_dir() {
+        let path = stream_path("missing").join("ops");
+        assert!(AContext::new_streaming(path, 7).is_err());
+    }
+}
@@ -15,6 +15,13 @@ pub trait Tape: Send + Sync + fmt::Debug {
     /// Iterate through operations
     fn ops_iter<'a>(&'a self) -> Box<dyn DoubleEndedIterator<Item = Operation> + 'a>;
 
+    /// Operations as a contiguous slice if the tape stores them that way
+    ///
+    /// Sweeps use this to avoid a virtual call per operation.
+    fn ops_slice(&self) -> Option<&[Operation]> {
+        None
+    }
+
     /// Number of independents
     fn num_indeps(&self) -> usize {
         self.indeps().len()
@@ -60,50 +67,460 @@ pub trait Tape: Send + Sync + fmt::Debug {
 
     /// Re-evaluate function from stored evaluation procedure
     fn zero_order(&mut self, x: &DVector<f64>) {
-        assert_eq!(x.nrows(), self.num_indeps());
         let indeps = self.indeps().to_vec();
         let ops = self.ops_iter().collect::<Vec<_>>();
-        let values = self.values_mut();
-        for (idx, vid) in indeps.into_iter().enumerate() {
-            values[vid] = x[idx];
-        }
-        for op in ops.into_iter() {
-            op.zero_order(values);
+        zero_order_sweep(ops, &indeps, self.values_mut(), x);
+    }
+
+    /// Re-evaluate the function at the `B` columns of `x` in one pass over the operations
+    ///
+    /// Returns the `m`×`B` results. The stored values are left untouched.
+    fn zero_order_batch(&self, x: &DMatrix<f64>) -> DMatrix<f64> {
+        let lanes = x.ncols();
+        let xt = x.transpose();
+        let mut yt = DMatrix::zeros(lanes, self.num_deps());
+        Workspace::with_local(|ws| {
+            let values = ws.zeroed(self.values().len() * lanes);
+            self.zero_order_batch_into(xt.as_slice(), values, lanes);
+            for (idx, vid) in self.deps().iter().enumerate() {
+                yt.as_mut_slice()[idx * lanes..(idx + 1) * lanes]
+                    .copy_from_slice(&values[vid * lanes..(vid + 1) * lanes]);
+            }
+        });
+        yt.transpose()
+    }
+
+    /// Re-evaluate the function at the `B` columns of `x` and keep all intermediate values
+    ///
+    /// Column `l` of the result holds the values of point `l` and can be passed as `values` to
+    /// the sweep functions.
+    fn zero_order_batch_values(&self, x: &DMatrix<f64>) -> DMatrix<f64> {
+        let lanes = x.ncols();
+        let xt = x.transpose();
+        let mut values_t = DMatrix::zeros(lanes, self.values().len());
+        self.zero_order_batch_into(xt.as_slice(), values_t.as_mut_slice(), lanes);
+        values_t.transpose()
+    }
+
+    /// Re-evaluate the function at `lanes` interleaved points
+    ///
+    /// `x[i * lanes + l]` is independent `i` of point `l` and `values` receives the intermediate
+    /// values in the same layout.
+    fn zero_order_batch_into(&self, x: &[f64], values: &mut [f64], lanes: usize) {
+        match self.ops_slice() {
+            Some(ops) => zero_order_batch_sweep(
+                ops.iter().cloned(),
+                self.indeps(),
+                self.values(),
+                values,
+                x,
+                lanes,
+            ),
+            None => zero_order_batch_sweep(
+                self.ops_iter(),
+                self.indeps(),
+                self.values(),
+                values,
+                x,
+                lanes,
+            ),
         }
     }
 
     /// Calculate adjoint of Jacobian
     fn first_order_forward(&self, dx: &DVector<f64>) -> DVector<f64> {
-        let v = self.values();
-        let mut dv = vec![0.0; v.len()];
-        for (idx, vid) in self.indeps().iter().enumerate() {
-            dv[*vid] = dx[idx];
-        }
-        for op in self.ops_iter() {
-            op.first_order(v, &mut dv);
-        }
         let mut dy = DVector::zeros(self.num_deps());
-        for (idx, vid) in self.deps().iter().enumerate() {
-            dy[idx] = dv[*vid];
-        }
+        Workspace::with_local(|ws| {
+            self.first_order_forward_into(dx.as_slice(), dy.as_mut_slice(), ws)
+        });
         dy
     }
 
     /// Calculate reverse-adjoint of Jacobian
     fn first_order_reverse(&self, ybar: &DVector<f64>) -> DVector<f64> {
-        let v = self.values();
-        let mut vbar = vec![0.0; v.len()];
-        for (idx, vid) in self.deps().iter().enumerate() {
-            vbar[*vid] = ybar[idx];
+        let mut xbar = DVector::zeros(self.num_indeps());
+        Workspace::with_local(|ws| {
+            self.first_order_reverse_into(ybar.as_slice(), xbar.as_mut_slice(), ws)
+        });
+        xbar
+    }
+
+    /// Calculate adjoint of Jacobian into `dy` using the scratch memory in `ws`
+    fn first_order_forward_into(&self, dx: &[f64], dy: &mut [f64], ws: &mut Workspace) {
+        match self.ops_slice() {
+            Some(ops) => first_order_forward_sweep(
+                ops.iter().cloned(),
+                self.indeps(),
+                self.deps(),
+                self.values(),
+                dx,
+                dy,
+                ws,
+            ),
+            None => first_order_forward_sweep(
+                self.ops_iter(),
+                self.indeps(),
+                self.deps(),
+                self.values(),
+                dx,
+                dy,
+                ws,
+            ),
         }
-        for op in self.ops_iter().rev() {
-            op.first_order_reverse(v, &mut vbar);
+    }
+
+    /// Calculate reverse-adjoint of Jacobian into `xbar` using the scratch memory in `ws`
+    fn first_order_reverse_into(&self, ybar: &[f64], xbar: &mut [f64], ws: &mut Workspace) {
+        match self.ops_slice() {
+            Some(ops) => first_order_reverse_sweep(
+                ops.iter().cloned(),
+                self.indeps(),
+                self.deps(),
+                self.values(),
+                ybar,
+                xbar,
+                ws,
+            ),
+            None => first_order_reverse_sweep(
+                self.ops_iter(),
+                self.indeps(),
+                self.deps(),
+                self.values(),
+                ybar,
+                xbar,
+                ws,
+            ),
         }
-        let mut xbar = DVector::zeros(self.num_indeps());
-        for (idx, vid) in self.indeps().iter().enumerate() {
-            xbar[idx] = vbar[*vid];
+    }
+
+    /// Propagate `k` tangents forward at once
+    ///
+    /// `dx` holds the directions interleaved as `dx[i * k + l]` for independent `i` and direction
+    /// `l`, and `dy` receives the results in the same layout.
+    fn first_order_forward_vector_into(
+        &self,
+        dx: &[f64],
+        dy: &mut [f64],
+        k: usize,
+        ws: &mut Workspace,
+    ) {
+        match self.ops_slice() {
+            Some(ops) => first_order_forward_vector_sweep(
+                ops.iter().cloned(),
+                self.indeps(),
+                self.deps(),
+                self.values(),
+                dx,
+                dy,
+                k,
+                ws,
+            ),
+            None => first_order_forward_vector_sweep(
+                self.ops_iter(),
+                self.indeps(),
+                self.deps(),
+                self.values(),
+                dx,
+                dy,
+                k,
+                ws,
+            ),
         }
-        xbar
+    }
+
+    /// Propagate `k` adjoints backward at once
+    ///
+    /// `ybar` holds the directions interleaved as `ybar[j * k + l]` for dependent `j` and
+    /// direction `l`, and `xbar` receives the results in the same layout.
+    fn first_order_reverse_vector_into(
+        &self,
+        ybar: &[f64],
+        xbar: &mut [f64],
+        k: usize,
+        ws: &mut Workspace,
+    ) {
+        match self.ops_slice() {
+            Some(ops) => first_order_reverse_vector_sweep(
+                ops.iter().cloned(),
+                self.indeps(),
+                self.deps(),
+                self.values(),
+                ybar,
+                xbar,
+                k,
+                ws,
+            ),
+            None => first_order_reverse_vector_sweep(
+                self.ops_iter(),
+                self.indeps(),
+                self.deps(),
+                self.values(),
+                ybar,
+                xbar,
+                k,
+                ws,
+            ),
+        }
+    }
+
+    /// Second-order adjoint sweep by forward-over-reverse differentiation
+    ///
+    /// Propagates the tangent `dx` forward and the adjoint `ybar` backward. `xbar` receives the
+    /// gradient `ybar^T J` and `dxbar` the Hessian-vector product `(∑ ybar_j H_j) dx`.
+    fn second_order_reverse_into(
+        &self,
+        dx: &[f64],
+        ybar: &[f64],
+        xbar: &mut [f64],
+        dxbar: &mut [f64],
+        ws: &mut Workspace,
+    ) {
+        match self.ops_slice() {
+            Some(ops) => second_order_reverse_sweep(
+                || ops.iter().cloned(),
+                self.indeps(),
+                self.deps(),
+                self.values(),
+                dx,
+                ybar,
+                xbar,
+                dxbar,
+                ws,
+            ),
+            None => second_order_reverse_sweep(
+                || self.ops_iter(),
+                self.indeps(),
+                self.deps(),
+                self.values(),
+                dx,
+                ybar,
+                xbar,
+                dxbar,
+                ws,
+            ),
+        }
+    }
+}
+
+/// Number of directions drivers propagate per vector sweep
+pub const SWEEP_BLOCK_WIDTH: usize = 8;
+
+/// Replay `ops` on `values` after setting the independents to `x`
+pub fn zero_order_sweep<I, S>(ops: I, indeps: &[usize], values: &mut [S], x: &DVector<S>)
+where
+    I: IntoIterator<Item = Operation>,
+    S: Float + nalgebra::Scalar,
+{
+    let _timer = profile::time(Timer::ZeroOrder);
+    assert_eq!(x.nrows(), indeps.len());
+    for (idx, vid) in indeps.iter().enumerate() {
+        values[*vid] = x[idx];
+    }
+    for op in ops {
+        op.zero_order(values);
+    }
+}
+
+/// Replay `ops` at `lanes` interleaved points
+///
+/// Every slot of `values` is initialized from the recorded `stored` values, which supplies the
+/// constants, before the independents are set to `x`.
+pub fn zero_order_batch_sweep<I>(
+    ops: I,
+    indeps: &[usize],
+    stored: &[f64],
+    values: &mut [f64],
+    x: &[f64],
+    lanes: usize,
+) where
+    I: IntoIterator<Item = Operation>,
+{
+    let _timer = profile::time(Timer::ZeroOrder);
+    assert_eq!(x.len(), indeps.len() * lanes);
+    assert_eq!(values.len(), stored.len() * lanes);
+    if lanes == 0 {
+        return;
+    }
+    for (row, val) in values.chunks_mut(lanes).zip(stored.iter()) {
+        for v in row.iter_mut() {
+            *v = *val;
+        }
+    }
+    for (idx, vid) in indeps.iter().enumerate() {
+        values[vid * lanes..(vid + 1) * lanes].copy_from_slice(&x[idx * lanes..(idx + 1) * lanes]);
+    }
+    for op in ops {
+        op.zero_order_vector(values, lanes);
+    }
+}
+
+/// Propagate the tangent `dx` forward through `ops` and store the result in `dy`
+pub fn first_order_forward_sweep<I>(
+    ops: I,
+    indeps: &[usize],
+    deps: &[usize],
+    values: &[f64],
+    dx: &[f64],
+    dy: &mut [f64],
+    ws: &mut Workspace,
+) where
+    I: IntoIterator<Item = Operation>,
+{
+    let _timer = profile::time(Timer::Forward);
+    assert_eq!(dx.len(), indeps.len());
+    assert_eq!(dy.len(), deps.len());
+    let dv = ws.zeroed(values.len());
+    for (idx, vid) in indeps.iter().enumerate() {
+        dv[*vid] = dx[idx];
+    }
+    for op in ops {
+        op.first_order(values, dv);
+    }
+    for (idx, vid) in deps.iter().enumerate() {
+        dy[idx] = dv[*vid];
+    }
+}
+
+/// Propagate the adjoint `ybar` backward through `ops` and store the result in `xbar`
+///
+/// Adjoints are accumulated in double precision for values of any precision.
+pub fn first_order_reverse_sweep<I, V>(
+    ops: I,
+    indeps: &[usize],
+    deps: &[usize],
+    values: &[V],
+    ybar: &[f64],
+    xbar: &mut [f64],
+    ws: &mut Workspace,
+) where
+    I: IntoIterator<Item = Operation>,
+    I::IntoIter: DoubleEndedIterator,
+    V: Float + Into<f64>,
+{
+    let _timer = profile::time(Timer::Reverse);
+    assert_eq!(ybar.len(), deps.len());
+    assert_eq!(xbar.len(), indeps.len());
+    let vbar = ws.zeroed(values.len());
+    for (idx, vid) in deps.iter().enumerate() {
+        // Dependents may occur more than once, so their seeds are accumulated
+        vbar[*vid] += ybar[idx];
+    }
+    for op in ops.into_iter().rev() {
+        op.first_order_reverse(values, vbar);
+    }
+    for (idx, vid) in indeps.iter().enumerate() {
+        xbar[idx] = vbar[*vid];
+    }
+}
+
+/// Propagate the `k` interleaved tangents in `dx` forward through `ops` and store them in `dy`
+#[allow(clippy::too_many_arguments)]
+pub fn first_order_forward_vector_sweep<I>(
+    ops: I,
+    indeps: &[usize],
+    deps: &[usize],
+    values: &[f64],
+    dx: &[f64],
+    dy: &mut [f64],
+    k: usize,
+    ws: &mut Workspace,
+) where
+    I: IntoIterator<Item = Operation>,
+{
+    let _timer = profile::time(Timer::Forward);
+    assert_eq!(dx.len(), indeps.len() * k);
+    assert_eq!(dy.len(), deps.len() * k);
+    let dv = ws.zeroed(values.len() * k);
+    for (idx, vid) in indeps.iter().enumerate() {
+        dv[vid * k..(vid + 1) * k].copy_from_slice(&dx[idx * k..(idx + 1) * k]);
+    }
+    for op in ops {
+        op.first_order_vector(values, dv, k);
+    }
+    for (idx, vid) in deps.iter().enumerate() {
+        dy[idx * k..(idx + 1) * k].copy_from_slice(&dv[vid * k..(vid + 1) * k]);
+    }
+}
+
+/// Propagate the `k` interleaved adjoints in `ybar` backward through `ops` and store them in `xbar`
+#[allow(clippy::too_many_arguments)]
+pub fn first_order_reverse_vector_sweep<I>(
+    ops: I,
+    indeps: &[usize],
+    deps: &[usize],
+    values: &[f64],
+    ybar: &[f64],
+    xbar: &mut [f64],
+    k: usize,
+    ws: &mut Workspace,
+) where
+    I: IntoIterator<Item = Operation>,
+    I::IntoIter: DoubleEndedIterator,
+{
+    let _timer = profile::time(Timer::Reverse);
+    assert_eq!(ybar.len(), deps.len() * k);
+    assert_eq!(xbar.len(), indeps.len() * k);
+    let vbar = ws.zeroed(values.len() * k);
+    for (idx, vid) in deps.iter().enumerate() {
+        // Dependents may occur more than once, so their seeds are accumulated
+        for (v, y) in vbar[vid * k..(vid + 1) * k]
+            .iter_mut()
+            .zip(ybar[idx * k..(idx + 1) * k].iter())
+        {
+            *v += y;
+        }
+    }
+    for op in ops.into_iter().rev() {
+        op.first_order_reverse_vector(values, vbar, k);
+    }
+    for (idx, vid) in indeps.iter().enumerate() {
+        xbar[idx * k..(idx + 1) * k].copy_from_slice(&vbar[vid * k..(vid + 1) * k]);
+    }
+}
+
+/// Forward-over-reverse sweep computing the gradient and the Hessian-vector product
+///
+/// `ops` is called twice, for the forward tangent and the reverse adjoint pass.
+#[allow(clippy::too_many_arguments)]
+pub fn second_order_reverse_sweep<F, I>(
+    ops: F,
+    indeps: &[usize],
+    deps: &[usize],
+    values: &[f64],
+    dx: &[f64],
+    ybar: &[f64],
+    xbar: &mut [f64],
+    dxbar: &mut [f64],
+    ws: &mut Workspace,
+) where
+    F: Fn() -> I,
+    I: IntoIterator<Item = Operation>,
+    I::IntoIter: DoubleEndedIterator,
+{
+    let _timer = profile::time(Timer::SecondOrder);
+    assert_eq!(dx.len(), indeps.len());
+    assert_eq!(ybar.len(), deps.len());
+    assert_eq!(xbar.len(), indeps.len());
+    assert_eq!(dxbar.len(), indeps.len());
+    let len = values.len();
+    let buf = ws.zeroed(3 * len);
+    let (dv, buf) = buf.split_at_mut(len);
+    let (vbar, dvbar) = buf.split_at_mut(len);
+    for (idx, vid) in indeps.iter().enumerate() {
+        dv[*vid] = dx[idx];
+    }
+    for op in ops() {
+        op.first_order(values, dv);
+    }
+    for (idx, vid) in deps.iter().enumerate() {
+        vbar[*vid] += ybar[idx];
+    }
+    for op in ops().into_iter().rev() {
+        op.second_order_reverse(values, dv, vbar, dvbar);
+    }
+    for (idx, vid) in indeps.iter().enumerate() {
+        xbar[idx] = vbar[*vid];
+        dxbar[idx] = dvbar[*vid];
     }
 }
 
@@ -134,6 +551,86 @@ mod tests {
         assert!((actual - expected).abs() < std::f64::EPSILON);
     }
 
+    /// Recorded tapes expose their operations as a slice
+    #[test]
+    fn ops_slice_matches_ops_iter() {
+        let tape = adv_fn_obj!(all_arithmetic_test_func).tape(&DVector::from_element(1, 3.0));
+        let ops = tape.ops_slice().unwrap();
+        assert_eq!(ops.to_vec(), tape.ops_iter().collect::<Vec<_>>());
+    }
+
+    /// Record a tape with three outputs, optionally containing an abs-function
+    fn vector_test_tape(with_abs: bool) -> impl Tape {
+        let mut ctx = AContext::new();
+        let x = ctx.new_indep_vec(2, 0.0);
+        let v0 = if with_abs { x[1].abs() } else { x[1] / x[0] };
+        let v1 = x[0] * x[1].sin() + x[0].powf(x[1]) - v0;
+        let v2 = (v1 / x[0]).exp() * x[0] + x[1].atan();
+        ctx.set_dep_slice(&[v1, v2, x[0] * x[0]]);
+        let mut tape = ctx.tape();
+        tape.zero_order(&adv_dvec![1.5, -0.5]);
+        tape
+    }
+
+    /// Vector sweeps agree with one scalar sweep per direction
+    #[test]
+    fn first_order_vector_matches_scalar() {
+        let k = 3;
+        let mut ws = Workspace::new();
+
+        let tape = vector_test_tape(true);
+        let dx = vec![1.0, 0.0, 0.5, 0.0, 1.0, -2.0];
+        let mut dy = vec![0.0; 3 * k];
+        tape.first_order_forward_vector_into(&dx, &mut dy, k, &mut ws);
+        for l in 0..k {
+            let dy_l = tape.first_order_forward(&adv_dvec![dx[l], dx[k + l]]);
+            for j in 0..3 {
+                assert_eq!(dy[j * k + l], dy_l[j]);
+            }
+        }
+
+        let tape = vector_test_tape(false);
+        let ybar = vec![1.0, 0.0, 2.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0];
+        let mut xbar = vec![0.0; 2 * k];
+        tape.first_order_reverse_vector_into(&ybar, &mut xbar, k, &mut ws);
+        for l in 0..k {
+            let xbar_l =
+                tape.first_order_reverse(&adv_dvec![ybar[l], ybar[k + l], ybar[2 * k + l]]);
+            for i in 0..2 {
+                assert_eq!(xbar[i * k + l], xbar_l[i]);
+            }
+        }
+    }
+
+    /// Batched replay agrees with replaying each point separately
+    #[test]
+    fn zero_order_batch_matches_zero_order() {
+        let mut tape = vector_test_tape(true);
+        let x = DMatrix::from_fn(2, 5, |i, j| 0.3 * (j as f64) - 0.4 * (i as f64) + 0.7);
+        let y = tape.zero_order_batch(&x);
+        let values = tape.zero_order_batch_values(&x);
+        let dx = adv_dvec![1.0, -1.0];
+        for l in 0..x.ncols() {
+            let dy_batch = Workspace::with_local(|ws| {
+                let mut dy = vec![0.0; 3];
+                first_order_forward_sweep(
+                    tape.ops_iter(),
+                    tape.indeps(),
+                    tape.deps(),
+                    values.column(l).as_slice(),
+                    dx.as_slice(),
+                    &mut dy,
+                    ws,
+                );
+                dy
+            });
+            tape.zero_order(&x.column(l).into_owned());
+            assert_eq!(y.column(l).into_owned(), tape.y());
+            assert_eq!(values.column(l).as_slice(), tape.values());
+            assert_eq!(dy_batch, tape.first_order_forward(&dx).as_slice());
+        }
+    }
+
     /// Forward-mode AD works on `all_arithmetic_test_func`
     #[test]
     fn first_order_forward_arithmetic() {
@@ -0,0 +1,63 @@
+use std::cell::RefCell;
+
+thread_local! {
+    /// Workspace of the current thread, i.e. one per rayon worker
+    static LOCAL_WORKSPACE: RefCell<Workspace> = RefCell::new(Workspace::new());
+}
+
+/// Scratch memory that is reused across tape sweeps
+///
+/// Sweeps need a tangent or adjoint buffer as large as the tape's value array. Reusing a workspace
+/// avoids allocating that buffer on every call.
+#[derive(Debug, Default, Clone)]
+pub struct Workspace {
+    buffer: Vec<f64>,
+}
+
+impl Workspace {
+    /// Create an empty workspace
+    pub fn new() -> Self {
+        Self { buffer: Vec::new() }
+    }
+
+    /// Get a zeroed buffer of length `len`
+    pub fn zeroed(&mut self, len: usize) -> &mut [f64] {
+        self.buffer.clear();
+        self.buffer.resize(len, 0.0);
+        &mut self.buffer
+    }
+
+    /// Run `f` with the workspace of the current thread
+    ///
+    /// Nested calls get a fresh workspace.
+    pub fn with_local<R, F: FnOnce(&mut Workspace) -> R>(f: F) -> R {
+        let mut ws = LOCAL_WORKSPACE.with(|ws| std::mem::take(&mut *ws.borrow_mut()));
+        let result = f(&mut ws);
+        LOCAL_WORKSPACE.with(|local| {
+            let mut local = local.borrow_mut();
+            if ws.buffer.capacity() > local.buffer.capacity() {
+                *local = ws;
+            }
+        });
+        result
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn workspace_reuse() {
+        let ptr = Workspace::with_local(|ws| ws.zeroed(64).as_ptr());
+        Workspace::with_local(|ws| {
+            let buf = ws.zeroed(32);
+            assert_eq!(buf.as_ptr(), ptr);
+            assert!(buf.iter().all(|x| *x == 0.0));
+            buf[0] = 1.0;
+            // Nested calls must not alias the outer buffer
+            Workspace::with_local(|inner| assert_eq!(inner.zeroed(1)[0], 0.0));
+        });
+        Workspace::with_local(|ws| assert_eq!(ws.zeroed(32)[0], 0.0));
+    }
+}
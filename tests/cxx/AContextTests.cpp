@@ -20,3 +20,32 @@ TEST(AContext, record_simple_tape)
 	auto v2 = v1 * v1;
 	ctx.set_dependent(v2);
 }
+
+TEST(AContext, bulk_variables)
+{
+	adv::AContext ctx;
+	ctx.reserve(16, 32);
+	auto x = ctx.new_independents(4);
+	ASSERT_EQ(x.size(), 4u);
+	std::vector<adv::ADouble> y;
+	for (std::size_t i = 1; i < x.size(); ++i) {
+		y.push_back(x[i - 1] * x[i]);
+	}
+	ctx.set_dependents(y);
+
+	adv::ADouble z[2];
+	ctx.new_independents(z, 2);
+	ctx.set_dependents(z, 2);
+}
+
+TEST(AContext, empty_variables)
+{
+	adv::AContext ctx;
+	EXPECT_TRUE(ctx.new_independents(0).empty());
+	ctx.new_independents(nullptr, 0);
+	ctx.set_dependents(std::vector<adv::ADouble> {});
+	ctx.set_dependents(nullptr, 0);
+	adv::Tape tape(std::move(ctx));
+	EXPECT_EQ(tape.num_independents(), 0u);
+	EXPECT_EQ(tape.num_dependents(), 0u);
+}
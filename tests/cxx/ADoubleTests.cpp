@@ -1,6 +1,8 @@
 #include <gtest/gtest.h>
 #include <adv.hpp>
 
+#include <cmath>
+
 TEST(ADouble, arithmetic_ops)
 {
 	adv::AContext ctx;
@@ -53,3 +55,41 @@ TEST(ADouble, binary_functions)
 	adv::max(1.0, 0.0);
 	ASSERT_EQ(1.0, adv::max(1.0, 0.0));
 }
+
+TEST(ADouble, values)
+{
+	adv::AContext ctx;
+	auto a = ctx.new_independent();
+	auto b = a + 2.0;
+
+	ASSERT_EQ(0.0, a.value());
+	ASSERT_EQ(2.0, b.value());
+	ASSERT_EQ(2.0, (2.0 - a).value());
+	ASSERT_EQ(0.0, (2.0 * a).value());
+
+	auto c = b;
+	c = c * 3.0;
+	ASSERT_EQ(2.0, b.value());
+	ASSERT_EQ(6.0, c.value());
+}
+
+TEST(ADouble, record_block)
+{
+	adv::AContext ctx;
+	auto x = ctx.new_independent();
+	adv::ADouble inputs[] = { x, adv::ADouble(2.0) };
+	// x * 2 + x
+	adv::BlockOp ops[] = { { 4, 0, 1 }, { 2, 2, 0 } };
+	ASSERT_EQ(0.0, adv::ADouble::record_block(inputs, 2, ops, 2).value());
+
+	// Unknown op codes, arguments after the operation and missing arguments
+	adv::BlockOp invalid[][1] = {
+		{ { 1u << 8 | 4, 0, 1 } },
+		{ { 4, 0, 2 } },
+		{ { 4, 0, adv::BlockOp::NO_ARG } },
+	};
+	for (auto& op : invalid) {
+		ASSERT_TRUE(std::isnan(adv::ADouble::record_block(inputs, 2, op, 1).value()));
+	}
+	ASSERT_TRUE(std::isnan(adv::ADouble::record_block(nullptr, 0, nullptr, 0).value()));
+}
@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+#include <adv.hpp>
+
+#include <vector>
+
+/// Tape of f(x) = x0 * x1 + sin(x2) / 2 - exp(x0) * x2 recorded eagerly or as one expression
+static adv::Tape record_test_tape(bool lazy)
+{
+	adv::AContext ctx;
+	auto x = ctx.new_independents(3);
+	adv::ADouble y;
+	if (lazy) {
+		y = adv::lazy(x[0]) * x[1] + adv::sin(adv::lazy(x[2])) / 2.0 - adv::exp(adv::lazy(x[0])) * x[2];
+	}
+	else {
+		y = x[0] * x[1] + adv::sin(x[2]) / 2.0 - adv::exp(x[0]) * x[2];
+	}
+	ctx.set_dependent(y);
+	ctx.set_dependent(-adv::lazy(x[1]) + 1.0);
+	adv::Tape tape(std::move(ctx));
+
+	double x0[] = { 0.5, -1.0, 2.0 };
+	double y0[2];
+	tape.zero_order(x0, y0);
+	return tape;
+}
+
+TEST(Expression, matches_eager_recording)
+{
+	auto lazy = record_test_tape(true);
+	auto eager = record_test_tape(false);
+
+	double x[] = { 0.5, -1.0, 2.0 };
+	double y_lazy[2];
+	double y_eager[2];
+	lazy.zero_order(x, y_lazy);
+	eager.zero_order(x, y_eager);
+	EXPECT_DOUBLE_EQ(y_lazy[0], y_eager[0]);
+	EXPECT_DOUBLE_EQ(y_lazy[1], 2.0);
+
+	std::vector<double> jac_lazy(6);
+	std::vector<double> jac_eager(6);
+	lazy.jacobian(jac_lazy.data());
+	eager.jacobian(jac_eager.data());
+	for (std::size_t i = 0; i < 3; ++i) {
+		EXPECT_DOUBLE_EQ(jac_lazy[i], jac_eager[i]);
+	}
+	EXPECT_EQ(std::vector<double>(jac_lazy.begin() + 3, jac_lazy.end()), (std::vector<double> { 0.0, -1.0, 0.0 }));
+}
+
+TEST(Expression, passive_values)
+{
+	adv::ADouble a(2.0);
+	adv::ADouble b = adv::lazy(a) * a + 1.0;
+	EXPECT_EQ(b.value(), 5.0);
+	EXPECT_EQ((3.0 * adv::abs(adv::lazy(-1.0))).evaluate().value(), 3.0);
+	EXPECT_EQ(adv::lazy(a).evaluate().value(), 2.0);
+}
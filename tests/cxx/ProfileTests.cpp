@@ -0,0 +1,38 @@
+#include <gtest/gtest.h>
+#include <adv.hpp>
+
+static adv::Tape record_tape()
+{
+	adv::AContext ctx;
+	auto x = ctx.new_independents(2);
+	ctx.set_dependent(adv::sin(x[0] * x[1]));
+	return adv::Tape(std::move(ctx));
+}
+
+TEST(Profile, disabled_by_default)
+{
+	EXPECT_FALSE(adv::Profile::enabled());
+	adv::Profile::reset();
+	record_tape();
+	auto json = adv::Profile::json();
+	EXPECT_EQ(json.find("{\"enabled\":false,\"recorded_ops\":0,"), 0u);
+}
+
+TEST(Profile, counts_and_times)
+{
+	adv::Profile::reset();
+	adv::Profile::enable();
+	EXPECT_TRUE(adv::Profile::enabled());
+	auto tape = record_tape();
+	double x[] = { 1.0, 2.0 };
+	double y[1];
+	tape.zero_order(x, y);
+	adv::Profile::disable();
+
+	auto json = adv::Profile::json();
+	EXPECT_NE(json.find("\"recorded_ops\":2,\"opcodes\":{\"Mul\":1,\"Sin\":1}"), std::string::npos);
+	EXPECT_NE(json.find("\"recorded_tapes\":1,"), std::string::npos);
+	EXPECT_NE(json.find("\"zero_order\":{\"calls\":1,"), std::string::npos);
+	EXPECT_EQ(json.back(), '}');
+	adv::Profile::reset();
+}
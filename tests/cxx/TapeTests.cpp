@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include <adv.hpp>
+
+#include <vector>
+
+/// Tape of f(x) = (x0 * x1, x0 - x1) or (x0 * x1, |x0 - x1|) evaluated at (2, 3)
+static adv::Tape record_test_tape(bool with_abs = false)
+{
+	adv::AContext ctx;
+	auto x = ctx.new_independents(2);
+	ctx.set_dependent(x[0] * x[1]);
+	ctx.set_dependent(with_abs ? adv::abs(x[0] - x[1]) : x[0] - x[1]);
+	adv::Tape tape(std::move(ctx));
+
+	double x0[] = { 2.0, 3.0 };
+	double y[2];
+	tape.zero_order(x0, y);
+	return tape;
+}
+
+TEST(Tape, dimensions)
+{
+	auto tape = record_test_tape(true);
+	EXPECT_EQ(tape.num_independents(), 2u);
+	EXPECT_EQ(tape.num_dependents(), 2u);
+	EXPECT_EQ(tape.num_abs(), 1u);
+}
+
+TEST(Tape, zero_order)
+{
+	auto tape = record_test_tape();
+	double x[] = { 1.0, 4.0 };
+	double y[2];
+	tape.zero_order(x, y);
+	EXPECT_DOUBLE_EQ(y[0], 4.0);
+	EXPECT_DOUBLE_EQ(y[1], -3.0);
+}
+
+TEST(Tape, first_order)
+{
+	auto tape = record_test_tape();
+	double dx[] = { 1.0, 0.0 };
+	double dy[2];
+	tape.first_order_forward(dx, dy);
+	EXPECT_DOUBLE_EQ(dy[0], 3.0);
+	EXPECT_DOUBLE_EQ(dy[1], 1.0);
+
+	double ybar[] = { 1.0, 1.0 };
+	double xbar[2];
+	tape.first_order_reverse(ybar, xbar);
+	EXPECT_DOUBLE_EQ(xbar[0], 4.0);
+	EXPECT_DOUBLE_EQ(xbar[1], 1.0);
+}
+
+TEST(Tape, jacobian)
+{
+	auto tape = record_test_tape();
+	std::vector<double> jac(4);
+	tape.jacobian(jac.data());
+	EXPECT_EQ(jac, (std::vector<double> { 3.0, 2.0, 1.0, -1.0 }));
+}
+
+TEST(Tape, abs_normal)
+{
+	auto tape = record_test_tape(true);
+	double a, zmat[2], lmat, b[2], jmat[4], ymat[2];
+	tape.abs_normal(&a, zmat, &lmat, b, jmat, ymat);
+	EXPECT_DOUBLE_EQ(a, -1.0);
+	EXPECT_DOUBLE_EQ(zmat[0], 1.0);
+	EXPECT_DOUBLE_EQ(zmat[1], -1.0);
+	EXPECT_DOUBLE_EQ(lmat, 0.0);
+	EXPECT_DOUBLE_EQ(b[0], 0.0);
+	EXPECT_DOUBLE_EQ(b[1], -1.0);
+	EXPECT_DOUBLE_EQ(jmat[0], 3.0);
+	EXPECT_DOUBLE_EQ(jmat[1], 2.0);
+	EXPECT_DOUBLE_EQ(jmat[2], 0.0);
+	EXPECT_DOUBLE_EQ(jmat[3], 0.0);
+	EXPECT_DOUBLE_EQ(ymat[0], 0.0);
+	EXPECT_DOUBLE_EQ(ymat[1], 1.0);
+}
+
+TEST(Tape, empty_buffers)
+{
+	// Without dependents or Abs operations the corresponding buffers may be null
+	adv::AContext ctx;
+	ctx.new_independents(2);
+	adv::Tape tape(std::move(ctx));
+	double x0[] = { 2.0, 3.0 };
+	double xbar[2];
+	tape.zero_order(x0, nullptr);
+	tape.first_order_forward(x0, nullptr);
+	tape.first_order_reverse(nullptr, xbar);
+	EXPECT_DOUBLE_EQ(xbar[0], 0.0);
+	EXPECT_DOUBLE_EQ(xbar[1], 0.0);
+	tape.jacobian(nullptr);
+	tape.abs_normal(nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);
+}
+
+TEST(Tape, stats_json)
+{
+	auto tape = record_test_tape();
+	auto json = tape.stats_json();
+	EXPECT_EQ(json.find("{\"num_indeps\":2,\"num_deps\":2,\"num_values\":4,\"num_ops\":2,"), 0u);
+	EXPECT_NE(json.find("\"peak_live_values\":4,\"opcodes\":{\"Sub\":1,\"Mul\":1}"), std::string::npos);
+	EXPECT_EQ(json.back(), '}');
+}